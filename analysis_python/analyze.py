@@ -11,26 +11,70 @@ import struct
 import numpy as np
 import threading
 from typing import Dict, Any, List
-from collections import deque
 
 from config import config
-from utils import SignalProcessor, DetectionLogger, CLIDisplay, DataBuffer
+from demodulator import FSKDemodulator
+from detection import CFARDetector
+from governor import CPUGovernor, QualityLevel, quality_levels
+from matched_filter import BeaconTemplate, MatchedFilterBank
+from periodicity import PeriodicityAnalyzer, subband_envelope, subband_starts
+from pipeline import AnalysisPipeline
+from receiver import PacketReceiver
+from shadow import ShadowConfigs
+from shard import ShardSupervisor
+from tracking import PeakTracker
+from utils import BandSpec, SignalProcessor, DetectionLogger, CLIDisplay, DataBuffer
+
+# Control messages sent back to the capture daemon on the same socket
+CONTROL_MESSAGE_FORMAT = '<IIQ'
+CONTROL_MAGIC = 0x4D435453  # "STCM"
+CONTROL_TRIGGER_CLIP = 1
+
+# What a shard worker sends back of each stream's analysis; the spectra
+# of every resolution and frame stay in the worker
+SHARD_RESULT_KEYS = ('capture_timestamp', 'threat_level', 'detections', 'tracks', 'matched_beacons',
+                     'beacons', 'payloads', 'periodicity', 'features', 'ultrasonic_frequencies',
+                     'ultrasonic_magnitudes', 'peaks', 'shadow')
 
 class UltrasonicDetector:
     """Main ultrasonic signal detector class"""
     
     def __init__(self):
         self.config = config
+        
+        # Quality level the analysis runs at, stepped down and up to keep
+        # it within the CPU budget
+        system = self.config.system
+        self.governor = CPUGovernor(
+            quality_levels(system.quality_levels), system.cpu_budget, system.cpu_headroom,
+            system.governor_window_sec, system.governor_hold_sec
+        )
+        
+        window_size, overlap_ratio, bands, window_sizes = self.analysis_settings(self.governor.current)
         self.processor = SignalProcessor(
             sample_rate=self.config.audio.sample_rate,
-            window_size=self.config.audio.fft_window_size
+            window_size=window_size,
+            overlap_ratio=overlap_ratio,
+            bands=bands,
+            window_sizes=window_sizes
         )
         self.logger = DetectionLogger(self.config.alerts.log_file_path)
         self.display = CLIDisplay()
         self.data_buffer = DataBuffer(self.config.dashboard.max_history_points)
         
         # Detection state
-        self.detection_history = deque(maxlen=50)
+        detection = self.config.detection
+        self.tracker = PeakTracker(
+            detection.track_gate_hz, detection.track_alpha, detection.track_beta,
+            detection.track_timeout_sec, detection.repetition_threshold,
+            detection.repetition_window_sec
+        )
+        self.alert_tracks = []
+        self.matched_beacons = []
+        
+        # Alternative detector settings run on the same spectra; their
+        # decisions are recorded, never alerted on
+        self.shadow = ShadowConfigs(detection, detection.shadow_configs, detection.shadow_log_path)
         self.last_alert_time = 0
         self.running = False
         self.stats = {
@@ -40,15 +84,51 @@ class UltrasonicDetector:
             'false_positives': 0
         }
         
+        # CFAR detectors by (window size, band)
+        self.detectors = {}
+        
+        # Repetition period of the ultrasonic sub-band envelopes, rebuilt
+        # when the frame rate or bins change
+        self.periodicity = None
+        self.periodicity_key = None
+        self.subband_starts = None
+        
+        # Known beacon waveforms, correlated against the stream; rebuilt
+        # when the sample rate changes
+        self.matched_filters = None
+        
+        # FSK demodulators locked onto matched alphabets, by template name
+        self.demodulators = {}
+        
+        # Set while a quality level has the beacon analysis off; it
+        # restarts from scratch when turned back on
+        self.beacons_paused = False
+        
+        # Capture time where the last packet ended, for spotting gaps
+        self.stream_end_ms = None
+        
         # Socket connection
         self.socket = None
+        self.receiver = None
         self.connect_attempts = 0
         
+        # Receiver, analysis workers and sink threads, while running
+        self.pipeline = None
+        
+        # Worker processes and the sockets of every capture daemon, when
+        # channels are analyzed as streams of their own
+        self.shards = None
+        self.source_sockets = {}
+        
     def connect_to_audio_source(self) -> bool:
         """Connect to the C audio capture module via Unix socket"""
         try:
             self.socket = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
             self.socket.connect(self.config.system.socket_path)
+            # Packets stay valid while queued and analyzed: one being
+            # received, a full queue, and a worker catching up holds the
+            # one it took plus at most a queue's worth it drained
+            self.receiver = PacketReceiver(self.socket, 2 * self.config.system.pipeline_queue_size + 2)
             self.logger.log_info("Connected to audio capture module")
             return True
         except Exception as e:
@@ -58,210 +138,770 @@ class UltrasonicDetector:
     def receive_audio_data(self) -> Dict[str, Any]:
         """Receive audio data from C module"""
         try:
-            # Receive header (timestamp, sample_rate, buffer_length, channels)
-            header_data = self.socket.recv(16)  # 8+4+4 bytes
-            if len(header_data) != 16:
-                raise ConnectionError("Incomplete header received")
-            
-            timestamp, sample_rate, buffer_length, channels = struct.unpack('QII', header_data)
-            
-            # Receive audio data
-            data_size = buffer_length * channels * 2  # 2 bytes per sample (int16)
-            audio_data_bytes = b''
-            
-            while len(audio_data_bytes) < data_size:
-                chunk = self.socket.recv(data_size - len(audio_data_bytes))
-                if not chunk:
-                    raise ConnectionError("Connection closed by audio source")
-                audio_data_bytes += chunk
-            
-            # Convert to numpy array
-            audio_data = np.frombuffer(audio_data_bytes, dtype=np.int16)
-            
-            # Normalize to [-1, 1] range
-            audio_data = audio_data.astype(np.float32) / 32768.0
-            
-            return {
-                'timestamp': timestamp,
-                'sample_rate': sample_rate,
-                'audio_data': audio_data,
-                'channels': channels
-            }
-            
+            return self.receiver.receive()
         except Exception as e:
-            self.logger.log_error(f"Error receiving audio data: {e}")
+            # Closing the socket is how a stopped pipeline's receiver ends
+            if self.running:
+                self.logger.log_error(f"Error receiving audio data: {e}")
             return None
     
-    def analyze_audio_chunk(self, audio_data: np.ndarray) -> Dict[str, Any]:
-        """Analyze audio chunk for ultrasonic signals"""
-        # Compute FFT
-        frequencies, magnitudes = self.processor.compute_fft(audio_data)
-        
-        # Extract ultrasonic band
-        us_freq, us_mag = self.processor.extract_ultrasonic_band(
-            frequencies, magnitudes,
-            self.config.audio.ultrasonic_min_freq,
-            self.config.audio.ultrasonic_max_freq
-        )
+    def request_evidence_clip(self, capture_timestamp: int, source: str = None):
+        """Ask the capture daemon (source, or the only one) to save the audio around this packet"""
+        sock = self.source_sockets.get(source, self.socket)
+        if sock is None or capture_timestamp is None:
+            return
+        try:
+            message = struct.pack(CONTROL_MESSAGE_FORMAT, CONTROL_MAGIC,
+                                  CONTROL_TRIGGER_CLIP, capture_timestamp)
+            sock.sendall(message)
+        except OSError as e:
+            self.logger.log_error(f"Failed to request evidence clip: {e}")
+    
+    def analysis_bands(self, quality: QualityLevel = None) -> tuple:
+        """Configured bands the quality level keeps, the ultrasonic detection band first"""
+        audio = self.config.audio
+        quality = quality or self.governor.current
+        zoom = 1.0 if quality.zoom else 0.0
+        bands = [BandSpec('ultrasonic', audio.ultrasonic_min_freq, audio.ultrasonic_max_freq,
+                          zoom * audio.ultrasonic_zoom_resolution_hz)]
+        if quality.bands:
+            for name, band in audio.bands.items():
+                bands.append(BandSpec(name, band['min_freq'], band['max_freq'],
+                                      zoom * band.get('zoom_resolution_hz', 0.0)))
+        return tuple(bands)
+    
+    def analysis_settings(self, quality: QualityLevel) -> tuple:
+        """Primary window size, overlap, bands and further window sizes at a quality level"""
+        audio = self.config.audio
+        window_size = max(1, int(round(audio.fft_window_size * quality.fft_window_scale)))
+        overlap_ratio = audio.overlap_ratio
+        if quality.overlap_ratio is not None:
+            overlap_ratio = min(overlap_ratio, quality.overlap_ratio)
+        window_sizes = tuple(audio.fft_window_sizes) if quality.extra_resolutions else ()
+        return window_size, overlap_ratio, self.analysis_bands(quality), window_sizes
+    
+    def packet_audio(self, audio_packet: Dict[str, Any]) -> tuple:
+        """
+        Mono samples of a packet, and whether it starts after a gap in the
+        stream
+        """
+        audio = audio_packet['audio_data']
+        channels = audio_packet['channels']
+        if channels > 1:
+            audio = audio.reshape(-1, channels).mean(axis=1)
         
-        # Detect peaks
-        peaks = self.processor.detect_peaks(
-            us_mag,
-            self.config.detection.threshold_db,
-            self.config.detection.min_peak_height,
-            self.config.detection.min_peak_distance
-        )
+        # Packets are contiguous seconds stamped when sent; one that starts
+        # well after the previous one ended (gated or dropped seconds) must
+        # not be stitched onto its overlap
+        duration_ms = len(audio) * 1000.0 / audio_packet['sample_rate']
+        start_ms = audio_packet['timestamp'] - duration_ms
+        gap = self.stream_end_ms is not None and start_ms - self.stream_end_ms > duration_ms / 2
+        self.stream_end_ms = audio_packet['timestamp']
+        return audio, gap
+    
+    def continue_spectral_stream(self, sample_rate: int, gap: bool, quality: QualityLevel = None):
+        """
+        Follow the packet's sample rate and the quality level; restart the
+        STFT after a gap
+        """
+        # Follows the rate the daemon actually captured at; the plan is
+        # only rebuilt when something changed. A new window size or hop
+        # restarts the framing, and detectors relearn the new bins' floor.
+        self.processor.configure(sample_rate, *self.analysis_settings(quality or self.governor.current))
+        if gap:
+            self.processor.reset_stream()
+            if self.periodicity is not None:
+                self.periodicity.reset()
+    
+    def continue_beacon_stream(self, gap: bool):
+        """Restart the matched filters and demodulators after a gap"""
+        if gap:
+            if self.matched_filters is not None:
+                self.matched_filters.reset_stream()
+            for demodulator in self.demodulators.values():
+                demodulator.reset_stream()
+    
+    def continue_stream(self, audio_packet: Dict[str, Any]) -> np.ndarray:
+        """Mono samples of a packet, restarting the analysis after a gap"""
+        audio, gap = self.packet_audio(audio_packet)
+        self.continue_spectral_stream(audio_packet['sample_rate'], gap)
+        self.continue_beacon_stream(gap)
+        return audio
+    
+    def detect_in_band(self, window_size: int, band: str,
+                       batch_spectra: List[Dict[int, Dict[str, Any]]],
+                       durations_sec: List[float]) -> List[np.ndarray]:
+        """
+        Peak indices in one band at one resolution, for every packet of the
+        processor's last batch (batch_spectra as it returned them)
+        """
+        detection = self.config.detection
+        min_distance = self.min_peak_distance(detection, window_size)
+        if detection.detector == 'minmax':
+            return [self.processor.detect_peaks(spectra[window_size][band][1], detection.threshold_db,
+                                                detection.min_peak_height, min_distance)
+                    for spectra in batch_spectra]
         
-        # Calculate spectral features
-        features = self.processor.calculate_spectral_features(us_mag)
+        # One detector per band and resolution: each keeps a noise floor
+        # per bin, so it is rebuilt when the bins change
+        n_bins = len(batch_spectra[0][window_size][band][1])
+        key = (window_size, band)
+        detector = self.detectors.get(key)
+        if detector is None or detector.n_bins != n_bins:
+            detector = CFARDetector(
+                n_bins, detection.cfar_mode, detection.cfar_guard_bins,
+                detection.cfar_training_bins, detection.cfar_pfa, detection.floor_sigma,
+                detection.floor_time_constant_sec, detection.threshold_db, min_distance
+            )
+            self.detectors[key] = detector
+        return [peaks for peaks, _ in detector.detect_batch(*self.band_block(window_size, band, durations_sec))]
+    
+    def shadow_detect_in_band(self, window_size: int, band: str, n_bins: int,
+                              durations_sec: List[float]) -> List[List[np.ndarray]]:
+        """
+        detect_in_band for every shadow configuration at once; per packet
+        one array of peak indices per configuration
+        """
+        detection = self.config.detection
+        key = (window_size, band)
+        bank = self.shadow.banks.get(key)
+        if bank is None or bank.n_bins != n_bins:
+            settings = self.shadow.settings
+            bank = CFARDetector(
+                n_bins, detection.cfar_mode, detection.cfar_guard_bins, detection.cfar_training_bins,
+                [s.cfar_pfa for s in settings], [s.floor_sigma for s in settings],
+                [s.floor_time_constant_sec for s in settings], [s.threshold_db for s in settings],
+                [self.min_peak_distance(s, window_size) for s in settings]
+            )
+            self.shadow.banks[key] = bank
+        return [peaks for peaks, _ in bank.detect_batch(*self.band_block(window_size, band, durations_sec))]
+    
+    def min_peak_distance(self, detection, window_size: int) -> int:
+        """min_peak_distance in bins of window_size"""
+        # It is given in bins of the primary window; keep it the same
+        # distance in Hz at other resolutions
+        return max(1, int(round(detection.min_peak_distance * window_size / self.processor.window_size)))
+    
+    def band_block(self, window_size: int, band: str, durations_sec: List[float]) -> tuple:
+        """Frame power of the processor's last batch, frames per packet and each packet's frame duration"""
+        power = self.processor.block_power[window_size][band]
+        counts = self.processor.block_counts[window_size][band]
+        frame_secs = [duration / count if count else duration for duration, count in zip(durations_sec, counts)]
+        return power, counts, frame_secs
+    
+    def update_periodicity(self, resolution_spectra: Dict[int, Dict[str, Any]]) -> List[Dict[str, Any]]:
+        """
+        Feed the ultrasonic sub-band envelopes of this packet's frames to the
+        periodicity analyzer, at the finest resolution for the highest frame
+        rate
+        Returns: one entry per sub-band that has a period estimate
+        """
+        detection = self.config.detection
+        window_size = min(size for size, spectra in resolution_spectra.items() if 'ultrasonic' in spectra)
+        frequencies = resolution_spectra[window_size]['ultrasonic'][0]
+        frame_rate = self.processor.frame_rate(window_size, 'ultrasonic')
+        key = (window_size, frame_rate, len(frequencies))
+        if self.periodicity_key != key:
+            self.subband_starts = subband_starts(frequencies, detection.periodicity_subband_hz)
+            self.periodicity = PeriodicityAnalyzer(
+                len(self.subband_starts), frame_rate, detection.periodicity_min_period_sec,
+                detection.periodicity_max_period_sec, detection.periodicity_history_sec
+            )
+            self.periodicity_key = key
         
-        # Determine if detection is significant
-        detections = []
-        if len(peaks) > 0:
-            for peak_idx in peaks:
-                detection = {
-                    'frequency': us_freq[peak_idx],
-                    'magnitude': us_mag[peak_idx],
-                    'peak_index': peak_idx,
-                    'timestamp': time.time(),
-                    'features': features
-                }
-                detections.append(detection)
+        power = self.processor.frame_power[window_size]['ultrasonic']
+        results = self.periodicity.update(subband_envelope(power, self.subband_starts))
         
-        return {
-            'frequencies': frequencies,
-            'magnitudes': magnitudes,
-            'ultrasonic_frequencies': us_freq,
-            'ultrasonic_magnitudes': us_mag,
-            'peaks': peaks,
-            'detections': detections,
-            'features': features
-        }
+        ends = np.append(self.subband_starts[1:], len(frequencies)) - 1
+        periodicity = []
+        for start, end, result in zip(self.subband_starts, ends, results):
+            if result is not None:
+                periodicity.append(dict(result, min_freq=float(frequencies[start]),
+                                        max_freq=float(frequencies[end])))
+        return periodicity
     
-    def evaluate_detection_pattern(self, detections: List[Dict[str, Any]]) -> str:
-        """Evaluate detection pattern to determine threat level"""
-        if not detections:
-            return "normal"
+    def match_templates(self, audio_data: np.ndarray, sample_rate: int) -> Dict[str, Dict[str, Any]]:
+        """Per-template scores and matches of the configured beacon waveforms"""
+        detection = self.config.detection
+        if not detection.beacon_templates:
+            return {}
+        if self.matched_filters is None or self.matched_filters.sample_rate != sample_rate:
+            self.matched_filters = MatchedFilterBank(
+                [BeaconTemplate.from_dict(spec) for spec in detection.beacon_templates],
+                sample_rate, self.config.audio.ultrasonic_min_freq,
+                self.config.audio.ultrasonic_max_freq, detection.matched_filter_threshold_db
+            )
+        return self.matched_filters.process(audio_data)
+    
+    def demodulate(self, audio_data: np.ndarray, beacons: Dict[str, Dict[str, Any]]) -> List[Dict[str, Any]]:
+        """
+        Lock a demodulator onto every FSK alphabet the matched filters found
+        and run all locked ones over the packet
+        Returns: the payload frames completed in this packet
+        """
+        detection = self.config.detection
+        if self.matched_filters is None:
+            return []
+        for template in self.matched_filters.templates:
+            if template.kind == 'fsk' and beacons[template.name]['matches'] and \
+                    template.name not in self.demodulators:
+                self.demodulators[template.name] = FSKDemodulator(
+                    template.frequencies, template.duration_sec, self.matched_filters.sample_rate,
+                    detection.demod_oversampling, detection.demod_squelch_db,
+                    detection.demod_frame_gap_symbols, detection.demod_min_frame_symbols
+                )
         
-        current_time = time.time()
+        payloads = []
+        for name, demodulator in list(self.demodulators.items()):
+            for frame in demodulator.process(audio_data):
+                frame['template'] = name
+                payloads.append(frame)
+            if demodulator.idle_sec > detection.demod_timeout_sec:
+                del self.demodulators[name]
+        return payloads
+    
+    def fuse_detections(self, candidates: List[Dict[str, Any]]) -> List[Dict[str, Any]]:
+        """
+        Merge peaks seen at several resolutions into one detection each.
+        The finest resolution goes first and sets the frequency; a coarser
+        peak joins it when they are within the coarser one's bin width.
+        """
+        fused = []
+        for candidate in sorted(candidates, key=lambda c: c['bin_width']):
+            for detection in fused:
+                if abs(detection['frequency'] - candidate['frequency']) <= candidate['bin_width']:
+                    detection['magnitude'] = max(detection['magnitude'], candidate['magnitude'])
+                    detection['window_sizes'].append(candidate['window_size'])
+                    break
+            else:
+                candidate['window_sizes'] = [candidate['window_size']]
+                fused.append(candidate)
+        fused.sort(key=lambda d: d['frequency'])
+        return fused
+    
+    def analyze_spectra(self, audio_data: np.ndarray, capture_time: float = None) -> Dict[str, Any]:
+        """Spectra, detections, periodicity and features of a packet"""
+        return self.analyze_spectra_batch([audio_data], [capture_time])[0]
+    
+    def analyze_spectra_batch(self, audio_blocks: List[np.ndarray], capture_times: List[float],
+                              quality: QualityLevel = None) -> List[Dict[str, Any]]:
+        """
+        analyze_spectra for consecutive packets at once: the frames of all
+        of them are transformed, run through the CFAR test and measured as
+        one block, and the results are split back per packet, the same as
+        packet by packet. capture_times (seconds, None for now) stamp each
+        packet's detections.
+        """
+        quality = quality or self.governor.current
+        # Spectra of the configured bands only, at every resolution
+        batch_spectra = self.processor.compute_resolution_spectra_batch(audio_blocks)
+        primary = self.processor.window_size
+        durations_sec = [len(audio) / self.processor.sample_rate for audio in audio_blocks]
         
-        # Add detections to history
-        for detection in detections:
-            self.detection_history.append(detection)
-        
-        # Count recent detections
-        recent_detections = [
-            d for d in self.detection_history
-            if current_time - d['timestamp'] <= self.config.detection.repetition_window_sec
-        ]
-        
-        # Check for repetitive pattern
-        if len(recent_detections) >= self.config.detection.repetition_threshold:
-            # Check if frequencies are similar (potential beacon)
-            frequencies = [d['frequency'] for d in recent_detections]
-            freq_std = np.std(frequencies)
+        # Detect peaks, every resolution
+        found = {size: self.detect_in_band(size, 'ultrasonic', batch_spectra, durations_sec)
+                 for size, spectra in batch_spectra[0].items() if 'ultrasonic' in spectra}
+        
+        # The same for all shadow configurations, in one pass per resolution
+        shadow_found = {}
+        if self.shadow:
+            shadow_found = {size: self.shadow_detect_in_band(size, 'ultrasonic',
+                                                             len(batch_spectra[0][size]['ultrasonic'][1]),
+                                                             durations_sec)
+                            for size in found}
+        
+        # Spectral features: once for each packet's peak-held spectrum, for
+        # the logs and display, and per frame for anything finer
+        us_freq = batch_spectra[0][primary]['ultrasonic'][0]
+        features = self.processor.calculate_spectral_features_batch(
+            np.stack([spectra[primary]['ultrasonic'][1] for spectra in batch_spectra]), us_freq)
+        if quality.frame_features:
+            frame_features = self.processor.block_frame_features(primary, 'ultrasonic')
+        else:
+            frame_features = [None] * len(audio_blocks)
+        
+        results = []
+        for i, resolution_spectra in enumerate(batch_spectra):
+            self.processor.frame_power = self.processor.batch_frame_power[i]
+            band_spectra = resolution_spectra[primary]
+            us_mag = band_spectra['ultrasonic'][1]
             
-            if freq_std < 100:  # Frequencies within 100Hz - likely same source
-                return "alert"
-            else:
-                return "warning"
+            # Peaks of every resolution, fused into one detection per
+            # signal, stamped with when the packet was captured
+            timestamp = capture_times[i] if capture_times[i] is not None else time.time()
+            detections = self.fuse_detections(self.peak_candidates(
+                resolution_spectra, {size: peaks[i] for size, peaks in found.items()}, timestamp))
+            
+            # Detections in a sub-band whose envelope repeats carry its period
+            periodicity = self.update_periodicity(resolution_spectra)
+            self.mark_periodic(detections, periodicity, self.config.detection.periodicity_min_confidence)
+            
+            # Each shadow configuration's detections go to its own tracker
+            shadow = {}
+            for k, (name, settings) in enumerate(zip(self.shadow.names, self.shadow.settings)):
+                shadow_detections = self.fuse_detections(self.peak_candidates(
+                    resolution_spectra, {size: peaks[i][k] for size, peaks in shadow_found.items()}, timestamp))
+                periodic = self.mark_periodic(shadow_detections, periodicity, settings.periodicity_min_confidence)
+                shadow[name] = self.shadow.assess(k, shadow_detections, periodic, timestamp)
+            
+            results.append({
+                'band_spectra': band_spectra,
+                'resolution_spectra': resolution_spectra,
+                'ultrasonic_frequencies': us_freq,
+                'ultrasonic_magnitudes': us_mag,
+                'peaks': found[primary][i],
+                'detections': detections,
+                'periodicity': periodicity,
+                'features': features[i],
+                'frame_features': frame_features[i],
+                'shadow': shadow
+            })
+        return results
+    
+    def peak_candidates(self, resolution_spectra: Dict[int, Dict[str, Any]],
+                        peaks: Dict[int, np.ndarray], timestamp: float) -> List[Dict[str, Any]]:
+        """One detection per ultrasonic peak index, by window size, for fuse_detections"""
+        candidates = []
+        for window_size, spectra in resolution_spectra.items():
+            if 'ultrasonic' not in spectra:
+                continue
+            freqs, mags = spectra['ultrasonic']
+            bin_width = float(freqs[1] - freqs[0]) if len(freqs) > 1 else 0.0
+            for peak_idx in peaks[window_size]:
+                candidates.append({
+                    'frequency': float(freqs[peak_idx]),
+                    'magnitude': float(mags[peak_idx]),
+                    'peak_index': peak_idx,
+                    'window_size': window_size,
+                    'bin_width': bin_width,
+                    'timestamp': timestamp
+                })
+        return candidates
+    
+    @staticmethod
+    def mark_periodic(detections: List[Dict[str, Any]], periodicity: List[Dict[str, Any]],
+                      min_confidence: float) -> bool:
+        """
+        Give detections in a sub-band found periodic with at least
+        min_confidence its period. Returns whether any got one.
+        """
+        periodic = False
+        for detection in detections:
+            for band in periodicity:
+                if band['min_freq'] <= detection['frequency'] <= band['max_freq'] and \
+                        band['confidence'] >= min_confidence:
+                    detection['periodicity'] = band
+                    periodic = True
+        return periodic
+    
+    def analyze_beacons(self, audio_data: np.ndarray, sample_rate: int) -> Dict[str, Any]:
+        """Known beacon waveforms and the payloads decoded from them"""
+        beacons = self.match_templates(audio_data, sample_rate)
+        return {'beacons': beacons, 'payloads': self.demodulate(audio_data, beacons)}
+    
+    def analyze_audio_chunk(self, audio_data: np.ndarray) -> Dict[str, Any]:
+        """Analyze audio chunk for ultrasonic signals"""
+        analysis = self.analyze_spectra(audio_data)
+        analysis.update(self.analyze_beacons(audio_data, self.processor.sample_rate))
+        return analysis
+    
+    def evaluate_detection_pattern(self, detections: List[Dict[str, Any]],
+                                   timestamp: float = None, beacons: Dict[str, Any] = None) -> str:
+        """Evaluate detection pattern to determine threat level"""
+        # Every update goes to the tracker, also an empty one: tracks that
+        # were not hit count a miss
+        hit_tracks = self.tracker.update(detections, timestamp if timestamp is not None else time.time())
+        self.alert_tracks = [t for t in hit_tracks if self.tracker.is_alerting(t)]
+        
+        # A detection in a sub-band that pulses on a steady schedule alerts
+        # right away, without waiting for its track to collect hits
+        periodic = any('periodicity' in d for d in detections)
+        
+        # So does a match with a known beacon waveform, best one first
+        beacons = beacons or {}
+        self.matched_beacons = sorted((name for name, result in beacons.items() if result['matches']),
+                                      key=lambda name: beacons[name]['score_db'], reverse=True)
+        
+        if self.alert_tracks or periodic or self.matched_beacons:
+            return "alert"
         elif len(detections) > 0:
             return "warning"
         else:
             return "normal"
     
-    def handle_detections(self, analysis: Dict[str, Any]):
-        """Handle detection events with appropriate alerts and logging"""
+    def assess_analysis(self, analysis: Dict[str, Any]) -> str:
+        """
+        Threat level of an analyzed packet; the alerting tracks and matched
+        beacons behind it are added to the analysis
+        """
+        capture_timestamp = analysis.get('capture_timestamp')
+        threat_level = self.evaluate_detection_pattern(
+            analysis['detections'], capture_timestamp / 1000.0 if capture_timestamp is not None else None,
+            analysis.get('beacons', {}))
+        analysis['threat_level'] = threat_level
+        analysis['tracks'] = [t.summary() for t in self.alert_tracks]
+        analysis['matched_beacons'] = self.matched_beacons
+        
+        # Shadow configurations share the beacon matches
+        analysis['shadow'] = {name: ShadowConfigs.threat_level(assessment, self.matched_beacons)
+                              for name, assessment in analysis.get('shadow', {}).items()}
+        return threat_level
+    
+    def report_analysis(self, analysis: Dict[str, Any], stream: str = None, source: str = None):
+        """
+        Display, log and store an assessed packet. stream names the input
+        it came from when several are analyzed, source its capture daemon.
+        """
         detections = analysis['detections']
-        threat_level = self.evaluate_detection_pattern(detections)
+        capture_timestamp = analysis.get('capture_timestamp')
+        beacons = analysis.get('beacons', {})
+        threat_level = analysis['threat_level']
+        tracks = analysis['tracks']
+        matched_beacons = analysis['matched_beacons']
+        quality = analysis.get('quality')
+        prefix = f"[{stream}] " if stream is not None else ""
         
         current_time = time.time()
         
         # Update statistics
         self.stats['total_detections'] += len(detections)
         
-        # Display status
+        # Display status; with many streams only the ones that found
+        # something
         if threat_level == "normal":
-            self.display.show_status("Listening... | 🔊 Normal ambient noise", "normal")
+            if stream is None:
+                self.display.show_status("Listening... | 🔊 Normal ambient noise", "normal")
         elif threat_level == "warning" and detections:
             freq = detections[0]['frequency']
             mag = detections[0]['magnitude']
-            self.display.show_status(f"Ultrasound spike at {freq:.1f}Hz detected!", "warning")
+            self.display.show_status(f"{prefix}Ultrasound spike at {freq:.1f}Hz detected!", "warning")
             
             # Detailed detection display
             if current_time - self.last_alert_time > self.config.alerts.alert_cooldown_sec:
-                self.display.show_detection(freq, mag, detections[0]['features'])
+                self.display.show_detection(freq, mag, analysis['features'])
                 self.last_alert_time = current_time
         elif threat_level == "alert":
-            self.display.show_status("Repetitive ultrasonic pulses detected (possible beacon signal)", "alert")
+            if matched_beacons:
+                name = matched_beacons[0]
+                symbols = ' '.join(str(symbol) for symbol in beacons[name]['symbols'])
+                self.display.show_status(f"{prefix}Known beacon waveform '{name}' matched"
+                                         + (f" (symbols {symbols})" if symbols else ""), "alert")
+            elif tracks:
+                track = tracks[0]
+                self.display.show_status(f"{prefix}Repetitive ultrasonic pulses at {track['frequency']:.1f}Hz "
+                                         f"(track {track['track_id']}, possible beacon signal)", "alert")
+            else:
+                detection = next(d for d in detections if 'periodicity' in d)
+                self.display.show_status(f"{prefix}Ultrasonic pulses every "
+                                         f"{detection['periodicity']['period_sec']:.2f}s "
+                                         f"at {detection['frequency']:.1f}Hz (possible beacon signal)", "alert")
+            
+            # Have the capture daemon keep the audio around this alert
+            if self.config.alerts.enable_evidence_clips:
+                self.request_evidence_clip(capture_timestamp, source)
             
             # Log critical detection
             if self.config.alerts.enable_file_logging:
+                alerting = {t['track_id']: t for t in tracks}
                 for detection in detections:
-                    self.logger.log_detection({
+                    track = alerting.get(detection.get('track_id'))
+                    if track is None and 'periodicity' not in detection:
+                        continue
+                    self.logger.log_detection(self._tagged({
                         'type': 'repetitive_ultrasonic_beacon',
                         'frequency': detection['frequency'],
                         'magnitude': detection['magnitude'],
                         'threat_level': threat_level,
-                        'features': detection['features']
-                    })
+                        'features': analysis['features'],
+                        'track': track,
+                        'periodicity': detection.get('periodicity')
+                    }, stream, quality))
+                for name in matched_beacons:
+                    self.logger.log_detection(self._tagged({
+                        'type': 'known_beacon_waveform',
+                        'template': name,
+                        'score_db': beacons[name]['score_db'],
+                        'matches': beacons[name]['matches'],
+                        'symbols': beacons[name]['symbols'],
+                        'threat_level': threat_level
+                    }, stream, quality))
+        
+        # Decoded beacon payloads are kept for attribution whatever the
+        # threat level
+        if self.config.alerts.enable_file_logging:
+            for payload in analysis.get('payloads', []):
+                self.logger.log_detection(self._tagged(
+                    dict(payload, type='beacon_payload', capture_timestamp=capture_timestamp), stream, quality))
+        
+        # Shadow configurations' decisions, next to this one
+        if analysis.get('shadow'):
+            self.shadow.record(capture_timestamp, threat_level, analysis['shadow'], stream)
         
         # Store data for dashboard
-        self.data_buffer.add({
+        entry = {
             'analysis': analysis,
             'threat_level': threat_level,
-            'detections': detections
-        })
+            'detections': detections,
+            'tracks': tracks
+        }
+        # Stamped with the capture time, which is not now when catching up
+        self.data_buffer.add(self._tagged(entry, stream, quality),
+                             capture_timestamp / 1000.0 if capture_timestamp is not None else None)
+    
+    @staticmethod
+    def _tagged(record: Dict[str, Any], stream: str, quality: str) -> Dict[str, Any]:
+        if stream is not None:
+            record['stream'] = stream
+        if quality is not None:
+            record['quality'] = quality
+        return record
+    
+    def handle_detections(self, analysis: Dict[str, Any]):
+        """Handle detection events with appropriate alerts and logging"""
+        self.assess_analysis(analysis)
+        self.report_analysis(analysis)
+    
+    def analyze_packet(self, audio_packet: Dict[str, Any]) -> Dict[str, Any]:
+        """
+        Analyze and assess one packet without displaying or logging it, as
+        a shard worker does for each of its streams
+        Returns: the parts of the analysis report_analysis() and the
+        dashboard use
+        """
+        analysis = self.analyze_audio_chunk(self.continue_stream(audio_packet))
+        analysis['capture_timestamp'] = audio_packet['timestamp']
+        self.assess_analysis(analysis)
+        return {key: analysis[key] for key in SHARD_RESULT_KEYS}
+    
+    def receive_stage(self) -> Dict[str, Any]:
+        """Next packet for the analysis workers, None at the end of the stream"""
+        audio_packet = self.receive_audio_data()
+        if audio_packet is None:
+            return None
+        audio, gap = self.packet_audio(audio_packet)
+        return {
+            'audio': audio,
+            'sample_rate': audio_packet['sample_rate'],
+            'timestamp': audio_packet['timestamp'],
+            'gap': gap
+        }
+    
+    def spectral_worker(self, packet: Dict[str, Any]) -> Dict[str, Any]:
+        """Analysis worker owning the STFT, detectors and periodicity"""
+        return self.spectral_batch_worker([packet])[0]
+    
+    def spectral_batch_worker(self, packets: List[Dict[str, Any]]) -> List[Dict[str, Any]]:
+        """spectral_worker for a backlog of packets, analyzed as one block"""
+        quality = self.governor.current
+        start_time = time.perf_counter()
+        results = []
+        # A gap or a new sample rate restarts the stream, and with it the
+        # block
+        start = 0
+        for end in range(1, len(packets) + 1):
+            if end < len(packets) and not packets[end]['gap'] and \
+                    packets[end]['sample_rate'] == packets[start]['sample_rate']:
+                continue
+            run = packets[start:end]
+            self.continue_spectral_stream(run[0]['sample_rate'], run[0]['gap'], quality)
+            results.extend(self.analyze_spectra_batch([packet['audio'] for packet in run],
+                                                      [packet['timestamp'] / 1000.0 for packet in run],
+                                                      quality))
+            start = end
+        
+        # Each packet's share of the time, for the governor
+        analysis_sec = (time.perf_counter() - start_time) / len(packets)
+        for result in results:
+            result['timing'] = (quality.index, analysis_sec)
+        return results
+    
+    def beacon_worker(self, packet: Dict[str, Any]) -> Dict[str, Any]:
+        """Analysis worker owning the matched filters and demodulators"""
+        quality = self.governor.current
+        start_time = time.perf_counter()
+        if quality.beacons:
+            self.continue_beacon_stream(packet['gap'] or self.beacons_paused)
+            self.beacons_paused = False
+            result = self.analyze_beacons(packet['audio'], packet['sample_rate'])
+        else:
+            self.beacons_paused = True
+            result = {'beacons': {}, 'payloads': []}
+        result['timing'] = (quality.index, time.perf_counter() - start_time)
+        return result
+    
+    def govern(self, packet: Dict[str, Any], timings: List[tuple]):
+        """
+        Account the workers' time on a packet against the CPU budget, and
+        log a quality level change
+        """
+        # Workers run side by side; the slowest one sets the pace
+        levels = {level for level, _ in timings}
+        if len(levels) != 1:
+            return
+        audio_sec = len(packet['audio']) / packet['sample_rate']
+        change = self.governor.update(levels.pop(), audio_sec, max(sec for _, sec in timings))
+        if change is None:
+            return
+        direction = "lowered" if change['level'] > change['from_level'] else "raised"
+        self.logger.log_info(
+            f"Analysis quality {direction} to level {change['level']} '{change['name']}' "
+            f"(load {change['load']:.2f} s per audio second, budget {change['budget']:.2f})"
+        )
+    
+    def output_stage(self, packet: Dict[str, Any], parts: Dict[str, Dict[str, Any]]):
+        """Display, logging and dashboard for one analyzed packet, in stream order"""
+        timings = [part.pop('timing') for part in parts.values()]
+        self.govern(packet, timings)
+        analysis = parts['spectra']
+        analysis.update(parts['beacons'])
+        analysis['capture_timestamp'] = packet['timestamp']
+        
+        # A packet analyzed below full quality says so in the log and
+        # dashboard records
+        level = max(level for level, _ in timings)
+        if level > 0:
+            analysis['quality'] = self.governor.levels[level].name
+        
+        # Handle detections
+        self.handle_detections(analysis)
+        
+        # Update statistics
+        self.stats['chunks_processed'] += 1
+        
+        # Display periodic statistics
+        if self.stats['chunks_processed'] % 10 == 0:
+            runtime = time.time() - self.stats['start_time']
+            stats_display = {
+                'runtime': f"{runtime:.0f}",
+                'chunks_processed': self.stats['chunks_processed'],
+                'pipeline': self.pipeline.snapshot(),
+                'quality': self.governor.snapshot()
+            }
+            self.display.show_statistics(stats_display)
+    
+    def stage_failed(self, stage: str, error: Exception):
+        """A pipeline stage raised; the pipeline stops after this"""
+        self.logger.log_error(f"Analysis error in {stage} stage: {error}")
+        if self.config.system.enable_debug_logging:
+            import traceback
+            traceback.print_exception(type(error), error, error.__traceback__)
     
     def run_analysis_loop(self):
-        """Main analysis loop"""
+        """
+        Main analysis loop: the receiver, the analysis workers and the
+        output stage run on their own threads, so a slow terminal or log
+        write no longer holds up the next receive
+        """
         self.display.show_banner()
         self.logger.log_info("SilentTrace analysis started")
         
         self.running = True
+        self.pipeline = AnalysisPipeline(
+            self.receive_stage,
+            {'spectra': self.spectral_worker, 'beacons': self.beacon_worker},
+            self.output_stage,
+            self.config.system.pipeline_queue_size,
+            self.stage_failed,
+            batch_workers={'spectra': self.spectral_batch_worker},
+            catch_up_backlog=self.config.system.catch_up_backlog
+        )
         
+        try:
+            self.pipeline.start()
+            self.pipeline.wait()
+        except KeyboardInterrupt:
+            self.logger.log_info("Analysis interrupted by user")
+    
+    def feed_shards(self, source: str, sock: socket.socket):
+        """Receive one capture daemon's packets and hand them to the shard workers"""
+        receiver = PacketReceiver(sock)
         while self.running:
             try:
-                # Receive audio data
-                audio_packet = self.receive_audio_data()
-                if audio_packet is None:
-                    break
-                
-                # Analyze audio
-                analysis = self.analyze_audio_chunk(audio_packet['audio_data'])
-                
-                # Handle detections
-                self.handle_detections(analysis)
-                
-                # Update statistics
-                self.stats['chunks_processed'] += 1
-                
-                # Display periodic statistics
-                if self.stats['chunks_processed'] % 10 == 0:
-                    runtime = time.time() - self.stats['start_time']
-                    stats_display = {
-                        'runtime': f"{runtime:.0f}",
-                        'chunks_processed': self.stats['chunks_processed']
-                    }
-                    self.display.show_statistics(stats_display)
-                
-            except KeyboardInterrupt:
-                self.logger.log_info("Analysis interrupted by user")
-                break
+                packet = receiver.receive()
             except Exception as e:
-                self.logger.log_error(f"Analysis error: {e}")
-                if self.config.system.enable_debug_logging:
-                    import traceback
-                    traceback.print_exc()
-                break
+                if self.running:
+                    self.logger.log_error(f"Error receiving audio data from {source}: {e}")
+                return
+            try:
+                self.shards.submit(source, packet)
+            except RuntimeError as e:
+                if self.running:
+                    self.logger.log_error(f"Cannot analyze audio from {source}: {e}")
+                return
+    
+    def shard_result(self, stream: str, source: str, result: Dict[str, Any]):
+        """One stream's analysis from a shard worker, reported in packet order"""
+        self.report_analysis(result, stream, source)
+        self.stats['chunks_processed'] += 1
+        
+        # Periodic statistics, about every ten packets of every stream
+        if self.stats['chunks_processed'] % (10 * max(len(self.shards.owners), 1)) == 0:
+            runtime = time.time() - self.stats['start_time']
+            self.display.show_statistics({
+                'runtime': f"{runtime:.0f}",
+                'chunks_processed': self.stats['chunks_processed'],
+                'pipeline': self.shards.snapshot()
+            })
+    
+    def run_sharded(self, n_processes: int):
+        """
+        Analyze every channel of every capture daemon as a stream of its
+        own, spread over n_processes worker processes; their detections are
+        reported here as one stream
+        """
+        self.display.show_banner()
+        self.logger.log_info(f"SilentTrace analysis started with {n_processes} worker processes")
+        
+        system = self.config.system
+        self.source_sockets = {system.socket_path: self.socket}
+        for path in system.extra_sources:
+            try:
+                sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+                sock.connect(path)
+                self.source_sockets[path] = sock
+            except OSError as e:
+                self.logger.log_error(f"Failed to connect to audio source {path}: {e}")
+        
+        self.running = True
+        self.shards = ShardSupervisor(n_processes, UltrasonicDetector, self.shard_result,
+                                      system.shard_queue_slots, system.shard_load_factor,
+                                      self.logger.log_error)
+        self.shards.start()
+        feeders = [threading.Thread(target=self.feed_shards, args=(path, sock),
+                                    name=f'silenttrace-feed-{i}', daemon=True)
+                   for i, (path, sock) in enumerate(self.source_sockets.items())]
+        for feeder in feeders:
+            feeder.start()
         
-        self.cleanup()
+        try:
+            # Short joins keep this thread responsive to Ctrl-C
+            for feeder in feeders:
+                while self.running and feeder.is_alive():
+                    feeder.join(0.1)
+        except KeyboardInterrupt:
+            self.logger.log_info("Analysis interrupted by user")
     
     def cleanup(self):
-        """Clean up resources"""
+        """
+        Clean up resources; main() calls this once after run_analysis_loop()
+        or run_sharded() returns, however they end
+        """
         self.running = False
-        if self.socket:
-            self.socket.close()
+        if self.pipeline:
+            self.pipeline.stop()
+        sockets = [sock for sock in set(self.source_sockets.values()) | {self.socket} if sock is not None]
+        for sock in sockets:
+            # Shutting down reads wakes a receiver blocked on the socket;
+            # results still queued can send clip triggers until it closes
+            try:
+                sock.shutdown(socket.SHUT_RD)
+            except OSError:
+                pass
+        if self.shards:
+            self.shards.stop()
+            self.shards = None
+        for sock in sockets:
+            sock.close()
         self.logger.log_info("SilentTrace analysis stopped")
     
     def get_dashboard_data(self) -> Dict[str, Any]:
@@ -272,6 +912,10 @@ class UltrasonicDetector:
             'status': 'running' if self.running else 'stopped',
             'stats': self.stats.copy(),
             'recent_detections': recent_data[-10:] if recent_data else [],
+            'pipeline': self.pipeline.snapshot() if self.pipeline else
+                        self.shards.snapshot() if self.shards else {},
+            'quality': self.governor.snapshot(),
+            'shadow': self.shadow.snapshot(),
             'config': {
                 'ultrasonic_range': self.config.get_frequency_range(),
                 'threshold_db': self.config.detection.threshold_db,
@@ -340,9 +984,15 @@ def main():
         
         print(f"Web dashboard available at http://{config.dashboard.host}:{config.dashboard.port}")
     
-    # Start main analysis
+    # Start main analysis, in worker processes if asked to
+    processes = config.system.analysis_processes
+    if '--processes' in sys.argv:
+        processes = int(sys.argv[sys.argv.index('--processes') + 1])
     try:
-        detector.run_analysis_loop()
+        if processes > 0:
+            detector.run_sharded(processes)
+        else:
+            detector.run_analysis_loop()
     except KeyboardInterrupt:
         print("\nShutting down...")
     finally:
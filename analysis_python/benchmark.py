@@ -0,0 +1,413 @@
+#!/usr/bin/env python3
+"""
+SilentTrace Analysis Benchmarks
+Times the spectral analysis kernels on synthetic audio and prints one JSON
+line per kernel and setting (CSV with --csv), like core_c/bench_capture:
+
+  {"kernel":"stft","window":4096,"overlap":0.5,"resolution_hz":10.767,
+   "ms_per_audio_sec":0.3,"realtime_factor":3300.0,"packets":20}
+
+ms_per_audio_sec is the compute time per second of audio; realtime_factor
+is how many times faster than real time that is. The zoom kernels compare
+the ultrasonic band's zoom spectrum with a full-band STFT of the same bin
+spacing; multires runs 512 and 32768-sample windows next to --window.
+cfar, minmax_peaks, periodicity and features include the band spectra they
+work on. cfar_shadow detects with SHADOW_CONFIGS detector configurations
+at once, as shadow configurations run; cfar_separate runs the same ones as
+separate detectors.
+matched_filter runs the configured beacon templates padded with tone
+bursts to MATCHED_FILTER_TEMPLATES; fsk_demod demodulates the configured
+FSK alphabets, all locked. Neither uses the STFT, so they run once, not
+for every --window and --overlap; zoom runs once per --resolution.
+spectral_path runs the analyzer's spectral worker path (spectra, CFAR,
+features) packet by packet; catch_up runs the same over blocks of
+CATCH_UP_BATCH packets, as when working off a backlog.
+The receive kernels read packets from a socket pair, PacketReceiver
+against the earlier recv-and-concatenate loop (receive_legacy);
+alloc_bytes_per_packet is the most memory a steady-state receive
+allocated, traced with tracemalloc.
+sharded analyzes --channels streams in each --processes count of shard
+worker processes, the full per-stream analysis; ms_per_audio_sec covers
+all channels, so on enough cores it should fall about linearly with the
+process count. It is timed once per setting, after a warm-up packet.
+Each figure is the median of several timed repetitions.
+"""
+
+import argparse
+import json
+import os
+import socket
+import statistics
+import struct
+import sys
+import threading
+import time
+import tracemalloc
+
+import numpy as np
+
+from analyze import UltrasonicDetector
+from config import config
+from demodulator import FSKDemodulator
+from detection import CFARDetector
+from matched_filter import BeaconTemplate, MatchedFilterBank
+from periodicity import PeriodicityAnalyzer, subband_envelope, subband_starts
+from receiver import AUDIO_HEADER_FORMAT, AUDIO_HEADER_SIZE, PacketReceiver
+from shard import ShardSupervisor
+from utils import BandSpec, SignalProcessor
+
+REPETITIONS = 5
+CSV_FIELDS = ('kernel', 'window', 'overlap', 'resolution_hz', 'ms_per_audio_sec',
+              'realtime_factor', 'packets', 'alloc_bytes_per_packet', 'processes', 'channels')
+MATCHED_FILTER_TEMPLATES = 32
+CATCH_UP_BATCH = 5
+SHADOW_CONFIGS = 8
+
+
+def make_packets(sample_rate: int, seconds: int) -> list:
+    """One-second float32 packets: noise with a weak 19.5 kHz beacon"""
+    rng = np.random.default_rng(1)
+    t = np.arange(sample_rate * seconds) / sample_rate
+    audio = 0.01 * rng.standard_normal(len(t)) + 0.001 * np.sin(2 * np.pi * 19500 * t)
+    return np.split(audio.astype(np.float32), seconds)
+
+
+def bench_stft(processor: SignalProcessor, packets: list) -> None:
+    for packet in packets:
+        processor.stft(packet)
+
+
+def bench_compute_fft(processor: SignalProcessor, packets: list) -> None:
+    for packet in packets:
+        processor.compute_fft(packet)
+
+
+def bench_band_spectra(processor: SignalProcessor, packets: list) -> None:
+    for packet in packets:
+        processor.compute_band_spectra(packet)
+
+
+def bench_resolution_spectra(processor: SignalProcessor, packets: list) -> None:
+    for packet in packets:
+        processor.compute_resolution_spectra(packet)
+
+
+def bench_cfar(processor: SignalProcessor, packets: list) -> None:
+    detector = None
+    for packet in packets:
+        _, magnitudes = processor.compute_band_spectra(packet)['ultrasonic']
+        power = processor.frame_power[processor.window_size]['ultrasonic']
+        if detector is None:
+            detector = CFARDetector(len(magnitudes))
+        detector.detect(power, 1.0 / max(1, len(power)))
+
+
+def shadow_settings() -> dict:
+    """CFARDetector settings of SHADOW_CONFIGS configurations around the defaults"""
+    return {
+        'pfa': np.logspace(-9, -3, SHADOW_CONFIGS),
+        'floor_sigma': np.linspace(2.0, 4.0, SHADOW_CONFIGS),
+        'min_level_db': np.linspace(-60.0, -30.0, SHADOW_CONFIGS),
+    }
+
+
+def bench_cfar_shadow(processor: SignalProcessor, packets: list) -> None:
+    bank = None
+    for packet in packets:
+        _, magnitudes = processor.compute_band_spectra(packet)['ultrasonic']
+        power = processor.frame_power[processor.window_size]['ultrasonic']
+        if bank is None:
+            bank = CFARDetector(len(magnitudes), **shadow_settings())
+        bank.detect(power, 1.0 / max(1, len(power)))
+
+
+def bench_cfar_separate(processor: SignalProcessor, packets: list) -> None:
+    detectors = None
+    for packet in packets:
+        _, magnitudes = processor.compute_band_spectra(packet)['ultrasonic']
+        power = processor.frame_power[processor.window_size]['ultrasonic']
+        if detectors is None:
+            settings = shadow_settings()
+            detectors = [CFARDetector(len(magnitudes), **{key: values[k] for key, values in settings.items()})
+                         for k in range(SHADOW_CONFIGS)]
+        for detector in detectors:
+            detector.detect(power, 1.0 / max(1, len(power)))
+
+
+def bench_minmax_peaks(processor: SignalProcessor, packets: list) -> None:
+    for packet in packets:
+        _, magnitudes = processor.compute_band_spectra(packet)['ultrasonic']
+        processor.detect_peaks(magnitudes)
+
+
+def bench_periodicity(processor: SignalProcessor, packets: list) -> None:
+    detection = config.detection
+    analyzer = None
+    for packet in packets:
+        frequencies, _ = processor.compute_band_spectra(packet)['ultrasonic']
+        if analyzer is None:
+            starts = subband_starts(frequencies, detection.periodicity_subband_hz)
+            analyzer = PeriodicityAnalyzer(len(starts), processor.frame_rate(processor.window_size, 'ultrasonic'),
+                                           detection.periodicity_min_period_sec,
+                                           detection.periodicity_max_period_sec,
+                                           detection.periodicity_history_sec)
+        power = processor.frame_power[processor.window_size]['ultrasonic']
+        analyzer.update(subband_envelope(power, starts))
+
+
+def bench_matched_filter(processor: SignalProcessor, packets: list) -> None:
+    templates = [BeaconTemplate.from_dict(spec) for spec in config.detection.beacon_templates]
+    for i in range(len(templates), MATCHED_FILTER_TEMPLATES):
+        templates.append(BeaconTemplate(f'tone_{i}', 'tone', (18000.0 + 125.0 * i,), 0.05))
+    bank = MatchedFilterBank(templates, processor.sample_rate, config.audio.ultrasonic_min_freq,
+                             config.audio.ultrasonic_max_freq, config.detection.matched_filter_threshold_db)
+    for packet in packets:
+        bank.process(packet)
+
+
+def bench_fsk_demod(processor: SignalProcessor, packets: list) -> None:
+    detection = config.detection
+    demodulators = [FSKDemodulator(spec['frequencies'], spec['duration_sec'], processor.sample_rate,
+                                   detection.demod_oversampling, detection.demod_squelch_db,
+                                   detection.demod_frame_gap_symbols, detection.demod_min_frame_symbols)
+                    for spec in detection.beacon_templates if spec['kind'] == 'fsk']
+    for packet in packets:
+        for demodulator in demodulators:
+            demodulator.process(packet)
+
+
+def bench_features(processor: SignalProcessor, packets: list) -> None:
+    for packet in packets:
+        frequencies, magnitudes = processor.compute_band_spectra(packet)['ultrasonic']
+        processor.calculate_spectral_features(magnitudes, frequencies)
+        processor.frame_features(processor.window_size, 'ultrasonic')
+
+
+def spectral_path(processor: SignalProcessor, batches: list, detectors: dict) -> None:
+    """Spectra, CFAR detection and features, one batch of packets at a time"""
+    for batch in batches:
+        spectra = processor.compute_resolution_spectra_batch(batch)
+        frequencies = spectra[0][processor.window_size]['ultrasonic'][0]
+        power = processor.block_power[processor.window_size]['ultrasonic']
+        counts = processor.block_counts[processor.window_size]['ultrasonic']
+        if 'ultrasonic' not in detectors:
+            detectors['ultrasonic'] = CFARDetector(len(frequencies))
+        detectors['ultrasonic'].detect_batch(power, counts, [1.0 / max(1, count) for count in counts])
+        processor.calculate_spectral_features_batch(
+            np.stack([s[processor.window_size]['ultrasonic'][1] for s in spectra]), frequencies)
+        processor.block_frame_features(processor.window_size, 'ultrasonic')
+
+
+def bench_spectral_path(processor: SignalProcessor, packets: list) -> None:
+    spectral_path(processor, [[packet] for packet in packets], {})
+
+
+def bench_catch_up(processor: SignalProcessor, packets: list) -> None:
+    batches = [packets[i:i + CATCH_UP_BATCH] for i in range(0, len(packets), CATCH_UP_BATCH)]
+    spectral_path(processor, batches, {})
+
+
+KERNELS = {
+    'stft': bench_stft,
+    'compute_fft': bench_compute_fft,
+    'band_spectra': bench_band_spectra,
+    'multires': bench_resolution_spectra,
+    'cfar': bench_cfar,
+    'cfar_shadow': bench_cfar_shadow,
+    'cfar_separate': bench_cfar_separate,
+    'minmax_peaks': bench_minmax_peaks,
+    'features': bench_features,
+    'spectral_path': bench_spectral_path,
+    'catch_up': bench_catch_up,
+    'periodicity': bench_periodicity,
+    'matched_filter': bench_matched_filter,
+    'fsk_demod': bench_fsk_demod,
+}
+
+# Window sizes run alongside --window by kernels that use several
+EXTRA_WINDOW_SIZES = {
+    'multires': (512, 32768),
+}
+
+# Kernels that work on the samples, not on STFT frames
+STREAM_KERNELS = ('matched_filter', 'fsk_demod')
+
+
+def legacy_receive(sock: socket.socket) -> dict:
+    """The receive loop PacketReceiver replaced, for comparison"""
+    header_data = sock.recv(AUDIO_HEADER_SIZE)
+    timestamp, sample_rate, buffer_length, channels = struct.unpack(AUDIO_HEADER_FORMAT, header_data)
+    data_size = buffer_length * channels * 2
+    audio_data_bytes = b''
+    while len(audio_data_bytes) < data_size:
+        chunk = sock.recv(data_size - len(audio_data_bytes))
+        audio_data_bytes += chunk
+    audio_data = np.frombuffer(audio_data_bytes, dtype=np.int16).astype(np.float32) / 32768.0
+    return {'timestamp': timestamp, 'sample_rate': sample_rate,
+            'audio_data': audio_data, 'channels': channels}
+
+
+def time_receive(name: str, sample_rate: int, packets: list) -> tuple:
+    """
+    Median seconds to receive all packets over a socket pair, and the most
+    memory one steady-state receive allocated
+    """
+    stream = b''.join(struct.pack(AUDIO_HEADER_FORMAT, i, sample_rate, len(p), 1) +
+                      (p * 32767).astype(np.int16).tobytes() for i, p in enumerate(packets))
+
+    def run(trace: bool) -> tuple:
+        reader, writer = socket.socketpair(socket.AF_UNIX, socket.SOCK_STREAM)
+        sender = threading.Thread(target=writer.sendall, args=(stream,))
+        sender.start()
+        receive = PacketReceiver(reader).receive if name == 'receive' else \
+            (lambda: legacy_receive(reader))
+        most = 0
+        start = time.perf_counter()
+        for i in range(len(packets)):
+            if trace:
+                tracemalloc.reset_peak()
+                before = tracemalloc.get_traced_memory()[0]
+            receive()
+            # Skip the first packets, which fill the buffer pool
+            if trace and i >= 2:
+                most = max(most, tracemalloc.get_traced_memory()[1] - before)
+        elapsed = time.perf_counter() - start
+        sender.join()
+        reader.close()
+        writer.close()
+        return elapsed, most
+
+    timings = [run(False)[0] for _ in range(REPETITIONS)]
+    tracemalloc.start()
+    _, most = run(True)
+    tracemalloc.stop()
+    return statistics.median(timings), most
+
+
+def time_sharded(processes: int, channels: int, sample_rate: int, packets: list) -> float:
+    """Seconds for shard workers to analyze every channel of all packets"""
+    # Distinct interleaved packets, cycled: every channel carries the same
+    # audio, which costs the same to analyze
+    interleaved = [np.repeat(p[:, np.newaxis], channels, axis=1).reshape(-1) for p in packets[:4]]
+    done = threading.Semaphore(0)
+    supervisor = ShardSupervisor(processes, UltrasonicDetector, lambda *_: done.release(),
+                                 queue_slots=2 * processes)
+
+    def run(first: int, count: int):
+        for i in range(first, first + count):
+            supervisor.submit('bench', {'timestamp': 1000 * (i + 1), 'sample_rate': sample_rate,
+                                        'audio_data': interleaved[i % len(interleaved)],
+                                        'channels': channels})
+        for _ in range(count * channels):
+            done.acquire()
+
+    supervisor.start()
+    run(0, 1)   # worker start-up and per-stream set-up
+    start = time.perf_counter()
+    run(1, len(packets))
+    elapsed = time.perf_counter() - start
+    supervisor.stop()
+    return elapsed
+
+
+def time_kernel(kernel, processor: SignalProcessor, packets: list) -> float:
+    """Median seconds for one pass over all packets"""
+    kernel(processor, packets[:1])  # warm up plans and caches
+    timings = []
+    for _ in range(REPETITIONS):
+        processor.reset_stream()
+        start = time.perf_counter()
+        kernel(processor, packets)
+        timings.append(time.perf_counter() - start)
+    return statistics.median(timings)
+
+
+def report(args, fields: dict, per_sec: float, packets: list) -> None:
+    result = dict(fields)
+    result['ms_per_audio_sec'] = round(per_sec * 1000, 3)
+    result['realtime_factor'] = round(1.0 / per_sec, 1)
+    result['packets'] = len(packets)
+    if args.csv:
+        print(','.join(str(result.get(field, '')) for field in CSV_FIELDS))
+    else:
+        print(json.dumps(result, separators=(',', ':')))
+    sys.stdout.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description='SilentTrace analysis benchmarks')
+    parser.add_argument('--seconds', type=int, default=20, help='Seconds of audio per pass')
+    parser.add_argument('--rate', type=int, default=config.audio.sample_rate, help='Sample rate')
+    parser.add_argument('--window', type=int, action='append', help='FFT window size (repeatable)')
+    parser.add_argument('--overlap', type=float, action='append', help='Overlap ratio (repeatable)')
+    parser.add_argument('--resolution', type=float, action='append',
+                        help='Zoom bin spacing in Hz (repeatable)')
+    parser.add_argument('--kernel', choices=sorted(KERNELS) + ['zoom', 'receive', 'sharded'], action='append',
+                        help='Run only this kernel')
+    parser.add_argument('--processes', type=int, action='append',
+                        help='Shard worker processes for sharded (repeatable)')
+    parser.add_argument('--channels', type=int, default=64, help='Streams for sharded')
+    parser.add_argument('--csv', action='store_true', help='CSV instead of JSON lines')
+    args = parser.parse_args()
+
+    windows = args.window or [1024, config.audio.fft_window_size, 16384]
+    overlaps = args.overlap or [0.0, config.audio.overlap_ratio, 0.75]
+    resolutions = args.resolution or [2.0, 1.0, 0.5]
+    kernels = args.kernel or list(KERNELS) + ['zoom', 'receive', 'sharded']
+    cores = os.cpu_count() or 1
+    processes = args.processes or sorted({1, max(1, cores // 4), max(1, cores // 2), cores})
+    packets = make_packets(args.rate, args.seconds)
+    band = (config.audio.ultrasonic_min_freq, config.audio.ultrasonic_max_freq)
+
+    if args.csv:
+        print(','.join(CSV_FIELDS))
+    for name in kernels:
+        if name in ('zoom', 'receive', 'sharded'):
+            continue
+        if name in STREAM_KERNELS:
+            processor = SignalProcessor(args.rate, config.audio.fft_window_size, config.audio.overlap_ratio)
+            per_sec = time_kernel(KERNELS[name], processor, packets) / args.seconds
+            report(args, {'kernel': name}, per_sec, packets)
+            continue
+        for window in windows:
+            for overlap in overlaps:
+                processor = SignalProcessor(args.rate, window, overlap,
+                                            window_sizes=EXTRA_WINDOW_SIZES.get(name))
+                per_sec = time_kernel(KERNELS[name], processor, packets) / args.seconds
+                report(args, {'kernel': name, 'window': window, 'overlap': overlap,
+                              'resolution_hz': round(args.rate / window, 3)}, per_sec, packets)
+
+    # Zoom spectrum of the ultrasonic band against a full-band STFT with
+    # the same bin spacing
+    if 'zoom' in kernels:
+        overlap = config.audio.overlap_ratio
+        for resolution in resolutions:
+            zoomed = SignalProcessor(args.rate, config.audio.fft_window_size, overlap,
+                                     (BandSpec('ultrasonic', *band, resolution),))
+            zoom = zoomed._zoom['ultrasonic']
+            per_sec = time_kernel(bench_band_spectra, zoomed, packets) / args.seconds
+            report(args, {'kernel': 'zoom_band', 'window': zoom.fft_size, 'overlap': overlap,
+                          'resolution_hz': round(zoom.output_rate / zoom.fft_size, 3)}, per_sec, packets)
+
+            window = int(round(args.rate / resolution))
+            full = SignalProcessor(args.rate, window, overlap, (BandSpec('ultrasonic', *band),))
+            per_sec = time_kernel(bench_band_spectra, full, packets) / args.seconds
+            report(args, {'kernel': 'zoom_fft_equivalent', 'window': full.plan.fft_size, 'overlap': overlap,
+                          'resolution_hz': round(args.rate / full.plan.fft_size, 3)}, per_sec, packets)
+
+    # Socket receive path, old and new
+    if 'receive' in kernels:
+        for name in ('receive_legacy', 'receive'):
+            elapsed, most = time_receive(name, args.rate, packets)
+            report(args, {'kernel': name, 'alloc_bytes_per_packet': most}, elapsed / args.seconds, packets)
+
+    # Full per-stream analysis of many channels in shard worker processes
+    if 'sharded' in kernels:
+        for count in processes:
+            elapsed = time_sharded(count, args.channels, args.rate, packets)
+            report(args, {'kernel': 'sharded', 'processes': count, 'channels': args.channels},
+                   elapsed / args.seconds, packets)
+
+
+if __name__ == '__main__':
+    main()
@@ -5,8 +5,8 @@ Manages all configuration settings for the ultrasonic signal detector
 
 import os
 import yaml
-from dataclasses import dataclass
-from typing import Dict, Any
+from dataclasses import dataclass, field
+from typing import Dict, Any, List
 
 @dataclass
 class AudioConfig:
@@ -18,6 +18,14 @@ class AudioConfig:
     ultrasonic_max_freq: int = 22000  # 22kHz
     fft_window_size: int = 4096
     overlap_ratio: float = 0.5
+    # Further window sizes run over the same stream, e.g. [512, 32768]:
+    # short ones catch brief pulses, long ones resolve steady tones
+    fft_window_sizes: List[int] = field(default_factory=list)
+    ultrasonic_zoom_resolution_hz: float = 0.0  # > 0: zoom spectrum with this bin spacing
+    # Further bands analyzed alongside the ultrasonic one, by name:
+    #   {'near_ultrasonic': {'min_freq': 15000, 'max_freq': 18000,
+    #                        'zoom_resolution_hz': 2.0}}
+    bands: Dict[str, Dict[str, float]] = field(default_factory=dict)
 
 @dataclass
 class DetectionConfig:
@@ -27,6 +35,42 @@ class DetectionConfig:
     min_peak_distance: int = 100  # FFT bins
     repetition_threshold: int = 3  # Number of detections to consider repetitive
     repetition_window_sec: int = 10  # Time window for repetition detection
+    detector: str = "cfar"  # "cfar", or "minmax" for normalized peak picking
+    cfar_mode: str = "ca"  # "ca" cell-averaging or "os" ordered-statistic
+    cfar_guard_bins: int = 2  # Bins next to the cell left out of the noise estimate
+    cfar_training_bins: int = 16  # Bins on each side the noise is estimated from
+    cfar_pfa: float = 1e-6  # False alarm rate per cell and frame
+    floor_sigma: float = 3.0  # Standard deviations above the bin's own noise floor
+    floor_time_constant_sec: float = 30.0  # Averaging time of the per-bin noise floor
+    track_gate_hz: float = 50.0  # Largest jump a peak may make and stay on its track
+    track_alpha: float = 0.5  # Frequency smoothing of the track filter
+    track_beta: float = 0.1  # Drift gain of the track filter, 0 = no drift prediction
+    track_timeout_sec: float = 10.0  # Drop a track this long after its last hit
+    periodicity_subband_hz: float = 500.0  # Width of the sub-bands checked for a repetition period
+    periodicity_min_period_sec: float = 0.2  # Shortest repetition period looked for
+    periodicity_max_period_sec: float = 10.0  # Longest repetition period looked for
+    periodicity_history_sec: float = 300.0  # Envelope history the autocorrelation covers
+    periodicity_min_confidence: float = 0.5  # Autocorrelation at the period (0-1) to call a sub-band periodic
+    matched_filter_threshold_db: float = 13.0  # Matched filter score over its noise level that counts as a match
+    demod_oversampling: int = 8  # Timing positions per symbol for symbol timing recovery
+    demod_squelch_db: float = 10.0  # Winning tone over the noise level for a valid symbol
+    demod_frame_gap_symbols: int = 2  # Symbol slots without a valid symbol that end a frame
+    demod_min_frame_symbols: int = 4  # Shorter frames are dropped as noise
+    demod_timeout_sec: float = 10.0  # Unlock a demodulator this long after its last valid symbol
+    # Known beacon waveforms correlated against the stream (empty: off).
+    # kind is 'tone', 'chirp' (frequencies: start, end) or 'fsk' (one
+    # frequency per symbol, duration_sec per symbol)
+    beacon_templates: List[Dict[str, Any]] = field(default_factory=lambda: [
+        {'name': 'tone_burst_18k5', 'kind': 'tone', 'frequencies': [18500], 'duration_sec': 0.05},
+        {'name': 'chirp_up_18k_20k', 'kind': 'chirp', 'frequencies': [18000, 20000], 'duration_sec': 0.1},
+        {'name': 'chirp_down_20k_18k', 'kind': 'chirp', 'frequencies': [20000, 18000], 'duration_sec': 0.1},
+        {'name': 'fsk4_18k5', 'kind': 'fsk', 'frequencies': [18500, 19000, 19500, 20000], 'duration_sec': 0.02},
+    ])
+    # Alternative detector settings evaluated in shadow on the same spectra,
+    # e.g. [{'name': 'sensitive', 'threshold_db': -50.0, 'cfar_pfa': 1e-4}].
+    # Their alert decisions go to shadow_log_path only, never to the alerts
+    shadow_configs: List[Dict[str, Any]] = field(default_factory=list)
+    shadow_log_path: str = "silenttrace_shadow.log"
     
 @dataclass
 class AlertConfig:
@@ -36,6 +80,7 @@ class AlertConfig:
     enable_file_logging: bool = True
     log_file_path: str = "silenttrace_detections.log"
     alert_cooldown_sec: int = 5  # Minimum time between alerts
+    enable_evidence_clips: bool = True  # Ask capture daemon to save clips on alerts (needs --clip-dir)
 
 @dataclass
 class DashboardConfig:
@@ -53,6 +98,40 @@ class SystemConfig:
     max_reconnect_attempts: int = 5
     reconnect_delay_sec: int = 2
     enable_debug_logging: bool = False
+    # Packets each analyzer pipeline queue holds before the stage feeding
+    # it waits
+    pipeline_queue_size: int = 4
+    # A spectral worker with this many packets queued behind the current
+    # one takes them all (up to pipeline_queue_size) and analyzes them as
+    # one block (0: never)
+    catch_up_backlog: int = 2
+    # CPU-budget governor: analysis taking more than cpu_budget seconds per
+    # second of audio (averaged over governor_window_sec of audio) steps
+    # down a quality level; governor_hold_sec under cpu_headroom steps back
+    # up (cpu_budget 0: off)
+    cpu_budget: float = 0.8
+    cpu_headroom: float = 0.4
+    governor_window_sec: float = 5.0
+    governor_hold_sec: float = 30.0
+    # Quality levels below the configured analysis, each adding to the cuts
+    # of the ones before it. Keys: extra_resolutions, zoom, frame_features,
+    # bands, beacons (False: off), overlap_ratio (cap), fft_window_scale
+    quality_levels: List[Dict[str, Any]] = field(default_factory=lambda: [
+        {'name': 'single_resolution', 'extra_resolutions': False, 'zoom': False, 'frame_features': False},
+        {'name': 'no_overlap', 'overlap_ratio': 0.0},
+        {'name': 'short_fft', 'fft_window_scale': 0.5},
+        {'name': 'band_only', 'bands': False, 'beacons': False},
+    ])
+    # Worker processes that analyze every capture channel as a stream of
+    # its own (0: analyze here, channels mixed down); --processes N
+    analysis_processes: int = 0
+    # Sockets of further capture daemons, analyzed by the worker processes
+    # alongside socket_path
+    extra_sources: List[str] = field(default_factory=list)
+    # Packets in shared memory awaiting the workers, and how much more
+    # than its share of streams consistent hashing may give a worker
+    shard_queue_slots: int = 8
+    shard_load_factor: float = 1.0
 
 class Config:
     """Main configuration manager"""
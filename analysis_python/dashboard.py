@@ -76,13 +76,15 @@ def create_dashboard_app(data_provider=None):
                 detections = item.get('detections', [])
                 threat_level = item.get('threat_level', 'normal')
                 
+                # Features are per analysis, shared by its detections
+                features = item.get('analysis', {}).get('features', {})
                 for detection in detections:
                     formatted_detections.append({
                         'timestamp': datetime.fromtimestamp(detection['timestamp']).strftime('%H:%M:%S'),
                         'frequency': round(detection['frequency'], 1),
                         'magnitude': round(detection['magnitude'], 1),
                         'threat_level': threat_level,
-                        'features': detection.get('features', {})
+                        'features': detection.get('features', features)
                     })
             
             # Sort by timestamp (most recent first)
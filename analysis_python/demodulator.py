@@ -0,0 +1,150 @@
+"""
+SilentTrace Demodulator Module
+Symbol timing recovery and decoding of FSK beacon payloads into frames
+"""
+
+from typing import Any, Dict, List, Sequence
+
+import numpy as np
+
+from utils import stream_frames
+
+
+class FSKDemodulator:
+    """
+    Demodulates one FSK carrier set from the audio stream.
+
+    Tone energies come from a Goertzel bank over just the set's tones,
+    evaluated for every symbol-long window at `oversampling` positions per
+    symbol: the single-bin DFT Goertzel computes, for all windows and tones
+    at once as one matrix product with per-tone phasors.
+
+    Timing recovery keeps, for each of the positions within a symbol, a
+    running average of how far the winning tone rises above the others
+    there; windows that straddle two symbols split their energy and score
+    worse, so the best position is where whole symbols fall in the window,
+    and it follows clock drift. Symbols are decided at that position;
+    consecutive valid symbols form a frame, which ends after
+    frame_gap_symbols slots without a valid symbol. Frames shorter than
+    min_frame_symbols are dropped as noise.
+    """
+
+    # Running average weight of the timing metric and noise level
+    TIMING_WEIGHT = 0.05
+    NOISE_WEIGHT = 0.02
+    MAX_FRAME_SYMBOLS = 256
+
+    def __init__(self, frequencies: Sequence[float], symbol_sec: float, sample_rate: int,
+                 oversampling: int = 8, squelch_db: float = 10.0, frame_gap_symbols: int = 2,
+                 min_frame_symbols: int = 4):
+        self.frequencies = np.asarray(frequencies, dtype=np.float64)
+        self.sample_rate = sample_rate
+        self.oversampling = oversampling
+        self.symbol_size = max(oversampling, int(round(symbol_sec * sample_rate)))
+        self.hop_size = max(1, self.symbol_size // oversampling)
+        self.squelch = 10.0 ** (squelch_db / 10.0)
+        self.frame_gap_symbols = frame_gap_symbols
+        self.min_frame_symbols = min_frame_symbols
+        # On noise alone the mean of the K-1 weakest of K tone energies is
+        # (K - H_K) / (K - 1) of the noise level (H_K the harmonic number)
+        k = len(frequencies)
+        self.rest_bias = (k - np.sum(1.0 / np.arange(1, k + 1))) / max(k - 1, 1)
+        self.bits_per_symbol = int(np.log2(len(frequencies))) if len(frequencies) & (len(frequencies) - 1) == 0 else 0
+        t = np.arange(self.symbol_size) / self.sample_rate
+        self.phasors = np.exp(-2j * np.pi * np.outer(t, self.frequencies)).astype(np.complex64)
+        self.reset_stream()
+
+    def reset_stream(self):
+        """Forget the samples, timing and partial frame of earlier packets"""
+        self.carry = np.zeros(0, dtype=np.float32)
+        self.position = 0               # stream hop index of the next window
+        self.samples_seen = 0
+        self.timing = np.zeros(self.oversampling)
+        self.noise = None
+        self.frame: List[int] = []
+        self.frame_start = 0
+        self.gap = 0
+        self.last_symbol_position = None
+
+    @property
+    def phase(self) -> int:
+        return int(np.argmax(self.timing))
+
+    def _frame_bits(self, symbols: List[int]) -> str:
+        if not self.bits_per_symbol:
+            return ''
+        return ''.join(format(s, f'0{self.bits_per_symbol}b') for s in symbols)
+
+    def _end_frame(self, frames: List[Dict[str, Any]], packet_start: int):
+        if len(self.frame) >= self.min_frame_symbols:
+            frames.append({
+                'start_sec': (self.frame_start * self.hop_size - packet_start) / self.sample_rate,
+                'symbols': self.frame,
+                'bits': self._frame_bits(self.frame),
+                'symbol_sec': self.symbol_size / self.sample_rate,
+            })
+        self.frame = []
+        self.gap = 0
+
+    def process(self, audio_data: np.ndarray) -> List[Dict[str, Any]]:
+        """
+        Feed a packet
+        Returns: the frames completed in it, each {'start_sec' (from the
+        start of this packet, negative if it began earlier), 'symbols',
+        'bits', 'symbol_sec'}
+        """
+        packet_start = self.samples_seen
+        self.samples_seen += len(audio_data)
+        windows, self.carry = stream_frames(self.carry, np.asarray(audio_data, dtype=np.float32),
+                                            self.symbol_size, self.hop_size)
+        frames = []
+        if len(windows) == 0:
+            return frames
+        first = self.position
+        self.position += len(windows)
+
+        tones = windows @ self.phasors
+        energy = tones.real ** 2 + tones.imag ** 2
+        order = np.sort(energy, axis=1)
+        best, rest = order[:, -1], order[:, :-1].mean(axis=1) / self.rest_bias
+
+        # Timing: energy the winning tone gains over the others, per
+        # position within the symbol, from windows with a signal only
+        if self.noise is None:
+            self.noise = float(np.median(rest))
+        gain = np.where(best >= self.squelch * self.noise, (best - rest) / self.noise, 0.0)
+        phases = (first + np.arange(len(windows))) % self.oversampling
+        if gain.any():
+            per_phase = np.bincount(phases, weights=gain, minlength=self.oversampling) / \
+                np.maximum(np.bincount(phases, minlength=self.oversampling), 1)
+            self.timing += self.TIMING_WEIGHT * (per_phase - self.timing)
+
+        # Decide at the symbol centres of this packet
+        centres = np.flatnonzero(phases == self.phase)
+        for i in centres:
+            # The other tones' level is the noise, also during a symbol
+            self.noise += self.NOISE_WEIGHT * (rest[i] - self.noise)
+            if best[i] < self.squelch * self.noise:
+                self.gap += 1
+                if self.gap >= self.frame_gap_symbols:
+                    self._end_frame(frames, packet_start)
+                continue
+            position = first + int(i)
+            # The timing phase can move; never take the same symbol twice
+            if self.last_symbol_position is not None and \
+                    position - self.last_symbol_position < self.oversampling // 2:
+                continue
+            if not self.frame:
+                self.frame_start = position
+            self.frame.append(int(np.argmax(energy[i])))
+            self.last_symbol_position = position
+            self.gap = 0
+            if len(self.frame) >= self.MAX_FRAME_SYMBOLS:
+                self._end_frame(frames, packet_start)
+        return frames
+
+    @property
+    def idle_sec(self) -> float:
+        """Time since the last valid symbol (or since the start)"""
+        last = 0 if self.last_symbol_position is None else self.last_symbol_position * self.hop_size
+        return (self.samples_seen - last) / self.sample_rate
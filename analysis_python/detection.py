@@ -0,0 +1,275 @@
+"""
+SilentTrace Detection Module
+Per-bin noise floor tracking and CFAR peak detection on band spectra
+"""
+
+import numpy as np
+from scipy.ndimage import maximum_filter1d
+from typing import List, Sequence, Tuple
+
+DB_EPSILON = np.float32(1e-20)
+
+
+def ca_cfar_scale(n_training: np.ndarray, pfa: float) -> np.ndarray:
+    """Cell-averaging threshold factor for exponentially distributed power"""
+    return n_training * (pfa ** (-1.0 / n_training) - 1.0)
+
+
+def os_cfar_scale(n_training: int, rank: int, pfa: float) -> float:
+    """
+    Ordered-statistic threshold factor: the alpha for which a cell compared
+    with the rank-th smallest of n_training cells has false alarm rate pfa
+    """
+    def false_alarms(alpha: float) -> float:
+        i = np.arange(rank)
+        return float(np.prod((n_training - i) / (n_training - i + alpha)))
+
+    low, high = 0.0, 1.0
+    while false_alarms(high) > pfa:
+        high *= 2.0
+    for _ in range(60):
+        mid = (low + high) / 2
+        if false_alarms(mid) > pfa:
+            low = mid
+        else:
+            high = mid
+    return high
+
+
+class NoiseFloor:
+    """
+    Per-bin exponential mean and variance of frame power in dB, updated with
+    every frame. Cells at and around a detection are left out of the update
+    so a signal that persists is not learned as background, and a single
+    frame moves the estimate by at most clip_sigma deviations, so a signal
+    that slips past detection cannot blow up the variance either.
+
+    With one time_constant_sec and clip_sigma per configuration (arrays),
+    it keeps a floor per configuration: mean and var are then
+    configurations x bins, and hold has a leading configuration axis too.
+    """
+
+    def __init__(self, n_bins: int, time_constant_sec, clip_sigma=3.0):
+        self.n_bins = n_bins
+        self.time_constant_sec = np.asarray(time_constant_sec, dtype=np.float64)
+        self.clip_sigma = clip_sigma
+        shape = (n_bins,)
+        if np.ndim(clip_sigma) or self.time_constant_sec.ndim:
+            configs = np.broadcast(self.time_constant_sec, clip_sigma).shape[0]
+            self.time_constant_sec = np.broadcast_to(self.time_constant_sec, (configs,))
+            self.clip_sigma = np.broadcast_to(np.asarray(clip_sigma, dtype=np.float32), (configs,))[:, np.newaxis]
+            shape = (configs, n_bins)
+        self.mean = np.zeros(shape, dtype=np.float32)
+        self.var = np.zeros(shape, dtype=np.float32)
+        self.frames_seen = 0
+
+    def update(self, power_db: np.ndarray, hold: np.ndarray, frame_sec: float,
+               seed_db: np.ndarray = None):
+        """
+        Fold frames x bins of dB values in, oldest frame first. seed_db,
+        frames x bins, is what the first update starts a bin held in every
+        frame from instead of its own cells, e.g. the surrounding noise
+        """
+        n_frames = len(power_db)
+        if n_frames == 0:
+            return
+        if self.frames_seen == 0:
+            # Start from the cells that are not held. A bin held in every
+            # frame (a tone present from the start) must not learn the tone
+            # as its floor: it starts from seed_db, moved by and given the
+            # spread of what the free bins learned relative to their seed
+            free = ~hold
+            never_free = ~free.any(axis=-2, keepdims=True)
+            values = power_db if seed_db is None else np.where(never_free, seed_db, power_db)
+            free |= never_free
+            count = free.sum(axis=-2)
+            self.mean = (np.where(free, values, 0).sum(axis=-2) / count).astype(np.float32)
+            deviation = values - self.mean[..., np.newaxis, :]
+            self.var = (np.where(free, deviation ** 2, 0).sum(axis=-2) / count).astype(np.float32)
+            seeded = never_free[..., 0, :]
+            if seed_db is not None and seeded.any() and not seeded.all(axis=-1).any():
+                offset = np.where(seeded, np.nan, self.mean - seed_db.mean(axis=0))
+                spread = np.where(seeded, np.nan, self.var)
+                self.mean = np.where(seeded, self.mean + np.nanmedian(offset, axis=-1, keepdims=True),
+                                     self.mean).astype(np.float32)
+                self.var = np.where(seeded, np.maximum(self.var, np.nanmedian(spread, axis=-1, keepdims=True)),
+                                    self.var).astype(np.float32)
+            self.frames_seen = n_frames
+            return
+
+        # n_frames EMA steps with held cells repeating the current mean,
+        # done with one weight vector instead of a loop (deviations are
+        # taken from the mean at the start of the packet). Plain running
+        # mean while fewer frames than the time constant.
+        alpha = np.maximum(frame_sec / self.time_constant_sec, 1.0 / (self.frames_seen + n_frames))
+        alpha = np.minimum(alpha, 1.0)[..., np.newaxis]
+        decay = np.float32(1.0 - alpha) ** np.arange(n_frames - 1, -1, -1, dtype=np.float32)
+        weights = (np.float32(alpha) * decay)[..., np.newaxis]
+        remaining = np.float32((1.0 - alpha) ** n_frames)
+
+        mean = self.mean[..., np.newaxis, :]
+        values = np.where(hold, mean, power_db)
+        limit = np.maximum(self.clip_sigma * np.sqrt(self.var), np.float32(1.0))[..., np.newaxis, :]
+        deviation = np.clip(values - mean, -limit, limit)
+        self.mean = self.mean + np.sum(weights * deviation, axis=-2)
+        self.var = remaining * self.var + np.sum(weights * deviation * deviation, axis=-2)
+        self.frames_seen += n_frames
+
+
+class CFARDetector:
+    """
+    Constant false alarm rate detection over a band, one frame at a time.
+    A cell is a hit when its power exceeds the local noise estimate from
+    the training cells around it (cell-averaging or ordered-statistic) by
+    the factor for the wanted false alarm rate, and it also stands out from
+    that bin's own noise floor history. Hits are thinned to local maxima and
+    reported once per packet with their peak level.
+
+    pfa, floor_sigma, floor_time_constant_sec, min_level_db and min_distance
+    may be sequences, one value per configuration: the detector then runs
+    all the configurations side by side as a leading axis of its arrays.
+    The dB levels, local noise estimate and local maxima are shared, and
+    each configuration keeps its own hits and noise floor.
+    """
+
+    def __init__(self, n_bins: int, mode: str = 'ca', guard_bins: int = 2,
+                 training_bins: int = 16, pfa=1e-6, floor_sigma=3.0,
+                 floor_time_constant_sec=30.0, min_level_db=-np.inf, min_distance=1):
+        if mode not in ('ca', 'os'):
+            raise ValueError(f"CFAR mode must be 'ca' or 'os', got {mode!r}")
+        self.n_bins = n_bins
+        self.mode = mode
+        self.guard_bins = guard_bins
+        self.training_bins = training_bins
+        self.n_configs = None
+        settings = (pfa, floor_sigma, floor_time_constant_sec, min_level_db, min_distance)
+        if any(np.ndim(value) for value in settings):
+            pfa, floor_sigma, floor_time_constant_sec, min_level_db, min_distance = \
+                np.broadcast_arrays(*(np.asarray(value, dtype=np.float64) for value in settings))
+            self.n_configs = len(pfa)
+            self.floor_sigma = floor_sigma.astype(np.float32)[:, np.newaxis]
+            self.min_level_db = min_level_db.astype(np.float32)[:, np.newaxis, np.newaxis]
+            self.min_distance = [max(1, int(distance)) for distance in min_distance]
+        else:
+            self.floor_sigma = floor_sigma
+            self.min_level_db = min_level_db
+            self.min_distance = max(1, min_distance)
+        self.floor = NoiseFloor(n_bins, floor_time_constant_sec, floor_sigma)
+
+        # Training cells per bin: fewer at the band edges
+        bins = np.arange(n_bins)
+        before = np.clip(bins - guard_bins, 0, training_bins)
+        after = np.clip(n_bins - 1 - bins - guard_bins, 0, training_bins)
+        self.n_training = (before + after).astype(np.float32)
+        usable = np.maximum(self.n_training, 1)
+        if mode == 'ca':
+            if self.n_configs is None:
+                self.scale = ca_cfar_scale(usable, pfa).astype(np.float32)
+            else:
+                self.scale = ca_cfar_scale(usable, pfa[:, np.newaxis]).astype(np.float32)[:, np.newaxis, :]
+        else:
+            # 3/4 rank, the usual choice; edges reuse the full-window factor
+            self.rank = max(1, (3 * 2 * training_bins) // 4)
+            if self.n_configs is None:
+                self.scale = np.float32(os_cfar_scale(2 * training_bins, self.rank, pfa))
+            else:
+                self.scale = np.array([os_cfar_scale(2 * training_bins, self.rank, value) for value in pfa],
+                                      dtype=np.float32)[:, np.newaxis, np.newaxis]
+
+    def _local_noise(self, power: np.ndarray) -> np.ndarray:
+        """Noise estimate for every cell of frames x bins"""
+        g, t = self.guard_bins, self.training_bins
+        n_frames, n_bins = power.shape
+        if self.mode == 'ca':
+            # Sum of [i-g-t, i-g) and (i+g, i+g+t] from one cumulative sum
+            csum = np.zeros((n_frames, n_bins + 1), dtype=np.float64)
+            np.cumsum(power, axis=1, out=csum[:, 1:])
+            idx = np.arange(n_bins)
+            lead = csum[:, np.clip(idx - g, 0, n_bins)] - csum[:, np.clip(idx - g - t, 0, n_bins)]
+            lag = csum[:, np.clip(idx + g + t + 1, 0, n_bins)] - csum[:, np.clip(idx + g + 1, 0, n_bins)]
+            return ((lead + lag) / np.maximum(self.n_training, 1)).astype(np.float32)
+
+        # Ordered statistic over the full training window; band edges are
+        # padded by reflection
+        pad = g + t
+        padded = np.pad(power, ((0, 0), (pad, pad)), mode='reflect')
+        windows = np.lib.stride_tricks.sliding_window_view(padded, 2 * pad + 1, axis=1)
+        training = np.concatenate((windows[..., :t], windows[..., -t:]), axis=-1)
+        return np.partition(training, self.rank - 1, axis=-1)[..., self.rank - 1]
+
+    def detect(self, power: np.ndarray, frame_sec: float) -> Tuple[np.ndarray, np.ndarray]:
+        """
+        Detect in frames x bins of linear power (one packet's frames)
+        Returns: (peak bin indices, per-bin peak level in dB over the packet)
+        """
+        return self.detect_batch(power, [len(power)], [frame_sec])[0]
+
+    def detect_batch(self, power: np.ndarray, counts: Sequence[int],
+                     frame_secs: Sequence[float]) -> List[Tuple[np.ndarray, np.ndarray]]:
+        """
+        detect for several consecutive packets' frames at once, counts
+        frames each. The CFAR test and the local maxima run over the whole
+        block in one pass; then each packet's frames are held against the
+        floor as it stood before them and folded into it, so the results
+        are those of one call per packet.
+        Returns: (peak bin indices, per-bin peak level in dB) per packet;
+        with several configurations the peak bin indices are a list, one
+        array per configuration
+        """
+        no_peaks = np.zeros(0, dtype=np.intp)
+        if self.n_configs is not None:
+            no_peaks = [no_peaks] * self.n_configs
+        empty = (no_peaks, np.full(self.n_bins, -200.0, dtype=np.float32))
+        if len(power) == 0 or power.shape[1] != self.n_bins:
+            return [empty for _ in counts]
+
+        power_db = np.float32(10) * np.log10(power + DB_EPSILON)
+        local_noise = self._local_noise(power)
+        cfar_hits = power > self.scale * local_noise
+        cfar_hits &= power_db > self.min_level_db
+        left = np.pad(power[:, :-1], ((0, 0), (1, 0)))
+        right = np.pad(power[:, 1:], ((0, 0), (0, 1)))
+        local_max = (power >= left) & (power >= right)
+
+        results = []
+        start = 0
+        for count, frame_sec in zip(counts, frame_secs):
+            if count == 0:
+                results.append(empty)
+                continue
+            frames = slice(start, start + count)
+            start += count
+            hits = cfar_hits[..., frames, :]
+            if self.floor.frames_seen > 0:
+                floor_limit = self.floor.mean + self.floor_sigma * np.sqrt(self.floor.var)
+                hits &= power_db[frames] > floor_limit[..., np.newaxis, :]
+
+            # The floor must not learn a signal's skirts either, or it loses
+            # the signal once it drifts into the next bin
+            hold = maximum_filter1d(hits, size=2 * self.guard_bins + 1, axis=-1)
+            seed_db = None
+            if self.floor.frames_seen == 0:
+                seed_db = np.float32(10) * np.log10(local_noise[frames] + DB_EPSILON)
+            self.floor.update(power_db[frames], hold, frame_sec, seed_db)
+
+            # Keep local maxima within each frame
+            hits &= local_max[frames]
+
+            # One peak per signal over the packet
+            level = np.where(hits, power_db[frames], np.float32(-np.inf)).max(axis=-2)
+            peak_level = power_db[frames].max(axis=0)
+            if self.n_configs is None:
+                peaks = self._thin(level, self.min_distance)
+            else:
+                peaks = [self._thin(row, distance) for row, distance in zip(level, self.min_distance)]
+            results.append((peaks, peak_level))
+        return results
+
+    @staticmethod
+    def _thin(level: np.ndarray, min_distance: int) -> np.ndarray:
+        """Bins with a finite level that is the highest within min_distance"""
+        detected = np.isfinite(level)
+        if not detected.any():
+            return np.zeros(0, dtype=np.intp)
+        window = 2 * (min_distance - 1) + 1
+        return np.flatnonzero(detected & (level >= maximum_filter1d(level, size=window, mode='nearest')))
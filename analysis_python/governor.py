@@ -0,0 +1,130 @@
+"""
+SilentTrace Governor Module
+Keeps the analysis within a CPU budget by stepping through quality levels
+"""
+
+import time
+from collections import deque
+from dataclasses import dataclass, replace
+from typing import Any, Dict, List, Optional
+
+
+@dataclass(frozen=True)
+class QualityLevel:
+    """
+    What the analysis runs at one level. overlap_ratio None keeps the
+    configured overlap, a value caps it; fft_window_scale scales the
+    primary window size.
+    """
+    index: int = 0
+    name: str = 'full'
+    extra_resolutions: bool = True  # fft_window_sizes next to the primary one
+    zoom: bool = True  # Zoom spectra of bands with zoom_resolution_hz
+    frame_features: bool = True  # Spectral features of every frame
+    overlap_ratio: Optional[float] = None
+    fft_window_scale: float = 1.0
+    bands: bool = True  # Bands next to the ultrasonic one
+    beacons: bool = True  # Matched filters and demodulators
+
+
+def quality_levels(specs: List[Dict[str, Any]]) -> List[QualityLevel]:
+    """
+    The full analysis followed by one level per spec, each adding its
+    settings to the cuts of the levels before it
+    """
+    levels = [QualityLevel()]
+    for index, spec in enumerate(specs, start=1):
+        levels.append(replace(levels[-1], index=index, **dict(spec, name=spec.get('name', f'level_{index}'))))
+    return levels
+
+
+class CPUGovernor:
+    """
+    Steps the analysis down a quality level when it takes more than budget
+    seconds per second of audio, and back up once it has stayed under
+    headroom for hold_sec of audio.
+
+    Load is averaged over window_sec of audio. Packets analyzed at another
+    level than the current one, i.e. still queued when the level changed,
+    are not counted, so a decision is always based on the level it judges.
+    headroom should sit below budget by about the cost of one level, or the
+    analysis climbs back into overload and bounces between two levels.
+    """
+
+    MAX_CHANGES = 50
+
+    def __init__(self, levels: List[QualityLevel], budget: float = 0.8, headroom: float = 0.4,
+                 window_sec: float = 5.0, hold_sec: float = 30.0):
+        self.levels = levels
+        self.budget = budget
+        self.headroom = headroom
+        self.window_sec = window_sec
+        self.hold_sec = hold_sec
+        # Read by the analysis workers: one assignment swaps the level
+        self.current = levels[0]
+        self.load = None
+        self.window_audio_sec = 0.0
+        self.window_busy_sec = 0.0
+        self.calm_sec = 0.0
+        self.changes = deque(maxlen=self.MAX_CHANGES)
+
+    @property
+    def enabled(self) -> bool:
+        return self.budget > 0 and len(self.levels) > 1
+
+    def update(self, level: int, audio_sec: float, busy_sec: float) -> Optional[Dict[str, Any]]:
+        """
+        Account busy_sec of analysis for audio_sec of audio analyzed at
+        level. Returns the level change this caused, if any.
+        """
+        if not self.enabled or level != self.current.index:
+            return None
+        self.window_audio_sec += audio_sec
+        self.window_busy_sec += busy_sec
+        if self.window_audio_sec < self.window_sec:
+            return None
+        self.load = self.window_busy_sec / self.window_audio_sec
+        window_sec = self.window_audio_sec
+        self.window_audio_sec = self.window_busy_sec = 0.0
+
+        index = self.current.index
+        if self.load > self.budget:
+            self.calm_sec = 0.0
+            if index + 1 < len(self.levels):
+                return self._change(index + 1)
+        elif self.load < self.headroom and index > 0:
+            self.calm_sec += window_sec
+            if self.calm_sec >= self.hold_sec:
+                return self._change(index - 1)
+        else:
+            self.calm_sec = 0.0
+        return None
+
+    def _change(self, index: int) -> Dict[str, Any]:
+        previous = self.current
+        self.current = self.levels[index]
+        self.calm_sec = 0.0
+        change = {
+            'time': time.time(),
+            'from_level': previous.index,
+            'from_name': previous.name,
+            'level': self.current.index,
+            'name': self.current.name,
+            'load': self.load,
+            'budget': self.budget
+        }
+        self.changes.append(change)
+        return change
+
+    def snapshot(self) -> Dict[str, Any]:
+        """Current level, last measured load and recent level changes"""
+        return {
+            'enabled': self.enabled,
+            'level': self.current.index,
+            'name': self.current.name,
+            'levels': len(self.levels),
+            'load': self.load,
+            'budget': self.budget,
+            'headroom': self.headroom,
+            'changes': list(self.changes)
+        }
@@ -0,0 +1,156 @@
+"""
+SilentTrace Periodicity Module
+Streaming autocorrelation of band energy envelopes, to find the repetition
+period of pulsed signals
+"""
+
+from collections import deque
+from typing import Any, Dict, List, Optional
+
+import numpy as np
+from scipy.fft import irfft, next_fast_len, rfft
+
+
+def subband_starts(frequencies: np.ndarray, width_hz: float) -> np.ndarray:
+    """First bin of each width_hz wide sub-band of an ascending frequency axis"""
+    if len(frequencies) == 0:
+        return np.zeros(0, dtype=np.intp)
+    edges = np.arange(frequencies[0], frequencies[-1] + 1e-6, width_hz)
+    return np.unique(np.searchsorted(frequencies, edges, side='left'))
+
+
+def subband_envelope(power: np.ndarray, starts: np.ndarray) -> np.ndarray:
+    """
+    Frames x bins of linear power to frames x sub-bands in dB, taking the
+    strongest bin so a narrow tone is not diluted by the sub-band's noise
+    """
+    if len(power) == 0:
+        return np.zeros((0, len(starts)), dtype=np.float32)
+    peak = np.maximum.reduceat(power, starts, axis=1)
+    return np.float32(10) * np.log10(peak + np.float32(1e-20))
+
+
+class PeriodicityAnalyzer:
+    """
+    Sliding-window autocorrelation of several envelopes sampled at
+    frame_rate, kept up to date one block of frames at a time.
+
+    The stream is cut into blocks of B frames. Each block is correlated by
+    FFT with itself and the blocks before it, which gives its products at
+    every lag up to max_period_sec; the window's autocorrelation is the sum
+    of the contributions of its last history_sec worth of blocks, and the
+    oldest one is subtracted as it leaves. A block costs a few FFTs of
+    about 5 B points, so a frame costs O(log B) however long the history,
+    and memory is a fixed number of lag vectors.
+    """
+
+    # Blocks per longest lag: more means more frequent reports but more
+    # FFT work per frame
+    BLOCKS_PER_LAG = 4
+
+    def __init__(self, n_channels: int, frame_rate: float, min_period_sec: float = 0.2,
+                 max_period_sec: float = 10.0, history_sec: float = 300.0):
+        self.n_channels = n_channels
+        self.frame_rate = frame_rate
+        self.min_lag = max(2, int(np.floor(min_period_sec * frame_rate)))
+        self.max_lag = max(self.min_lag + 2, int(np.ceil(max_period_sec * frame_rate)) + 1)
+        self.block_size = -(-self.max_lag // self.BLOCKS_PER_LAG)
+        self.context = self.BLOCKS_PER_LAG * self.block_size   # frames before a block
+        self.fft_size = next_fast_len(self.context + self.block_size, real=True)
+        self.max_blocks = max(self.BLOCKS_PER_LAG,
+                              int(np.ceil(history_sec * frame_rate / self.block_size)))
+        self.reset()
+
+    def reset(self):
+        """Forget the envelope history (e.g. after a gap in the stream)"""
+        c = self.n_channels
+        self.pending = np.zeros((c, self.block_size), dtype=np.float64)
+        self.pending_len = 0
+        self.previous = np.zeros((c, self.context), dtype=np.float64)
+        self.mean = None
+        self.contributions = deque()
+        self.total = np.zeros((c, self.max_lag + 1), dtype=np.float64)
+        self.blocks_since_sum = 0
+        self.results: List[Optional[Dict[str, Any]]] = [None] * c
+
+    @property
+    def history_frames(self) -> int:
+        return len(self.contributions) * self.block_size
+
+    def update(self, envelope: np.ndarray) -> List[Optional[Dict[str, Any]]]:
+        """
+        Append frames x channels of envelope values
+        Returns: per channel the latest period estimate, or None
+        """
+        envelope = np.asarray(envelope, dtype=np.float64)
+        position = 0
+        while position < len(envelope):
+            take = min(self.block_size - self.pending_len, len(envelope) - position)
+            self.pending[:, self.pending_len:self.pending_len + take] = envelope[position:position + take].T
+            self.pending_len += take
+            position += take
+            if self.pending_len == self.block_size:
+                self._add_block()
+                self.pending_len = 0
+        return self.results
+
+    def _add_block(self):
+        block = self.pending
+        # Remove a slowly following mean; a fixed offset would otherwise
+        # dominate every lag
+        block_mean = block.mean(axis=1, keepdims=True)
+        if self.mean is None:
+            self.mean = block_mean
+        else:
+            weight = min(1.0, self.BLOCKS_PER_LAG / self.max_blocks)
+            self.mean += weight * (block_mean - self.mean)
+        block = block - self.mean
+
+        # Products of this block with itself and the context before it:
+        # lag tau is correlation index context - tau
+        stream = np.concatenate((self.previous, block), axis=1)
+        spectrum = np.conj(rfft(block, n=self.fft_size, axis=1)) * rfft(stream, n=self.fft_size, axis=1)
+        correlation = irfft(spectrum, n=self.fft_size, axis=1)
+        contribution = correlation[:, self.context - np.arange(self.max_lag + 1)]
+
+        self.contributions.append(contribution)
+        self.total += contribution
+        if len(self.contributions) > self.max_blocks:
+            self.total -= self.contributions.popleft()
+        # Re-add from scratch now and then so rounding does not pile up
+        self.blocks_since_sum += 1
+        if self.blocks_since_sum >= self.max_blocks:
+            self.total = np.sum(self.contributions, axis=0)
+            self.blocks_since_sum = 0
+        self.previous = stream[:, self.block_size:]
+        self.results = [self._estimate(channel) for channel in range(self.n_channels)]
+
+    def _estimate(self, channel: int) -> Optional[Dict[str, Any]]:
+        """Repetition period from the normalized autocorrelation of a channel"""
+        acf = self.total[channel]
+        if acf[0] <= 0:
+            return None
+        acf = acf / acf[0]
+
+        # Local maxima in the search range; of those nearly as strong as the
+        # best, the shortest lag, so the fundamental wins over its multiples
+        lags = np.arange(self.min_lag, self.max_lag)
+        values = acf[lags]
+        is_peak = (values > acf[lags - 1]) & (values >= acf[lags + 1]) & (values > 0)
+        # Lags beyond half the history are backed by too few repetitions
+        is_peak &= lags <= self.history_frames / 2
+        if not is_peak.any():
+            return None
+        candidates = lags[is_peak]
+        best = acf[candidates].max()
+        lag = int(candidates[np.argmax(acf[candidates] >= 0.8 * best)])
+
+        # Parabolic interpolation between the neighbouring lags
+        left, centre, right = acf[lag - 1], acf[lag], acf[lag + 1]
+        curvature = left - 2 * centre + right
+        offset = 0.5 * (left - right) / curvature if curvature < 0 else 0.0
+        return {
+            'period_sec': float((lag + offset) / self.frame_rate),
+            'confidence': float(np.clip(centre, 0.0, 1.0)),
+            'history_sec': float(self.history_frames / self.frame_rate),
+        }
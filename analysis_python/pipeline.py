@@ -0,0 +1,247 @@
+"""
+SilentTrace Pipeline Module
+Runs the analyzer as threaded stages joined by bounded queues: a receiver,
+a pool of analysis workers and an output sink
+"""
+
+import queue
+import threading
+import time
+from typing import Any, Callable, Dict, List, Optional
+
+# End of the stream, passed down every queue
+STOP = None
+
+
+class StageStats:
+    """
+    Counters of one stage, written by its own thread only. busy is the
+    time spent on items (for the receiver that includes waiting for the
+    daemon), wait the time blocked on its input or output queue.
+    """
+
+    def __init__(self, name: str, inputs: List[queue.Queue]):
+        self.name = name
+        self.inputs = inputs
+        self.items = 0
+        self.busy_sec = 0.0
+        self.max_busy_sec = 0.0
+        self.wait_sec = 0.0
+        self.max_queue_depth = 0
+        self.batches = 0
+        self.max_batch = 0
+        self.started = time.perf_counter()
+
+    @property
+    def queue_depth(self) -> int:
+        """Items waiting for this stage"""
+        return min((q.qsize() for q in self.inputs), default=0)
+
+    def record(self, busy_sec: float, items: int = 1):
+        self.items += items
+        self.busy_sec += busy_sec
+        self.max_busy_sec = max(self.max_busy_sec, busy_sec)
+        if items > 1:
+            self.batches += 1
+            self.max_batch = max(self.max_batch, items)
+
+    def snapshot(self) -> Dict[str, Any]:
+        items = max(self.items, 1)
+        elapsed = max(time.perf_counter() - self.started, 1e-9)
+        return {
+            'items': self.items,
+            'queue_depth': self.queue_depth,
+            'max_queue_depth': self.max_queue_depth,
+            'busy_ms_mean': 1000.0 * self.busy_sec / items,
+            'busy_ms_max': 1000.0 * self.max_busy_sec,
+            'wait_ms_mean': 1000.0 * self.wait_sec / items,
+            'utilization': self.busy_sec / elapsed,
+            'catch_up_batches': self.batches,
+            'max_batch': self.max_batch,
+        }
+
+
+class AnalysisPipeline:
+    """
+    receive -> analysis workers -> sink, each stage on its own thread.
+
+    The receiver's items go to every worker; each worker owns a disjoint
+    part of the analysis state and returns its part of the result. The
+    analysis carries state from packet to packet, so a worker takes the
+    packets in order, and workers run side by side on the same packet or
+    on consecutive ones; their numpy and FFT work releases the GIL. Each
+    worker has its own output queue and the sink takes one result from
+    every queue in turn, which puts the parts of a packet back together
+    in stream order.
+
+    Queues hold at most queue_size items, so a stage that falls behind
+    stalls the ones before it instead of growing memory.
+
+    Catch-up: a worker with a batch function that finds catch_up_backlog
+    or more items queued behind the one it took drains its queue, at
+    most queue_size items, and hands them all to the batch function at
+    once, which must return one part per item. Per-call costs are then
+    paid once per backlog instead of once per item, so a worker that fell
+    behind (a GC pause, a stall downstream) gains on the stream again. At
+    most 2 * queue_size + 1 items are in flight past the receiver per
+    worker.
+    """
+
+    POLL_SEC = 0.1
+
+    def __init__(self, receive: Callable[[], Optional[Any]],
+                 workers: Dict[str, Callable[[Any], Dict[str, Any]]],
+                 sink: Callable[[Any, Dict[str, Any]], None],
+                 queue_size: int = 4, on_error: Callable[[str, Exception], None] = None,
+                 batch_workers: Dict[str, Callable[[List[Any]], List[Dict[str, Any]]]] = None,
+                 catch_up_backlog: int = 0):
+        self.receive = receive
+        self.workers = workers
+        self.batch_workers = batch_workers or {}
+        self.catch_up_backlog = catch_up_backlog
+        self.sink = sink
+        self.on_error = on_error
+        self.inboxes = {name: queue.Queue(queue_size) for name in workers}
+        self.outboxes = {name: queue.Queue(queue_size) for name in workers}
+        self.stats = {'receive': StageStats('receive', [])}
+        for name in workers:
+            self.stats[name] = StageStats(name, [self.inboxes[name]])
+        self.stats['sink'] = StageStats('sink', list(self.outboxes.values()))
+        self.running = False
+        self.threads = []
+
+    def _get(self, inbox: queue.Queue, stats: StageStats) -> Any:
+        start = time.perf_counter()
+        while self.running:
+            try:
+                item = inbox.get(timeout=self.POLL_SEC)
+            except queue.Empty:
+                continue
+            stats.wait_sec += time.perf_counter() - start
+            stats.max_queue_depth = max(stats.max_queue_depth, inbox.qsize() + 1)
+            return item
+        return STOP
+
+    def _put(self, outbox: queue.Queue, item: Any, stats: StageStats) -> bool:
+        start = time.perf_counter()
+        while self.running:
+            try:
+                outbox.put(item, timeout=self.POLL_SEC)
+            except queue.Full:
+                continue
+            stats.wait_sec += time.perf_counter() - start
+            return True
+        return False
+
+    def _fail(self, stage: str, error: Exception):
+        if self.on_error is not None:
+            self.on_error(stage, error)
+        self.stop()
+
+    def _receive_loop(self):
+        stats = self.stats['receive']
+        while self.running:
+            start = time.perf_counter()
+            try:
+                item = self.receive()
+            except Exception as e:
+                self._fail('receive', e)
+                return
+            if item is STOP:
+                break
+            stats.record(time.perf_counter() - start)
+            for inbox in self.inboxes.values():
+                if not self._put(inbox, item, stats):
+                    return
+        for inbox in self.inboxes.values():
+            self._put(inbox, STOP, stats)
+
+    def _drain(self, inbox: queue.Queue) -> tuple:
+        """
+        Items queued right now, and whether the end of the stream is among
+        them. Every get frees a slot the receiver may refill at once, so
+        this stops after one queue's worth.
+        """
+        items = []
+        while len(items) < inbox.maxsize:
+            try:
+                item = inbox.get_nowait()
+            except queue.Empty:
+                return items, False
+            if item is STOP:
+                return items, True
+            items.append(item)
+        return items, False
+
+    def _work_loop(self, name: str):
+        work, stats = self.workers[name], self.stats[name]
+        batch_work = self.batch_workers.get(name)
+        inbox, outbox = self.inboxes[name], self.outboxes[name]
+        while True:
+            item = self._get(inbox, stats)
+            if item is STOP:
+                self._put(outbox, STOP, stats)
+                return
+            items, stopping = [item], False
+            if batch_work is not None and self.catch_up_backlog > 0 and \
+                    inbox.qsize() >= self.catch_up_backlog:
+                backlog, stopping = self._drain(inbox)
+                items.extend(backlog)
+            start = time.perf_counter()
+            try:
+                parts = batch_work(items) if len(items) > 1 else [work(item)]
+            except Exception as e:
+                self._fail(name, e)
+                return
+            stats.record(time.perf_counter() - start, len(items))
+            for item, part in zip(items, parts):
+                if not self._put(outbox, (item, part), stats):
+                    return
+            if stopping:
+                self._put(outbox, STOP, stats)
+                return
+
+    def _sink_loop(self):
+        stats = self.stats['sink']
+        while True:
+            results = {}
+            for name, outbox in self.outboxes.items():
+                result = self._get(outbox, stats)
+                if result is STOP:
+                    self.running = False
+                    return
+                results[name] = result
+            start = time.perf_counter()
+            item = next(iter(results.values()))[0]
+            try:
+                self.sink(item, {name: part for name, (_, part) in results.items()})
+            except Exception as e:
+                self._fail('sink', e)
+                return
+            stats.record(time.perf_counter() - start)
+
+    def start(self):
+        self.running = True
+        targets = [('receive', self._receive_loop, ())]
+        targets += [(name, self._work_loop, (name,)) for name in self.workers]
+        targets.append(('sink', self._sink_loop, ()))
+        self.threads = [threading.Thread(target=target, args=args, name=f'silenttrace-{name}', daemon=True)
+                        for name, target, args in targets]
+        for thread in self.threads:
+            thread.start()
+
+    def wait(self):
+        """Block until the stream ends or the pipeline is stopped"""
+        # The sink is the last to see the end of the stream; short joins
+        # keep the calling thread responsive to Ctrl-C. A receiver still
+        # blocked on the socket after a stop is left to the socket's close.
+        sink = self.threads[-1]
+        while self.running and sink.is_alive():
+            sink.join(self.POLL_SEC)
+
+    def stop(self):
+        self.running = False
+
+    def snapshot(self) -> Dict[str, Dict[str, Any]]:
+        """Per-stage counters, queue depths and timing"""
+        return {name: stats.snapshot() for name, stats in self.stats.items()}
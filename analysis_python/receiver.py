@@ -0,0 +1,94 @@
+"""
+SilentTrace Receiver Module
+Reads audio packets from the capture daemon's socket into reused buffers
+"""
+
+import socket
+import struct
+from typing import Any, Dict, List
+
+import numpy as np
+
+# Wire format shared with core_c/audio_capture.c. The C header struct is
+# padded to 24 bytes (uint64 + 3 x uint32 + 4 bytes padding).
+AUDIO_HEADER_FORMAT = '<QIII4x'
+AUDIO_HEADER_SIZE = struct.calcsize(AUDIO_HEADER_FORMAT)
+
+INT16_SCALE = np.float32(1.0 / 32768.0)
+
+
+class PacketReceiver:
+    """
+    Receives packets with recv_into straight into preallocated memory and
+    converts the int16 samples to float32 in place, so a steady stream of
+    same-sized packets allocates no buffers. Packets are handed out from a
+    ring of pool_size slots: a packet's dict and arrays stay valid until
+    pool_size further packets have been received, which lets a consumer
+    work on one while the next is read.
+    """
+
+    def __init__(self, sock: socket.socket, pool_size: int = 2):
+        self.socket = sock
+        self.header = bytearray(AUDIO_HEADER_SIZE)
+        self.header_view = memoryview(self.header)
+        self.header_struct = struct.Struct(AUDIO_HEADER_FORMAT)
+        self.slots: List[Dict[str, Any]] = [{'packet': {}} for _ in range(pool_size)]
+        for slot in self.slots:
+            self._allocate(slot, 0)
+        self.next_slot = 0
+
+    def _recv_exactly(self, view: memoryview):
+        """Fill view completely, however the stream splits it"""
+        received = 0
+        size = len(view)
+        while received < size:
+            # Slice only after a partial read; the slice is a new object
+            n = self.socket.recv_into(view[received:] if received else view, size - received)
+            if n == 0:
+                raise ConnectionError("Connection closed by audio source")
+            received += n
+
+    @staticmethod
+    def _allocate(slot: Dict[str, Any], n_samples: int):
+        """(Re)allocate a slot's buffers for packets of n_samples"""
+        slot['payload'] = bytearray(2 * n_samples)
+        slot['samples'] = np.frombuffer(slot['payload'], dtype=np.int16)
+        slot['audio'] = np.empty(n_samples, dtype=np.float32)
+        slot['size'] = None
+
+    @staticmethod
+    def _resize(slot: Dict[str, Any], n_samples: int):
+        """Views of a slot's buffers for packets of n_samples, kept while the size repeats"""
+        slot['size'] = n_samples
+        slot['recv_view'] = memoryview(slot['payload'])[:2 * n_samples]
+        slot['samples_view'] = slot['samples'][:n_samples]
+        slot['audio_view'] = slot['audio'][:n_samples]
+
+    def receive(self) -> Dict[str, Any]:
+        """
+        Next packet as {'timestamp', 'sample_rate', 'audio_data', 'channels'};
+        audio_data is interleaved float32 in [-1, 1)
+        """
+        self._recv_exactly(self.header_view)
+        timestamp, sample_rate, buffer_length, channels = self.header_struct.unpack_from(self.header)
+
+        slot = self.slots[self.next_slot]
+        self.next_slot = (self.next_slot + 1) % len(self.slots)
+        n_samples = buffer_length * channels
+        if len(slot['payload']) < 2 * n_samples:
+            self._allocate(slot, n_samples)
+        if slot['size'] != n_samples:
+            self._resize(slot, n_samples)
+        self._recv_exactly(slot['recv_view'])
+
+        # Cast first and scale in place: a mixed-type multiply would
+        # allocate numpy's cast buffer
+        audio = slot['audio_view']
+        np.copyto(audio, slot['samples_view'])
+        np.multiply(audio, INT16_SCALE, out=audio)
+        packet = slot['packet']
+        packet['timestamp'] = timestamp
+        packet['sample_rate'] = sample_rate
+        packet['audio_data'] = audio
+        packet['channels'] = channels
+        return packet
@@ -0,0 +1,105 @@
+"""
+SilentTrace Shadow Module
+Alternative detector configurations evaluated on the production spectra,
+with their alert decisions recorded side by side
+"""
+
+import json
+import time
+from dataclasses import replace
+from typing import Any, Dict, List
+
+from tracking import PeakTracker
+
+# What a shadow configuration may change. The spectra, the CFAR noise
+# estimate (mode, guard and training bins), periodicity and the beacon
+# analysis are production's, shared by every configuration
+SHADOW_SETTINGS = ('threshold_db', 'cfar_pfa', 'floor_sigma', 'floor_time_constant_sec',
+                   'min_peak_distance', 'repetition_threshold', 'repetition_window_sec',
+                   'track_gate_hz', 'track_alpha', 'track_beta', 'track_timeout_sec',
+                   'periodicity_min_confidence')
+
+THREAT_LEVELS = ('normal', 'warning', 'alert')
+
+
+class ShadowConfigs:
+    """
+    Detector configurations that run next to production without raising
+    alerts. The analyzer detects with all of them at once through one
+    multi-configuration CFARDetector per band and resolution (kept in
+    banks); each configuration tracks its own peaks and reaches its own
+    threat level, which is counted and logged next to production's.
+    """
+
+    def __init__(self, detection, specs: List[Dict[str, Any]], log_path: str):
+        self.names = []
+        self.settings = []
+        for index, spec in enumerate(specs):
+            name = spec.get('name', f'shadow_{index + 1}')
+            overrides = {key: value for key, value in spec.items() if key != 'name'}
+            unknown = sorted(set(overrides) - set(SHADOW_SETTINGS))
+            if unknown:
+                raise ValueError(f"Shadow configuration {name!r} cannot change {', '.join(unknown)}")
+            self.names.append(name)
+            self.settings.append(replace(detection, **overrides))
+        self.log_path = log_path
+
+        # Multi-configuration CFAR detectors by (window size, band)
+        self.banks = {}
+        self.trackers = [
+            PeakTracker(s.track_gate_hz, s.track_alpha, s.track_beta, s.track_timeout_sec,
+                        s.repetition_threshold, s.repetition_window_sec)
+            for s in self.settings
+        ]
+        self.counts = {name: dict({level: 0 for level in THREAT_LEVELS}, alerts_added=0, alerts_missed=0)
+                       for name in self.names}
+
+    def __len__(self) -> int:
+        return len(self.names)
+
+    def assess(self, index: int, detections: List[Dict[str, Any]], periodic: bool,
+               timestamp: float) -> Dict[str, Any]:
+        """
+        Fold one packet's detections of configuration index into its
+        tracker. Returns what its threat level depends on besides the
+        beacon matches.
+        """
+        tracker = self.trackers[index]
+        alerting = [t for t in tracker.update(detections, timestamp) if tracker.is_alerting(t)]
+        return {'detections': len(detections), 'alert_tracks': len(alerting), 'periodic': periodic}
+
+    @staticmethod
+    def threat_level(assessment: Dict[str, Any], matched_beacons: List[str]) -> str:
+        """The same rules production's threat level follows"""
+        if assessment['alert_tracks'] or assessment['periodic'] or matched_beacons:
+            return "alert"
+        elif assessment['detections'] > 0:
+            return "warning"
+        else:
+            return "normal"
+
+    def record(self, capture_timestamp: int, production: str, levels: Dict[str, str], stream: str = None):
+        """
+        Count every configuration's threat level, and log the packet when
+        any of them or production is above normal
+        """
+        for name, level in levels.items():
+            counts = self.counts[name]
+            counts[level] += 1
+            if level == 'alert' and production != 'alert':
+                counts['alerts_added'] += 1
+            elif production == 'alert' and level != 'alert':
+                counts['alerts_missed'] += 1
+        if production == 'normal' and all(level == 'normal' for level in levels.values()):
+            return
+
+        entry = {'time': time.time(), 'capture_timestamp': capture_timestamp,
+                 'production': production, 'shadow': levels}
+        if stream is not None:
+            entry['stream'] = stream
+        with open(self.log_path, 'a') as f:
+            f.write(json.dumps(entry) + '\n')
+
+    def snapshot(self) -> Dict[str, Any]:
+        """Threat level counts per configuration since start"""
+        return {name: dict(counts) for name, counts in self.counts.items()}
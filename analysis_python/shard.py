@@ -0,0 +1,393 @@
+"""
+SilentTrace Shard Module
+Analyzes many input streams (capture channels, several capture daemons)
+in worker processes: streams are assigned with consistent hashing, frames
+are passed through shared memory, and results come back as one detection
+stream
+"""
+
+import hashlib
+import math
+import multiprocessing
+import os
+import queue
+import signal
+import threading
+import time
+from bisect import bisect_right
+from contextlib import contextmanager
+from multiprocessing import shared_memory
+from typing import Any, Callable, Dict, List, Optional, Sequence
+
+import numpy as np
+
+# Math libraries in a worker stay on one thread: the workers already use
+# the cores, and nested thread pools would only contend for them
+SINGLE_THREAD_ENV = ('OMP_NUM_THREADS', 'OPENBLAS_NUM_THREADS', 'MKL_NUM_THREADS')
+
+
+def stream_id(source: str, channel: int) -> str:
+    return f"{source}#{channel}"
+
+
+def _hash(key: str) -> int:
+    return int.from_bytes(hashlib.blake2b(key.encode(), digest_size=8).digest(), 'big')
+
+
+class HashRing:
+    """
+    Consistent hashing with bounded loads. Every worker owns `replicas`
+    points on a ring; a stream goes to the first worker clockwise from
+    its own point that is below capacity, ceil(load_factor * streams /
+    workers). Adding a worker or a stream moves few streams, and the cap
+    keeps the split even: at 1.0 every worker gets its fair share.
+    """
+
+    def __init__(self, n_nodes: int, replicas: int = 64):
+        self.n_nodes = n_nodes
+        points = sorted((_hash(f"worker-{node}-{r}"), node) for node in range(n_nodes) for r in range(replicas))
+        self.hashes = [h for h, _ in points]
+        self.nodes = [node for _, node in points]
+
+    def assign(self, keys: Sequence[str], load_factor: float = 1.0) -> Dict[str, int]:
+        """Worker of each key"""
+        capacity = max(1, math.ceil(load_factor * len(keys) / self.n_nodes))
+        load = [0] * self.n_nodes
+        owner = {}
+        # Keys claim their places in ring order, so the result depends on
+        # the set of keys only
+        for key_hash, key in sorted((_hash(key), key) for key in keys):
+            i = bisect_right(self.hashes, key_hash)
+            while load[self.nodes[i % len(self.nodes)]] >= capacity:
+                i += 1
+            node = self.nodes[i % len(self.nodes)]
+            load[node] += 1
+            owner[key] = node
+        return owner
+
+
+class FrameRing:
+    """
+    Packet slots in shared memory, slots x channels x samples of float32:
+    a packet is deinterleaved into a slot once and every worker reads its
+    channels from there in place
+    """
+
+    def __init__(self, n_slots: int, channels: int, samples: int, name: str = None):
+        self.shape = (n_slots, channels, samples)
+        size = max(4, 4 * n_slots * channels * samples)
+        if name is None:
+            self.memory = shared_memory.SharedMemory(create=True, size=size)
+        else:
+            self.memory = _attach(name)
+        self.name = self.memory.name
+        self.slots = np.ndarray(self.shape, dtype=np.float32, buffer=self.memory.buf)
+
+    def fits(self, channels: int, samples: int) -> bool:
+        return channels <= self.shape[1] and samples <= self.shape[2]
+
+    def close(self):
+        del self.slots
+        self.memory.close()
+
+    def unlink(self):
+        self.close()
+        self.memory.unlink()
+
+
+def _attach(name: str) -> shared_memory.SharedMemory:
+    """Open a segment the supervisor owns, without taking over its cleanup"""
+    try:
+        return shared_memory.SharedMemory(name=name, track=False)
+    except TypeError:
+        # Before Python 3.13 an attach registers the segment again, with
+        # the resource tracker spawned workers share with the supervisor;
+        # it is one entry there, removed when the supervisor unlinks
+        return shared_memory.SharedMemory(name=name)
+
+
+def _worker_main(index: int, analyzer_factory: Callable[[], Any], tasks, results):
+    """
+    Worker process: one analyzer per stream it owns. Tasks are
+    (seq, ring (name, shape), slot, source, timestamp, sample_rate,
+    n_samples, [(stream, row)]); None ends the worker.
+    """
+    # Ctrl-C reaches the whole process group; the supervisor ends workers
+    # once the packets already submitted are analyzed
+    signal.signal(signal.SIGINT, signal.SIG_IGN)
+    rings = {}
+    analyzers = {}
+    while True:
+        task = tasks.get()
+        if task is None:
+            break
+        seq, (ring_name, shape), slot, source, timestamp, sample_rate, n_samples, streams = task
+        start = time.perf_counter()
+        if ring_name not in rings:
+            for ring in rings.values():
+                ring.close()
+            rings = {ring_name: FrameRing(*shape, name=ring_name)}
+        frames = rings[ring_name].slots[slot]
+
+        # Streams of this source that moved to another worker
+        owned = {stream for stream, _ in streams}
+        for stream in [s for s, (src, _) in analyzers.items() if src == source and s not in owned]:
+            del analyzers[stream]
+
+        stream_results = []
+        error = None
+        for stream, row in streams:
+            packet = {'audio_data': frames[row, :n_samples], 'sample_rate': sample_rate,
+                      'timestamp': timestamp, 'channels': 1}
+            try:
+                if stream not in analyzers:
+                    analyzers[stream] = (source, analyzer_factory())
+                stream_results.append((stream, analyzers[stream][1].analyze_packet(packet)))
+            except Exception as e:
+                error = f"{stream}: {e}"
+        results.put((index, seq, stream_results, time.perf_counter() - start, error))
+        # No views into the ring may outlive it
+        frames = packet = None
+
+    for ring in rings.values():
+        ring.close()
+
+
+@contextmanager
+def _single_threaded_math():
+    saved = {name: os.environ.get(name) for name in SINGLE_THREAD_ENV}
+    os.environ.update({name: '1' for name in SINGLE_THREAD_ENV})
+    try:
+        yield
+    finally:
+        for name, value in saved.items():
+            if value is None:
+                os.environ.pop(name, None)
+            else:
+                os.environ[name] = value
+
+
+class ShardSupervisor:
+    """
+    Runs n_workers analyzer processes over the streams of any number of
+    sources. submit() copies a packet into a free shared-memory slot and
+    sends every worker that owns one of its channels a small task naming
+    the slot; the slot is reused once they have all answered. Results are
+    passed to on_result(stream, source, result) from one collector
+    thread, in the order the packets were submitted.
+
+    A packet's channels are independent streams here; the analyzer
+    factory builds the per-stream analyzer, whose analyze_packet() runs
+    in the worker. A stream whose analyzer fails is left out of that
+    packet's results, and a worker that exits takes its streams out of
+    every packet it still owed; both are passed to on_error.
+    """
+
+    POLL_SEC = 0.1
+
+    def __init__(self, n_workers: int, analyzer_factory: Callable[[], Any],
+                 on_result: Callable[[str, str, Dict[str, Any]], None],
+                 queue_slots: int = 8, load_factor: float = 1.0,
+                 on_error: Callable[[str], None] = None):
+        self.n_workers = n_workers
+        self.analyzer_factory = analyzer_factory
+        self.on_result = on_result
+        self.on_error = on_error
+        self.queue_slots = queue_slots
+        self.load_factor = load_factor
+        self.ring = HashRing(n_workers)
+
+        # submit() holds lock, also while it waits for slots; the collector
+        # only ever takes pending_lock, so it can always free them
+        self.lock = threading.Lock()
+        self.pending_lock = threading.Lock()
+        self.frames: Optional[FrameRing] = None
+        self.free_slots = queue.Queue()
+        self.sources: Dict[str, int] = {}       # channels of each source
+        self.owners: Dict[str, int] = {}        # worker of each stream
+        self.next_seq = 0
+        self.reported = 0                       # seq of the next packet to report
+        self.pending: Dict[int, Dict[str, Any]] = {}   # by seq, until every worker answered
+
+        self.in_flight = [0] * n_workers
+        self.max_in_flight = [0] * n_workers
+        self.items = [0] * n_workers
+        self.busy_sec = [0.0] * n_workers
+        self.max_busy_sec = [0.0] * n_workers
+        self.started = time.perf_counter()
+
+        context = multiprocessing.get_context('spawn')
+        self.tasks = [context.Queue() for _ in range(n_workers)]
+        self.results = context.Queue()
+        self.context = context
+        self.processes = []
+        self.collector = threading.Thread(target=self._collect, name='silenttrace-collect', daemon=True)
+        self.running = False
+
+    def start(self):
+        self.running = True
+        self.processes = [self.context.Process(target=_worker_main, name=f'silenttrace-shard{i}',
+                                               args=(i, self.analyzer_factory, self.tasks[i], self.results),
+                                               daemon=True)
+                          for i in range(self.n_workers)]
+        with _single_threaded_math():
+            for process in self.processes:
+                process.start()
+        self.collector.start()
+
+    def _reassign(self, source: str, channels: int):
+        """Place every stream again when a source appears or changes shape"""
+        self.sources[source] = channels
+        streams = [stream_id(src, c) for src, n in self.sources.items() for c in range(n)]
+        self.owners = self.ring.assign(streams, self.load_factor)
+
+    def _reserve(self, channels: int, samples: int):
+        """A slot ring that holds this packet, grown once all slots are free"""
+        if self.frames is not None and self.frames.fits(channels, samples):
+            return
+        if self.frames is not None:
+            for _ in range(self.queue_slots):
+                self._free_slot()
+            channels = max(channels, self.frames.shape[1])
+            samples = max(samples, self.frames.shape[2])
+            self.frames.unlink()
+        self.frames = FrameRing(self.queue_slots, channels, samples)
+        for slot in range(self.queue_slots):
+            self.free_slots.put(slot)
+
+    def _free_slot(self) -> int:
+        """Wait for a slot the workers are done with, as long as they run"""
+        while True:
+            try:
+                return self.free_slots.get(timeout=self.POLL_SEC)
+            except queue.Empty:
+                if not self.running or not self.collector.is_alive():
+                    raise RuntimeError("Shard workers stopped")
+
+    def submit(self, source: str, packet: Dict[str, Any]):
+        """
+        Hand a packet ({'timestamp', 'sample_rate', 'audio_data'
+        interleaved, 'channels'}) to the workers; blocks while every slot
+        is in use, and raises RuntimeError if the workers stop meanwhile
+        """
+        channels = packet['channels']
+        n_samples = len(packet['audio_data']) // channels
+        with self.lock:
+            if self.sources.get(source) != channels:
+                self._reassign(source, channels)
+            self._reserve(channels, n_samples)
+            slot = self._free_slot()
+            self.frames.slots[slot, :channels, :n_samples] = \
+                np.asarray(packet['audio_data']).reshape(n_samples, channels).T
+
+            by_worker: Dict[int, List] = {}
+            for channel in range(channels):
+                stream = stream_id(source, channel)
+                by_worker.setdefault(self.owners[stream], []).append((stream, channel))
+            seq = self.next_seq
+            self.next_seq += 1
+            with self.pending_lock:
+                self.pending[seq] = {'slot': slot, 'source': source, 'workers': set(by_worker), 'results': []}
+            ring = (self.frames.name, self.frames.shape)
+            for worker, streams in by_worker.items():
+                self.in_flight[worker] += 1
+                self.max_in_flight[worker] = max(self.max_in_flight[worker], self.in_flight[worker])
+                self.tasks[worker].put((seq, ring, slot, source, packet['timestamp'],
+                                        packet['sample_rate'], n_samples, streams))
+
+    def _collect(self):
+        """Gather worker answers, free slots and report packets in order"""
+        while self.running or self.pending:
+            try:
+                answer = self.results.get(timeout=self.POLL_SEC)
+            except queue.Empty:
+                self._check_exited()
+                if not any(p.is_alive() for p in self.processes):
+                    break
+                continue
+            self._report(*answer)
+
+    def _report(self, worker: int, seq: int, stream_results: List, busy_sec: float, error: Optional[str]):
+        """Take one worker's answer for packet seq"""
+        self.items[worker] += 1
+        self.busy_sec[worker] += busy_sec
+        self.max_busy_sec[worker] = max(self.max_busy_sec[worker], busy_sec)
+        if error is not None and self.on_error is not None:
+            self.on_error(f"Shard worker {worker}: {error}")
+        self._complete(worker, seq, stream_results)
+
+    def _complete(self, worker: int, seq: int, stream_results: List):
+        """Count a worker done with packet seq, then report every packet that is complete, in order"""
+        self.in_flight[worker] -= 1
+        with self.pending_lock:
+            entry = self.pending[seq]
+            entry['results'].extend(stream_results)
+            entry['workers'].discard(worker)
+            if not entry['workers']:
+                self.free_slots.put(entry['slot'])
+        while True:
+            with self.pending_lock:
+                if self.reported not in self.pending or self.pending[self.reported]['workers']:
+                    break
+                entry = self.pending.pop(self.reported)
+            for stream, result in sorted(entry['results'], key=lambda r: r[0]):
+                try:
+                    self.on_result(stream, entry['source'], result)
+                except Exception as e:
+                    if self.on_error is not None:
+                        self.on_error(f"Reporting {stream}: {e}")
+            self.reported += 1
+
+    def _check_exited(self):
+        """Give up a worker's part of the packets it owed once it has exited"""
+        exited = [(worker, p.exitcode) for worker, p in enumerate(self.processes) if p.exitcode is not None]
+        if not exited:
+            return
+        # Whatever it answered before exiting is in the queue by now
+        while True:
+            try:
+                answer = self.results.get_nowait()
+            except queue.Empty:
+                break
+            self._report(*answer)
+        for worker, exitcode in exited:
+            with self.pending_lock:
+                owed = sorted(seq for seq, entry in self.pending.items() if worker in entry['workers'])
+            if not owed:
+                continue
+            if self.on_error is not None:
+                self.on_error(f"Shard worker {worker} exited with code {exitcode}; "
+                              f"its streams are missing from {len(owed)} packets")
+            for seq in owed:
+                self._complete(worker, seq, [])
+
+    def stop(self, timeout: float = 5.0):
+        """Finish the submitted packets, then end the workers"""
+        self.running = False
+        for tasks, _ in zip(self.tasks, self.processes):
+            tasks.put(None)
+        if self.collector.is_alive():
+            self.collector.join(timeout)
+        for process in self.processes:
+            process.join(timeout)
+            if process.is_alive():
+                process.terminate()
+        if self.frames is not None:
+            self.frames.unlink()
+            self.frames = None
+
+    def snapshot(self) -> Dict[str, Dict[str, Any]]:
+        """Per-worker streams, packets in flight and timing, like the pipeline stages"""
+        elapsed = max(time.perf_counter() - self.started, 1e-9)
+        streams = [0] * self.n_workers
+        for worker in self.owners.values():
+            streams[worker] += 1
+        return {f'shard{i}': {
+            'streams': streams[i],
+            'items': self.items[i],
+            'queue_depth': self.in_flight[i],
+            'max_queue_depth': self.max_in_flight[i],
+            'busy_ms_mean': 1000.0 * self.busy_sec[i] / max(self.items[i], 1),
+            'busy_ms_max': 1000.0 * self.max_busy_sec[i],
+            'utilization': self.busy_sec[i] / elapsed,
+        } for i in range(self.n_workers)}
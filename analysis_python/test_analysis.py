@@ -0,0 +1,313 @@
+#!/usr/bin/env python3
+"""
+SilentTrace Analysis Checks
+Behavior checks for the analysis path on synthetic audio. Run from
+analysis_python/:
+
+  python3 -m unittest test_analysis
+"""
+
+import os
+import socket
+import struct
+import sys
+import threading
+import time
+import unittest
+import numpy as np
+
+from config import config
+from detection import CFARDetector
+from matched_filter import BeaconTemplate, MatchedFilterBank
+from pipeline import AnalysisPipeline
+from receiver import AUDIO_HEADER_FORMAT, PacketReceiver
+from shard import HashRing, ShardSupervisor, stream_id
+
+config.alerts.enable_file_logging = False
+config.alerts.log_file_path = os.devnull
+
+import analyze
+
+SAMPLE_RATE = 44100
+
+
+def noisy_tone(seconds: float, frequency: float, start_sec: float = 0.0, seed: int = 1) -> np.ndarray:
+    """Noise of standard deviation 0.01 with a 0.01 amplitude tone from start_sec"""
+    rng = np.random.default_rng(seed)
+    t = np.arange(int(seconds * SAMPLE_RATE)) / SAMPLE_RATE
+    tone = np.sin(2 * np.pi * frequency * t) * (t >= start_sec)
+    return (0.01 * rng.standard_normal(len(t)) + 0.01 * tone).astype(np.float32)
+
+
+def packets(audio: np.ndarray) -> list:
+    """One-second packets as the capture daemon sends them"""
+    return [{'audio_data': block, 'sample_rate': SAMPLE_RATE, 'timestamp': 1000 * (i + 1), 'channels': 1}
+            for i, block in enumerate(np.split(audio, len(audio) // SAMPLE_RATE))]
+
+
+def quiet_detector():
+    """
+    Analyzer factory for shard workers, which import this module and so
+    leave the log files alone too
+    """
+    return analyze.UltrasonicDetector()
+
+
+def broken_detector():
+    """Analyzer factory that fails in the shard worker"""
+    raise RuntimeError("no analyzer here")
+
+
+def exiting_detector():
+    """Analyzer factory that ends the shard worker process"""
+    os._exit(3)
+
+
+def stage_items(detector, audio_packets: list) -> list:
+    """Packets as the receive stage hands them to the analysis workers"""
+    items = []
+    for packet in audio_packets:
+        audio, gap = detector.packet_audio(packet)
+        items.append({'audio': audio, 'sample_rate': packet['sample_rate'],
+                      'timestamp': packet['timestamp'], 'gap': gap})
+    return items
+
+
+class NoiseFloorTest(unittest.TestCase):
+
+    def test_tone_present_from_startup_is_detected(self):
+        # A bin held from the first frame must not learn the tone as floor
+        n_bins, tone_bin = 256, 100
+        rng = np.random.default_rng(0)
+        for mode in ('ca', 'os'):
+            detector = CFARDetector(n_bins, mode=mode)
+            for _ in range(10):
+                power = rng.exponential(1.0, (20, n_bins)).astype(np.float32)
+                power[:, tone_bin] += 1000.0
+                peaks, _ = detector.detect(power, 0.05)
+                self.assertIn(tone_bin, peaks, mode)
+
+    def test_tone_present_from_startup_alerts(self):
+        detector = analyze.UltrasonicDetector()
+        results = [detector.analyze_packet(packet) for packet in packets(noisy_tone(8, 19500.0))]
+        self.assertTrue(all(result['detections'] for result in results))
+        self.assertEqual(results[-1]['threat_level'], 'alert')
+
+
+class MatchedFilterTest(unittest.TestCase):
+
+    def test_tone_burst_matches_only_its_template(self):
+        # It also matches the FSK symbol at 18.5 kHz and the chirps more
+        # weakly; only the best template may be reported
+        templates = [BeaconTemplate.from_dict(spec) for spec in config.detection.beacon_templates]
+        bank = MatchedFilterBank(templates, SAMPLE_RATE, 18000, 22000, 13.0)
+        t = np.arange(SAMPLE_RATE) / SAMPLE_RATE
+        bursts = 0.05 * np.sin(2 * np.pi * 18500.0 * t) * ((t % 0.25) >= 0.1) * ((t % 0.25) < 0.15)
+        noise = 0.01 * np.random.default_rng(2).standard_normal((3, SAMPLE_RATE))
+        for block in noise + bursts:
+            results = bank.process(block.astype(np.float32))
+        matched = [name for name, result in results.items() if result['matches']]
+        self.assertEqual(matched, ['tone_burst_18k5'])
+        self.assertEqual(len(results['tone_burst_18k5']['matches']), 4)
+
+
+class CountingSocket:
+    """A socket that counts the reads it is asked for"""
+
+    def __init__(self, sock: socket.socket):
+        self.sock = sock
+        self.reads = 0
+
+    def recv_into(self, buffer, nbytes: int = 0) -> int:
+        self.reads += 1
+        return self.sock.recv_into(buffer, nbytes)
+
+
+class ReceiverTest(unittest.TestCase):
+
+    def test_packets_split_into_small_pieces(self):
+        # Two stereo packets, then the size changes up and down
+        rng = np.random.default_rng(3)
+        shapes = [(32, 2), (32, 2), (48, 1), (48, 1), (16, 1), (16, 1)]
+        sent = [(1000 * (i + 1), rng.integers(-32768, 32768, frames * channels, dtype=np.int16), channels)
+                for i, (frames, channels) in enumerate(shapes)]
+        stream = b''.join(struct.pack(AUDIO_HEADER_FORMAT, timestamp, SAMPLE_RATE, len(samples) // channels,
+                                      channels) + samples.astype('<i2').tobytes()
+                          for timestamp, samples, channels in sent)
+        source, sink = socket.socketpair()
+
+        def send():
+            # 1-7 bytes at a time, so every header and payload arrives in pieces
+            position = 0
+            while position < len(stream):
+                piece = int(rng.integers(1, 8))
+                source.sendall(stream[position:position + piece])
+                position += piece
+                time.sleep(0.0002)
+
+        sender = threading.Thread(target=send)
+        sender.start()
+        counting = CountingSocket(sink)
+        receiver = PacketReceiver(counting, pool_size=2)
+        received = []
+        try:
+            for i, (timestamp, samples, channels) in enumerate(sent):
+                packet = receiver.receive()
+                self.assertEqual((packet['timestamp'], packet['sample_rate'], packet['channels']),
+                                 (timestamp, SAMPLE_RATE, channels))
+                np.testing.assert_array_equal(packet['audio_data'], samples / np.float32(32768.0))
+                received.append((packet, packet['audio_data']))
+                # The packet before it must survive this receive
+                if i > 0:
+                    previous, audio = received[i - 1]
+                    self.assertEqual(previous['timestamp'], sent[i - 1][0])
+                    self.assertIs(previous['audio_data'], audio)
+                    np.testing.assert_array_equal(audio, sent[i - 1][1] / np.float32(32768.0))
+        finally:
+            sender.join()
+            source.close()
+            sink.close()
+        self.assertGreater(counting.reads, 2 * len(sent))
+
+
+class CatchUpTest(unittest.TestCase):
+
+    def assert_same(self, a, b, path='result'):
+        if isinstance(a, dict):
+            self.assertEqual(sorted(a), sorted(b), path)
+            for key in a:
+                self.assert_same(a[key], b[key], f'{path}.{key}')
+        elif isinstance(a, (list, tuple)):
+            self.assertEqual(len(a), len(b), path)
+            for i, (x, y) in enumerate(zip(a, b)):
+                self.assert_same(x, y, f'{path}[{i}]')
+        elif isinstance(a, np.ndarray) and a.dtype.names:
+            for name in a.dtype.names:
+                self.assert_same(a[name], b[name], f'{path}.{name}')
+        elif isinstance(a, np.ndarray):
+            np.testing.assert_allclose(a, b, rtol=1e-5, err_msg=path)
+        elif isinstance(a, float):
+            # Features summed over a block in another order than per packet
+            self.assertAlmostEqual(a, b, delta=1e-5 * abs(a), msg=path)
+        else:
+            self.assertEqual(a, b, path)
+
+    def test_batch_equals_packet_by_packet(self):
+        audio = noisy_tone(8, 19500.0, start_sec=3.0) + noisy_tone(8, 20300.0, start_sec=5.5, seed=2)
+        serial, batched = analyze.UltrasonicDetector(), analyze.UltrasonicDetector()
+        expected = [serial.spectral_worker(item) for item in stage_items(serial, packets(audio))]
+        items = stage_items(batched, packets(audio))
+        results = [batched.spectral_worker(items[0])] + batched.spectral_batch_worker(items[1:])
+        for result in expected + results:
+            result.pop('timing')
+        self.assertTrue(any(result['detections'] for result in expected))
+        self.assert_same(expected, results)
+
+    def test_backlog_is_capped_at_queue_size(self):
+        # A receiver that refills the queue while it is drained must not
+        # grow a batch past one queue's worth
+        queue_size, received, batches, sunk = 4, [0], [], []
+
+        def receive():
+            received[0] += 1
+            return received[0] if received[0] <= 500 else None
+
+        def batch(items):
+            batches.append(len(items))
+            time.sleep(0.001)
+            return [{} for _ in items]
+
+        pipeline = AnalysisPipeline(receive, {'spectra': lambda item: {}}, lambda item, parts: sunk.append(item),
+                                    queue_size, batch_workers={'spectra': batch}, catch_up_backlog=1)
+        # Switch threads often so the receiver refills during the drain
+        interval = sys.getswitchinterval()
+        sys.setswitchinterval(1e-6)
+        try:
+            pipeline.start()
+            pipeline.wait()
+        finally:
+            sys.setswitchinterval(interval)
+        self.assertEqual(sunk, list(range(1, 501)))
+        self.assertLessEqual(max(batches, default=0), queue_size + 1)
+
+
+class ShardTest(unittest.TestCase):
+
+    def test_streams_reported_in_packet_order(self):
+        # Odd channels carry a tone from the start, even ones only noise
+        channels, seconds = 4, 5
+        streams = [noisy_tone(seconds, 19500.0, start_sec=0.0 if channel % 2 else seconds, seed=channel)
+                   for channel in range(channels)]
+        interleaved = np.stack(streams, axis=1).reshape(-1)
+        reported = []
+        supervisor = ShardSupervisor(2, quiet_detector,
+                                     lambda stream, source, result: reported.append((stream, result)))
+        supervisor.start()
+        try:
+            for i, block in enumerate(np.split(interleaved, seconds)):
+                supervisor.submit('test', {'timestamp': 1000 * (i + 1), 'sample_rate': SAMPLE_RATE,
+                                           'audio_data': block, 'channels': channels})
+        finally:
+            supervisor.stop(timeout=30.0)
+
+        self.assertEqual(len(reported), channels * seconds)
+        timestamps = [result['capture_timestamp'] for _, result in reported]
+        self.assertEqual(timestamps, sorted(timestamps))
+        for channel, audio in enumerate(streams):
+            # Each stream is analyzed on its own, as one analyzer would
+            reference = analyze.UltrasonicDetector()
+            expected = [reference.analyze_packet(packet) for packet in packets(audio)]
+            results = [result for stream, result in reported if stream == stream_id('test', channel)]
+            self.assertEqual([r['capture_timestamp'] for r in results], [r['capture_timestamp'] for r in expected])
+            self.assertEqual([r['threat_level'] for r in results], [r['threat_level'] for r in expected])
+            self.assertEqual([[d['frequency'] for d in r['detections']] for r in results],
+                             [[d['frequency'] for d in r['detections']] for r in expected])
+            self.assertEqual(any(r['detections'] for r in results), channel % 2 == 1)
+
+    def test_out_of_order_answers_reported_in_packet_order(self):
+        # Workers answer the newest packet first; the collector must still
+        # report packet by packet. The workers are not started, their
+        # answers are handed in here
+        reported = []
+        supervisor = ShardSupervisor(2, quiet_detector, lambda stream, source, result: reported.append(
+            (result['capture_timestamp'], stream)))
+        streams = [stream_id('test', channel) for channel in range(4)]
+        owners = HashRing(2).assign(streams)
+        try:
+            for i in range(3):
+                supervisor.submit('test', {'timestamp': 1000 * (i + 1), 'sample_rate': SAMPLE_RATE,
+                                           'audio_data': np.zeros(4 * 1024, dtype=np.float32), 'channels': 4})
+            for seq in reversed(range(3)):
+                for worker in range(2):
+                    answers = [(stream, {'capture_timestamp': 1000 * (seq + 1)})
+                               for stream in streams if owners[stream] == worker]
+                    supervisor._report(worker, seq, answers, 0.0, None)
+        finally:
+            supervisor.stop()
+
+        expected = [(1000 * (i + 1), stream) for i in range(3) for stream in streams]
+        self.assertEqual(reported, expected)
+
+    def test_failing_analyzers_are_reported(self):
+        # Neither an analyzer that cannot be built nor a worker that exits
+        # may stall the packets behind them
+        channels = 2
+        for factory, message in ((broken_detector, 'no analyzer here'), (exiting_detector, 'exited with code 3')):
+            reported, errors = [], []
+            supervisor = ShardSupervisor(2, factory, lambda stream, source, result: reported.append(stream),
+                                         queue_slots=2, on_error=errors.append)
+            supervisor.start()
+            try:
+                for i in range(4):
+                    supervisor.submit('test', {'timestamp': 1000 * (i + 1), 'sample_rate': SAMPLE_RATE,
+                                               'audio_data': np.zeros(channels * 1024, dtype=np.float32),
+                                               'channels': channels})
+            finally:
+                supervisor.stop(timeout=30.0)
+            self.assertEqual(reported, [])
+            self.assertTrue(errors, factory.__name__)
+            self.assertTrue(all(message in error for error in errors), errors)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,162 @@
+"""
+SilentTrace Tracking Module
+Frame-to-frame association of spectral peaks into tracks with incremental
+statistics, so repetition is judged per signal instead of by rescanning a
+history of raw detections
+"""
+
+from collections import deque
+from dataclasses import dataclass, field
+from typing import Any, Deque, Dict, List, Optional
+
+
+@dataclass
+class Track:
+    """One signal followed across analysis updates"""
+    track_id: int
+    first_seen: float
+    last_seen: float
+    frequency: float                # alpha-beta filtered
+    drift_hz_per_sec: float = 0.0
+    magnitude: float = 0.0          # last detection
+    hits: int = 0
+    misses: int = 0                 # consecutive updates without a hit
+
+    # Running frequency and magnitude statistics (Welford)
+    mean_frequency: float = 0.0
+    m2_frequency: float = 0.0
+    mean_magnitude: float = 0.0
+
+    # Repetition: a hit after at least one miss starts a new burst
+    bursts: int = 0
+    last_onset: Optional[float] = None
+    mean_period_sec: float = 0.0
+    recent_hits: Deque[float] = field(default_factory=deque)
+
+    @property
+    def duration_sec(self) -> float:
+        return self.last_seen - self.first_seen
+
+    @property
+    def frequency_std(self) -> float:
+        return (self.m2_frequency / self.hits) ** 0.5 if self.hits > 1 else 0.0
+
+    def summary(self) -> Dict[str, Any]:
+        return {
+            'track_id': self.track_id,
+            'frequency': round(self.frequency, 2),
+            'mean_frequency': round(self.mean_frequency, 2),
+            'frequency_std': round(self.frequency_std, 2),
+            'drift_hz_per_sec': round(self.drift_hz_per_sec, 3),
+            'mean_magnitude': round(self.mean_magnitude, 2),
+            'duration_sec': round(self.duration_sec, 2),
+            'hits': self.hits,
+            'bursts': self.bursts,
+            'repetition_period_sec': round(self.mean_period_sec, 3) if self.bursts > 1 else None,
+        }
+
+
+class PeakTracker:
+    """
+    Associates each update's peaks with the live tracks nearest in predicted
+    frequency, within gate_hz. Peaks and tracks are both walked in frequency
+    order, so an update costs O(peaks + tracks). An alpha-beta filter follows
+    Doppler drift; with beta = 0 the prediction is the last frequency.
+    """
+
+    def __init__(self, gate_hz: float = 50.0, alpha: float = 0.5, beta: float = 0.1,
+                 timeout_sec: float = 10.0, repetition_threshold: int = 3,
+                 repetition_window_sec: float = 10.0):
+        self.gate_hz = gate_hz
+        self.alpha = alpha
+        self.beta = beta
+        self.timeout_sec = timeout_sec
+        self.repetition_threshold = repetition_threshold
+        self.repetition_window_sec = repetition_window_sec
+        self.tracks: List[Track] = []   # ascending frequency
+        self.next_id = 1
+        self.last_update: Optional[float] = None
+
+    def is_alerting(self, track: Track) -> bool:
+        """Hit repetition_threshold times within repetition_window_sec"""
+        hits = track.recent_hits
+        return len(hits) >= self.repetition_threshold and \
+            hits[-1] - hits[0] <= self.repetition_window_sec
+
+    def _hit(self, track: Track, detection: Dict[str, Any], now: float, dt: float):
+        frequency = detection['frequency']
+        if track.hits > 0:
+            predicted = track.frequency + track.drift_hz_per_sec * dt
+            residual = frequency - predicted
+            track.frequency = predicted + self.alpha * residual
+            if dt > 0:
+                track.drift_hz_per_sec += self.beta * residual / dt
+        else:
+            track.frequency = frequency
+
+        track.hits += 1
+        delta = frequency - track.mean_frequency
+        track.mean_frequency += delta / track.hits
+        track.m2_frequency += delta * (frequency - track.mean_frequency)
+        track.magnitude = detection['magnitude']
+        track.mean_magnitude += (track.magnitude - track.mean_magnitude) / track.hits
+
+        if track.misses > 0 or track.bursts == 0:
+            if track.last_onset is not None:
+                track.mean_period_sec += (now - track.last_onset - track.mean_period_sec) / track.bursts
+            track.bursts += 1
+            track.last_onset = now
+        track.misses = 0
+        track.last_seen = now
+        track.recent_hits.append(now)
+        while len(track.recent_hits) > self.repetition_threshold:
+            track.recent_hits.popleft()
+        detection['track_id'] = track.track_id
+
+    def update(self, detections: List[Dict[str, Any]], now: float) -> List[Track]:
+        """
+        Fold one update's detections in (ascending frequency); each gets a
+        track_id
+        Returns: the tracks hit by this update
+        """
+        dt = now - self.last_update if self.last_update is not None else 0.0
+        self.last_update = now
+
+        predicted = [t.frequency + t.drift_hz_per_sec * dt for t in self.tracks]
+        assigned = [False] * len(self.tracks)
+        hit_tracks = []
+        new_tracks = []
+        j = 0
+        for detection in detections:
+            frequency = detection['frequency']
+            while j < len(self.tracks) and predicted[j] < frequency - self.gate_hz:
+                j += 1
+            # Nearest free track among the (at most two) bracketing ones
+            best = None
+            for k in (j - 1, j, j + 1):
+                if 0 <= k < len(self.tracks) and not assigned[k] and \
+                        abs(predicted[k] - frequency) <= self.gate_hz and \
+                        (best is None or abs(predicted[k] - frequency) < abs(predicted[best] - frequency)):
+                    best = k
+            if best is not None:
+                assigned[best] = True
+                track = self.tracks[best]
+            else:
+                track = Track(self.next_id, now, now, frequency)
+                self.next_id += 1
+                new_tracks.append(track)
+            self._hit(track, detection, now, dt)
+            hit_tracks.append(track)
+
+        # Age out tracks that were not hit; keep the rest in frequency order
+        live = []
+        for track, hit in zip(self.tracks, assigned):
+            if not hit:
+                track.misses += 1
+                if now - track.last_seen > self.timeout_sec:
+                    continue
+            live.append(track)
+        live.extend(new_tracks)
+        live.sort(key=lambda t: t.frequency)
+        self.tracks = live
+        return hit_tracks
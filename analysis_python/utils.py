@@ -7,10 +7,12 @@ import numpy as np
 import time
 import logging
 import json
+from dataclasses import dataclass
 from datetime import datetime
-from typing import List, Tuple, Dict, Any
+from typing import List, Sequence, Tuple, Dict, Any
 from scipy import signal
-from scipy.fft import fft, fftfreq
+from numpy.lib.stride_tricks import as_strided, sliding_window_view
+from scipy.fft import fft, fftfreq, fftshift, rfft, rfftfreq, next_fast_len
 from colorama import init, Fore, Back, Style
 from rich.console import Console
 from rich.text import Text
@@ -22,45 +24,415 @@ init(autoreset=True)
 # Rich console for enhanced CLI output
 console = Console()
 
+@dataclass(frozen=True)
+class BandSpec:
+    """A frequency band analyzed on its own"""
+    name: str
+    min_freq: float
+    max_freq: float
+    zoom_resolution_hz: float = 0.0  # > 0: zoom spectrum with this bin spacing
+
+def stream_frames(carry: np.ndarray, samples: np.ndarray, frame_size: int,
+                  hop_size: int) -> Tuple[np.ndarray, np.ndarray]:
+    """
+    Frames of a stream that arrives in packets: carry holds the samples of
+    earlier packets not yet covered by a full frame
+    Returns: (frames as one strided 2-D view, carry for the next packet)
+    """
+    samples = np.concatenate((carry, samples))
+    if len(samples) < frame_size:
+        return samples[:0].reshape(0, frame_size), samples
+    frames = sliding_window_view(samples, frame_size)[::hop_size]
+    return frames, samples[len(frames) * hop_size:].copy()
+
+class ZoomBand:
+    """
+    High-resolution spectrum of one band by decimate-then-FFT: a complex
+    bandpass FIR centred on the band shifts it to baseband while decimating,
+    and a long complex FFT over the decimated stream gives fine bins across
+    the band only. Same streaming framing and peak hold as the plain STFT;
+    levels are scaled so a tone reads the same as in the plain spectrum.
+    """
+    
+    TAPS_PER_PHASE = 16
+    
+    def __init__(self, band: BandSpec, sample_rate: int, overlap_ratio: float,
+                 reference_window_sum: float):
+        self.band = band
+        width = band.max_freq - band.min_freq
+        center = (band.min_freq + band.max_freq) / 2
+        # Keep the decimated rate 1.5x the band so the filter has room to
+        # roll off before anything aliases into the band
+        self.decimation = max(1, int(sample_rate // (1.5 * width)))
+        self.output_rate = sample_rate / self.decimation
+        self.fft_size = next_fast_len(int(np.ceil(self.output_rate / band.zoom_resolution_hz)))
+        self.hop_size = max(1, int(round(self.fft_size * (1.0 - overlap_ratio))))
+        self.omega = 2 * np.pi * center / sample_rate
+        
+        # Lowpass modulated up to the band, reversed and laid out as
+        # [sample within block, tap block] for the block-wise convolution
+        n_taps = self.TAPS_PER_PHASE * self.decimation
+        lowpass = signal.firwin(n_taps, self.output_rate / 2, fs=sample_rate, window=('kaiser', 8.0))
+        taps = (lowpass * np.exp(1j * self.omega * np.arange(n_taps)))[::-1]
+        taps = taps.reshape(self.TAPS_PER_PHASE, self.decimation).T
+        self.taps_real = np.ascontiguousarray(taps.real, dtype=np.float32)
+        self.taps_imag = np.ascontiguousarray(taps.imag, dtype=np.float32)
+        
+        window = signal.windows.hann(self.fft_size, sym=False)
+        self.window = window.astype(np.float32)
+        self.power_scale = np.float32((reference_window_sum / window.sum()) ** 2)
+        
+        frequencies = center + fftshift(fftfreq(self.fft_size, 1 / self.output_rate))
+        self.bins = slice(int(np.searchsorted(frequencies, band.min_freq, side='left')),
+                          int(np.searchsorted(frequencies, band.max_freq, side='right')))
+        self.frequencies = frequencies[self.bins].astype(np.float32)
+        self.reset_stream()
+    
+    def reset_stream(self):
+        self._input_carry = np.zeros(0, dtype=np.float32)
+        self._baseband_carry = np.zeros(0, dtype=np.complex64)
+        self._phase = 0.0  # heterodyne phase at the first carried input sample
+        self._rotation = np.zeros(0, dtype=np.complex64)
+    
+    def decimate(self, audio_data: np.ndarray) -> np.ndarray:
+        """Complex baseband samples for the next stretch of input"""
+        d, k = self.decimation, self.TAPS_PER_PHASE
+        samples = np.concatenate((self._input_carry, np.asarray(audio_data, dtype=np.float32)))
+        n_out = len(samples) // d - k + 1
+        if n_out <= 0:
+            self._input_carry = samples
+            return np.zeros(0, dtype=np.complex64)
+        
+        # Output i is the filter over blocks i..i+k-1: every block against
+        # every tap block in two matrix products, then the diagonals summed
+        # through a strided view
+        blocks = samples[:(n_out + k - 1) * d].reshape(-1, d)
+        baseband = np.empty(n_out, dtype=np.complex64)
+        for partial, part in ((blocks @ self.taps_real, baseband.real),
+                              (blocks @ self.taps_imag, baseband.imag)):
+            row, col = partial.strides
+            np.sum(as_strided(partial, (n_out, k), (row, row + col)), axis=1, out=part)
+        
+        # Undo the modulation at each output's newest input sample; the
+        # phase steps by the same amount per output, so a table does it
+        if len(self._rotation) < n_out:
+            self._rotation = np.exp(-1j * self.omega * d * np.arange(2 * n_out)).astype(np.complex64)
+        baseband *= np.complex64(np.exp(-1j * (self._phase + self.omega * (k * d - 1))))
+        baseband *= self._rotation[:n_out]
+        
+        consumed = n_out * d
+        self._phase = (self._phase + self.omega * consumed) % (2 * np.pi)
+        self._input_carry = samples[consumed:].copy()
+        return baseband
+    
+    def power_frames(self, audio_data: np.ndarray) -> np.ndarray:
+        """Band power of each frame completed by this packet (frames x bins)"""
+        frames, self._baseband_carry = stream_frames(self._baseband_carry, self.decimate(audio_data),
+                                                     self.fft_size, self.hop_size)
+        spectra = fftshift(fft(frames * self.window, axis=1), axes=1)[:, self.bins]
+        return (spectra.real * spectra.real + spectra.imag * spectra.imag) * self.power_scale
+
+class BandPlan:
+    """
+    Everything the analysis hot path needs that only depends on the
+    configuration: window, rfft size, hop, frequency axis, and for each band
+    the contiguous bin range it covers
+    """
+    
+    def __init__(self, sample_rate: int, window_size: int, overlap_ratio: float,
+                 bands: Tuple[BandSpec, ...]):
+        if not 0.0 <= overlap_ratio < 1.0:
+            raise ValueError(f"overlap_ratio must be in [0, 1), got {overlap_ratio}")
+        self.key = (sample_rate, window_size, overlap_ratio, bands)
+        self.sample_rate = sample_rate
+        self.window_size = window_size
+        self.overlap_ratio = overlap_ratio
+        self.hop_size = max(1, int(round(window_size * (1.0 - overlap_ratio))))
+        self.fft_size = next_fast_len(window_size, real=True)
+        # Periodic Hann so overlapping frames sum to a constant gain
+        self.window = signal.windows.hann(window_size, sym=False).astype(np.float32)
+        self.frequencies = rfftfreq(self.fft_size, 1 / sample_rate).astype(np.float32)
+        
+        self.bands = bands
+        self.slices = {}
+        self.band_frequencies = {}
+        for band in bands:
+            if band.zoom_resolution_hz > 0:
+                continue
+            band_slice = self.bin_range(band.min_freq, band.max_freq)
+            self.slices[band.name] = band_slice
+            self.band_frequencies[band.name] = self.frequencies[band_slice]
+    
+    def bin_range(self, min_freq: float, max_freq: float) -> slice:
+        """Bins with min_freq <= f <= max_freq"""
+        return slice(int(np.searchsorted(self.frequencies, min_freq, side='left')),
+                     int(np.searchsorted(self.frequencies, max_freq, side='right')))
+
 class SignalProcessor:
     """Advanced signal processing utilities for ultrasonic detection"""
     
-    def __init__(self, sample_rate: int = 44100, window_size: int = 4096):
+    def __init__(self, sample_rate: int = 44100, window_size: int = 4096,
+                 overlap_ratio: float = 0.5, bands: Tuple[BandSpec, ...] = None,
+                 window_sizes: Tuple[int, ...] = None):
+        self.plan = None
+        self.plans = {}
+        self._key = None
+        self._zoom = {}
+        self._feature_kernels = {}
+        self.configure(sample_rate, window_size, overlap_ratio, bands, window_sizes)
+    
+    def configure(self, sample_rate: int, window_size: int, overlap_ratio: float,
+                  bands: Tuple[BandSpec, ...] = None, window_sizes: Tuple[int, ...] = None):
+        """
+        Rebuild the band plans, but only if the settings changed. window_size
+        is the primary resolution; window_sizes adds further ones that run
+        over the same stream.
+        """
+        if bands is None:
+            bands = (BandSpec('ultrasonic', 18000, 22000),)
+        sizes = tuple(sorted(set(window_sizes or ()) | {window_size}))
+        key = (sample_rate, window_size, overlap_ratio, tuple(bands), sizes)
+        if self._key == key:
+            return
+        
+        previous = self._key
+        self._key = key
+        self.plans = {size: BandPlan(sample_rate, size, overlap_ratio, tuple(bands)) for size in sizes}
+        self.plan = self.plans[window_size]
         self.sample_rate = sample_rate
         self.window_size = window_size
-        self.window = signal.windows.hann(window_size)
+        self.window_sizes = sizes
+        self.overlap_ratio = overlap_ratio
+        self.hop_size = self.plan.hop_size
+        self.window = self.plan.window
+        self.frequencies = self.plan.frequencies
         
-    def compute_fft(self, audio_data: np.ndarray) -> Tuple[np.ndarray, np.ndarray]:
+        # Levels of every resolution on the primary one's scale, so a tone
+        # reads the same whatever the window length
+        reference = float(self.window.sum())
+        self._power_scale = {size: np.float32((reference / float(plan.window.sum())) ** 2)
+                             for size, plan in self.plans.items()}
+        
+        # Zoom bands carry their own stream state; keep the ones whose
+        # settings did not change
+        same_stream = previous is not None and previous[:3] == key[:3] and previous[4] == sizes
+        previous_zoom = self._zoom if same_stream else {}
+        self._zoom = {}
+        for band in self.plan.bands:
+            if band.zoom_resolution_hz > 0:
+                zoom = previous_zoom.get(band.name)
+                if zoom is None or zoom.band != band:
+                    zoom = ZoomBand(band, sample_rate, overlap_ratio, reference)
+                self._zoom[band.name] = zoom
+        
+        # Buffered samples are only valid for the same rate and framing
+        if not same_stream:
+            self.reset_stream()
+    
+    def reset_stream(self):
+        """Forget the samples kept from earlier packets"""
+        # One input buffer shared by all resolutions; sample i of the
+        # stream is at _buffer[i - _buffer_start]
+        self._buffer = np.zeros(0, dtype=np.float32)
+        self._buffer_start = 0
+        self._buffer_len = 0
+        self._next_frame = {size: 0 for size in self.plans}
+        for zoom in self._zoom.values():
+            zoom.reset_stream()
+    
+    def _append(self, audio_data: np.ndarray):
+        """Add a packet to the shared buffer, dropping what no frame needs"""
+        audio = np.asarray(audio_data, dtype=np.float32)
+        keep_from = min(self._next_frame.values()) - self._buffer_start
+        kept = self._buffer_len - keep_from
+        if self._buffer_len + len(audio) > len(self._buffer):
+            # Out of room: move the kept tail down, into a larger buffer if
+            # even that is not enough
+            if kept + len(audio) > len(self._buffer):
+                grown = np.zeros(2 * (kept + len(audio)), dtype=np.float32)
+                grown[:kept] = self._buffer[keep_from:self._buffer_len]
+                self._buffer = grown
+            else:
+                self._buffer[:kept] = self._buffer[keep_from:self._buffer_len]
+            self._buffer_start += keep_from
+            self._buffer_len = kept
+        self._buffer[self._buffer_len:self._buffer_len + len(audio)] = audio
+        self._buffer_len += len(audio)
+    
+    def _take_frames(self, plan: BandPlan) -> np.ndarray:
+        """Frames of one resolution completed so far, as a strided view"""
+        first = self._next_frame[plan.window_size] - self._buffer_start
+        available = self._buffer_len - first
+        if available < plan.window_size:
+            return self._buffer[:0].reshape(0, plan.window_size)
+        n_frames = (available - plan.window_size) // plan.hop_size + 1
+        end = first + (n_frames - 1) * plan.hop_size + plan.window_size
+        self._next_frame[plan.window_size] += n_frames * plan.hop_size
+        return sliding_window_view(self._buffer[first:end], plan.window_size)[::plan.hop_size]
+    
+    def stft_all(self, audio_data: np.ndarray) -> Dict[int, np.ndarray]:
         """
-        Compute FFT with proper windowing and normalization
-        Returns: (frequencies, magnitudes)
+        Streaming STFT of mono audio at every configured window size
+        The packet is appended once to a buffer all resolutions share; each
+        frames it with its own hop, so long windows run at a lower frame
+        rate, and frames continue across packet boundaries.
+        Returns: {window size: complex spectra, one row per frame (possibly none)}
         """
-        # Apply window function to reduce spectral leakage
-        windowed_data = audio_data * self.window[:len(audio_data)]
-        
-        # Compute FFT
-        fft_result = fft(windowed_data, n=self.window_size)
-        frequencies = fftfreq(self.window_size, 1/self.sample_rate)
+        self._append(audio_data)
+        return self._transform_all()
+    
+    def _transform_all(self) -> Dict[int, np.ndarray]:
+        """Spectra of the frames buffered samples complete, every resolution"""
+        # Each resolution's frames as one strided view, transformed in a
+        # single batch
+        return {size: rfft(self._take_frames(plan) * plan.window, n=plan.fft_size, axis=1)
+                for size, plan in self.plans.items()}
+    
+    def stft(self, audio_data: np.ndarray) -> np.ndarray:
+        """Streaming STFT at the primary window size (see stft_all)"""
+        return self.stft_all(audio_data)[self.window_size]
+    
+    @staticmethod
+    def _to_db(power: np.ndarray) -> np.ndarray:
+        return np.float32(10) * np.log10(power + np.float32(1e-20))  # Add small value to avoid log(0)
+    
+    @staticmethod
+    def _band_power(spectra: np.ndarray, bins: slice, scale: np.float32) -> np.ndarray:
+        """Power of a range of bins only, every frame"""
+        band = spectra[:, bins]
+        return (band.real * band.real + band.imag * band.imag) * scale
+    
+    def _peak_hold_db(self, power: np.ndarray) -> np.ndarray:
+        """Per-bin peak over the frames, in dB"""
+        if len(power) == 0:
+            return self._to_db(np.zeros(power.shape[1], dtype=np.float32))
+        return self._to_db(np.max(power, axis=0))
+    
+    def _peak_hold_db_runs(self, power: np.ndarray, counts: np.ndarray) -> np.ndarray:
+        """Per-bin peak over each run of counts frames, in dB, one row per run"""
+        held = np.zeros((len(counts), power.shape[1]), dtype=np.float32)
+        filled = counts > 0
+        if filled.any():
+            # Empty runs are left out; each remaining run then reaches up
+            # to the start of the next
+            starts = np.cumsum(counts) - counts
+            held[filled] = np.maximum.reduceat(power, starts[filled], axis=0)
+        return self._to_db(held)
+    
+    def compute_resolution_spectra(self, audio_data: np.ndarray) -> Dict[int, Dict[str, Tuple[np.ndarray, np.ndarray]]]:
+        """
+        Band spectra of the packet at every window size, peak-held across
+        each resolution's frames so a short burst anywhere in the packet
+        keeps its full level. Zoom bands are computed once, from the packet
+        itself, and listed with the primary resolution. The power of every
+        frame is left in frame_power, laid out the same way, for detectors
+        that work frame by frame.
+        Returns: {window size: {band name: (frequencies, magnitudes)}}
+        """
+        return self.compute_resolution_spectra_batch([audio_data])[0]
+    
+    def compute_resolution_spectra_batch(self, packets: Sequence[np.ndarray]) -> List[Dict[int, Dict[str, Tuple[np.ndarray, np.ndarray]]]]:
+        """
+        compute_resolution_spectra for consecutive packets at once, as when
+        catching up on a backlog: the frames of all of them are transformed
+        in one batch per resolution, and each packet is given the frames it
+        would have completed on its own, so the spectra are the same as
+        from one call per packet. The frames of the whole block are left in
+        block_power with the number per packet in block_counts, each
+        packet's frames in batch_frame_power and the last packet's in
+        frame_power.
+        Returns: one {window size: {band name: (frequencies, magnitudes)}} per packet
+        """
+        # Bands are the same at every resolution, so when all are zoom bands
+        # there is nothing to transform here
+        counts = {}
+        spectra = None
+        if self.plan.slices:
+            # Frames each packet completes, counted from where the stream
+            # stands before the block
+            ends = self._buffer_start + self._buffer_len + np.cumsum([len(audio) for audio in packets])
+            for size, plan in self.plans.items():
+                completed = np.maximum((ends - size - self._next_frame[size]) // plan.hop_size + 1, 0)
+                counts[size] = np.diff(completed, prepend=0)
+            for audio in packets:
+                self._append(audio)
+            spectra = self._transform_all()
         
-        # Take only positive frequencies and compute magnitude
-        positive_freq_idx = frequencies >= 0
-        frequencies = frequencies[positive_freq_idx]
-        magnitudes = np.abs(fft_result[positive_freq_idx])
+        self.block_power = {}
+        self.block_counts = {}
+        for size, plan in self.plans.items():
+            self.block_power[size] = {} if spectra is None else {
+                name: self._band_power(spectra[size], bins, self._power_scale[size])
+                for name, bins in plan.slices.items()
+            }
+            self.block_counts[size] = {name: counts[size] for name in self.block_power[size]}
+        for name, zoom in self._zoom.items():
+            frames = [zoom.power_frames(audio) for audio in packets]
+            self.block_power[self.window_size][name] = frames[0] if len(frames) == 1 else np.concatenate(frames)
+            self.block_counts[self.window_size][name] = np.array([len(f) for f in frames])
         
-        # Convert to dB scale
-        magnitudes_db = 20 * np.log10(magnitudes + 1e-10)  # Add small value to avoid log(0)
+        self.batch_frame_power = [{size: {} for size in self.block_power} for _ in packets]
+        held = {}
+        for size, bands in self.block_power.items():
+            held[size] = {}
+            for name, power in bands.items():
+                runs = self.block_counts[size][name]
+                for packet, frames in zip(self.batch_frame_power, np.split(power, np.cumsum(runs)[:-1])):
+                    packet[size][name] = frames
+                held[size][name] = self._peak_hold_db_runs(power, runs)
+        self.frame_power = self.batch_frame_power[-1]
         
-        return frequencies, magnitudes_db
+        results = []
+        for i in range(len(packets)):
+            result = {}
+            for size, bands in held.items():
+                frequencies = self.plans[size].band_frequencies
+                result[size] = {
+                    band.name: (self._zoom[band.name].frequencies if band.name in self._zoom
+                                else frequencies[band.name], bands[band.name][i])
+                    for band in self.plan.bands if band.name in bands
+                }
+            results.append(result)
+        return results
+    
+    def frame_rate(self, window_size: int, band: str) -> float:
+        """Frames per second in frame_power[window_size][band]"""
+        if window_size == self.window_size and band in self._zoom:
+            zoom = self._zoom[band]
+            return zoom.output_rate / zoom.hop_size
+        return self.sample_rate / self.plans[window_size].hop_size
+
+    def compute_band_spectra(self, audio_data: np.ndarray) -> Dict[str, Tuple[np.ndarray, np.ndarray]]:
+        """
+        Band spectra of the packet at the primary resolution (see
+        compute_resolution_spectra)
+        Returns: {band name: (frequencies, magnitudes)}, in configured order
+        """
+        return self.compute_resolution_spectra(audio_data)[self.window_size]
+    
+    def compute_fft(self, audio_data: np.ndarray) -> Tuple[np.ndarray, np.ndarray]:
+        """
+        Full-range spectrum of a packet from the streaming STFT, peak-held
+        across its frames
+        Returns: (frequencies, magnitudes)
+        """
+        spectra = self.stft(audio_data)
+        return self.frequencies, self._peak_hold_db(self._band_power(spectra, slice(None), 1))
     
     def extract_ultrasonic_band(self, frequencies: np.ndarray, magnitudes: np.ndarray, 
                                min_freq: int = 18000, max_freq: int = 22000) -> Tuple[np.ndarray, np.ndarray]:
-        """Extract the ultrasonic frequency band"""
-        mask = (frequencies >= min_freq) & (frequencies <= max_freq)
-        return frequencies[mask], magnitudes[mask]
+        """Extract the ultrasonic frequency band (frequencies must be ascending)"""
+        band = slice(int(np.searchsorted(frequencies, min_freq, side='left')),
+                     int(np.searchsorted(frequencies, max_freq, side='right')))
+        return frequencies[band], magnitudes[band]
     
     def detect_peaks(self, magnitudes: np.ndarray, threshold_db: float = -40.0, 
                     min_height: float = 0.1, min_distance: int = 100) -> np.ndarray:
         """Detect significant peaks in the spectrum"""
+        # Nothing to find in a flat spectrum (e.g. no frame completed yet)
+        if len(magnitudes) == 0 or np.max(magnitudes) == np.min(magnitudes):
+            return np.zeros(0, dtype=np.intp)
+        
         # Normalize magnitudes for peak detection
         normalized_mag = (magnitudes - np.min(magnitudes)) / (np.max(magnitudes) - np.min(magnitudes))
         
@@ -76,31 +448,131 @@ class SignalProcessor:
         
         return valid_peaks
     
-    def calculate_spectral_features(self, magnitudes: np.ndarray) -> Dict[str, float]:
-        """Calculate various spectral features for signal characterization"""
-        return {
-            'peak_magnitude': np.max(magnitudes),
-            'mean_magnitude': np.mean(magnitudes),
-            'std_magnitude': np.std(magnitudes),
-            'spectral_centroid': np.sum(magnitudes * np.arange(len(magnitudes))) / np.sum(magnitudes),
-            'spectral_rolloff': self._spectral_rolloff(magnitudes, 0.85),
-            'spectral_flatness': self._spectral_flatness(magnitudes)
-        }
-    
-    def _spectral_rolloff(self, magnitudes: np.ndarray, rolloff_percent: float = 0.85) -> float:
-        """Calculate spectral rolloff frequency"""
-        cumulative_sum = np.cumsum(magnitudes)
-        rolloff_threshold = rolloff_percent * cumulative_sum[-1]
-        rolloff_idx = np.where(cumulative_sum >= rolloff_threshold)[0]
-        return rolloff_idx[0] if len(rolloff_idx) > 0 else len(magnitudes) - 1
-    
-    def _spectral_flatness(self, magnitudes: np.ndarray) -> float:
-        """Calculate spectral flatness (Wiener entropy)"""
-        # Convert back from dB to linear scale for calculation
-        linear_mag = 10 ** (magnitudes / 20)
-        geometric_mean = np.power(np.prod(linear_mag + 1e-10), 1.0 / len(linear_mag))
-        arithmetic_mean = np.mean(linear_mag)
-        return geometric_mean / (arithmetic_mean + 1e-10)
+    def calculate_spectral_features(self, magnitudes: np.ndarray,
+                                    frequencies: np.ndarray = None) -> Dict[str, float]:
+        """
+        Spectral features of one dB spectrum, as plain floats for JSON logs.
+        Frequency features are in Hz when frequencies are given, else in bins.
+        """
+        if frequencies is None:
+            frequencies = np.arange(len(magnitudes), dtype=np.float32)
+        return self.calculate_spectral_features_batch(np.asarray(magnitudes)[np.newaxis, :], frequencies)[0]
+    
+    def calculate_spectral_features_batch(self, magnitudes: np.ndarray,
+                                          frequencies: np.ndarray = None) -> List[Dict[str, float]]:
+        """calculate_spectral_features for each row of spectra x bins, in one pass"""
+        if frequencies is None:
+            frequencies = np.arange(np.shape(magnitudes)[1], dtype=np.float32)
+        power = np.power(np.float32(10), np.asarray(magnitudes, dtype=np.float32) / np.float32(10))
+        records = self._feature_kernel(frequencies).compute(power)
+        return [{name: float(record[name]) for name in FEATURE_DTYPE.names} for record in records]
+    
+    def frame_features(self, window_size: int, band: str) -> np.ndarray:
+        """Features of every frame in frame_power[window_size][band], FEATURE_DTYPE records"""
+        if band in self._zoom and window_size == self.window_size:
+            frequencies = self._zoom[band].frequencies
+        else:
+            frequencies = self.plans[window_size].band_frequencies[band]
+        return self._feature_kernel(frequencies).compute(self.frame_power[window_size][band])
+    
+    def block_frame_features(self, window_size: int, band: str) -> List[np.ndarray]:
+        """
+        frame_features for every packet of the last batch, from one pass
+        over block_power
+        """
+        if band in self._zoom and window_size == self.window_size:
+            frequencies = self._zoom[band].frequencies
+        else:
+            frequencies = self.plans[window_size].band_frequencies[band]
+        features = self._feature_kernel(frequencies).compute(self.block_power[window_size][band])
+        return np.split(features, np.cumsum(self.block_counts[window_size][band])[:-1])
+    
+    def _feature_kernel(self, frequencies: np.ndarray) -> 'SpectralFeatureKernel':
+        """Kernel for a frequency axis, kept while the axis stays the same"""
+        key = (len(frequencies), float(frequencies[0]), float(frequencies[-1])) if len(frequencies) else (0,)
+        kernel = self._feature_kernels.get(key)
+        if kernel is None:
+            kernel = self._feature_kernels[key] = SpectralFeatureKernel(frequencies)
+        return kernel
+
+# Per-frame spectral features; dB levels over the band's bins, frequency
+# features in Hz
+FEATURE_DTYPE = np.dtype([(name, np.float32) for name in (
+    'peak_magnitude', 'mean_magnitude', 'std_magnitude', 'band_energy',
+    'spectral_centroid', 'spectral_bandwidth', 'spectral_rolloff',
+    'spectral_flatness', 'spectral_kurtosis',
+)])
+
+class SpectralFeatureKernel:
+    """
+    All spectral features of frames x bins of linear power in one sweep:
+    one log of the power, one matrix product with the powers of the
+    (normalized) bin frequencies for the spectral moments, one cumulative
+    sum for the rolloff. Flatness is the geometric over the arithmetic
+    mean of the power, taken in the log domain so it cannot underflow.
+    Intermediate arrays are kept between calls.
+    """
+    
+    ROLLOFF = 0.85
+    
+    def __init__(self, frequencies: np.ndarray):
+        self.frequencies = np.asarray(frequencies, dtype=np.float32)
+        self.n_bins = len(self.frequencies)
+        # Moments of a frequency axis centred on the band and scaled to
+        # [-1, 1], so the fourth power stays well inside float32
+        low, high = (float(self.frequencies[0]), float(self.frequencies[-1])) if self.n_bins else (0.0, 0.0)
+        self.center = (low + high) / 2
+        self.scale = max((high - low) / 2, 1e-9)
+        x = (self.frequencies - self.center) / self.scale
+        self.moments = np.stack([np.ones_like(x), x, x * x, x * x * x, x * x * x * x], axis=1)
+        self._capacity = 0
+    
+    def _reserve(self, n_frames: int):
+        if n_frames <= self._capacity:
+            return
+        self._capacity = max(n_frames, 2 * self._capacity)
+        self._log = np.empty((self._capacity, self.n_bins), dtype=np.float32)
+        self._cumulative = np.empty((self._capacity, self.n_bins), dtype=np.float32)
+        self._sums = np.empty((self._capacity, 5), dtype=np.float32)
+    
+    def compute(self, power: np.ndarray) -> np.ndarray:
+        """Features of each frame of power, as FEATURE_DTYPE records"""
+        n_frames = len(power)
+        result = np.zeros(n_frames, dtype=FEATURE_DTYPE)
+        if n_frames == 0 or self.n_bins == 0:
+            return result
+        self._reserve(n_frames)
+        power = np.asarray(power, dtype=np.float32)
+        
+        log_power = self._log[:n_frames]
+        np.add(power, np.float32(1e-20), out=log_power)
+        np.log(log_power, out=log_power)
+        sums = np.matmul(power, self.moments, out=self._sums[:n_frames]).astype(np.float64)
+        sum_log = log_power.sum(axis=1, dtype=np.float64)
+        sum_log_sq = np.einsum('ij,ij->i', log_power, log_power, dtype=np.float64)
+        np.cumsum(power, axis=1, out=self._cumulative[:n_frames])
+        cumulative = self._cumulative[:n_frames]
+        
+        # Level statistics of the dB spectrum
+        db = 10.0 / np.log(10.0)
+        mean_log = sum_log / self.n_bins
+        result['peak_magnitude'] = db * log_power.max(axis=1)
+        result['mean_magnitude'] = db * mean_log
+        result['std_magnitude'] = db * np.sqrt(np.maximum(sum_log_sq / self.n_bins - mean_log * mean_log, 0.0))
+        
+        # Shape of the power distribution over frequency
+        total = np.maximum(sums[:, 0], 1e-30)
+        m1, m2, m3, m4 = (sums[:, k] / total for k in range(1, 5))
+        variance = np.maximum(m2 - m1 * m1, 1e-30)
+        central4 = m4 - 4 * m1 * m3 + 6 * m1 * m1 * m2 - 3 * m1 ** 4
+        result['band_energy'] = db * np.log(total)
+        result['spectral_centroid'] = self.center + self.scale * m1
+        result['spectral_bandwidth'] = self.scale * np.sqrt(variance)
+        result['spectral_kurtosis'] = central4 / (variance * variance)
+        result['spectral_flatness'] = np.exp(mean_log - np.log(total / self.n_bins))
+        rolloff = np.argmax(cumulative >= np.float32(self.ROLLOFF) * cumulative[:, -1:], axis=1)
+        result['spectral_rolloff'] = self.frequencies[rolloff]
+        return result
 
 class DetectionLogger:
     """Handles logging of ultrasonic signal detections"""
@@ -207,6 +679,23 @@ class CLIDisplay:
             f"Detections: {self.detection_count}[/dim]"
         )
         console.print(stats_text)
+        
+        # Per stage: queued items, and mean/max time per item
+        pipeline = stats.get('pipeline')
+        if pipeline:
+            stages = " | ".join(
+                f"{name} q{stage['queue_depth']} {stage['busy_ms_mean']:.1f}/{stage['busy_ms_max']:.1f}ms"
+                for name, stage in pipeline.items()
+            )
+            console.print(f"[dim]Pipeline: {stages}[/dim]")
+        
+        # Only shown while the CPU governor has the analysis below full
+        # quality
+        quality = stats.get('quality')
+        if quality and quality['level'] > 0:
+            console.print(f"[yellow]Quality: level {quality['level']}/{quality['levels'] - 1} "
+                          f"'{quality['name']}' (load {quality['load']:.2f}, "
+                          f"budget {quality['budget']:.2f})[/yellow]")
 
 class DataBuffer:
     """Circular buffer for storing historical data"""
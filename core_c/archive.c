@@ -0,0 +1,908 @@
+/*
+ * SilentTrace - Ultrasonic Signal Detector
+ * Segmented Audio Archive Writer
+ *
+ * Buffer life cycle: the capture thread takes staging buffers strictly in
+ * ring order (FREE -> FILLING -> QUEUED), the dispatcher thread picks them
+ * up in the same order, assigns file offsets and submits the write
+ * (QUEUED -> WRITING), and whichever thread reaps the completion hands the
+ * buffer back (WRITING -> FREE). Buffer states are the only shared data on
+ * the capture path, so it never takes a lock or waits for the disk.
+ *
+ * Coded formats keep the same life cycle: the dispatcher encodes each
+ * buffer into its companion output buffer just before submitting it, and
+ * pads the output to ARCHIVE_ALIGN so O_DIRECT offsets stay aligned.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+#include "archive.h"
+#include "codec.h"
+#include "log.h"
+
+#define ARCHIVE_ALIGN 4096
+#define ARCHIVE_IDLE_WAIT_MS 100
+#define ARCHIVE_REAP_WAIT_MS 10
+
+enum {
+    BUF_FREE,
+    BUF_FILLING,
+    BUF_QUEUED,
+    BUF_WRITING
+};
+
+typedef struct segment segment_t;
+
+typedef struct {
+    uint8_t *data;                  // ARCHIVE_ALIGN-aligned, buffer_bytes long
+    size_t used;                    // payload bytes
+    uint8_t *encoded;               // coded formats: output, encoded_bytes long
+    uint8_t *out;                   // data or encoded
+    size_t out_len;
+    uint64_t frames;                // stored frames in out (coded formats)
+    size_t write_len;               // out_len rounded up to ARCHIVE_ALIGN
+    uint64_t file_offset;
+    int state;                      // BUF_*, accessed atomically
+    int starts_segment;
+    int ends_segment;
+    uint64_t start_timestamp_ms;    // valid when starts_segment is set
+    segment_t *segment;
+} staging_buffer_t;
+
+struct segment {
+    int fd;
+    char path[PATH_MAX];
+    uint64_t start_timestamp_ms;
+    uint64_t data_bytes;            // payload submitted so far
+    uint64_t frames;                // stored frames (coded formats)
+    int outstanding;                // writes in flight, accessed atomically
+    segment_t *next;                // closing list
+};
+
+typedef struct {
+    char *path;
+    uint64_t bytes;
+    int busy;                       // segment still being written
+} segment_file_t;
+
+struct archive {
+    archive_config_t cfg;
+    char directory[PATH_MAX / 2];
+    size_t frame_bytes;
+    uint64_t segment_bytes;         // PCM per full-length segment
+    size_t fill_bytes;              // PCM per staging buffer
+    uint64_t reserve_bytes;         // preallocation per segment file
+
+    // Coded formats (dispatcher thread only)
+    codec_encoder_t *encoder;
+    band_filter_t *band;
+    int16_t *band_frames;           // decimated copy of one staging buffer
+    unsigned int decimation;
+    size_t encoded_bytes;           // size of each output buffer
+
+    staging_buffer_t *buffers;
+    unsigned int n_buffers;
+
+    // Capture thread only
+    uint64_t fill_seq;
+    staging_buffer_t *current;
+    uint64_t segment_pos;
+    int segment_broken;             // frames were dropped; start a new segment
+
+    // Dispatcher thread only
+    uint64_t submit_seq;
+    segment_t *open_segment;
+    segment_t *closing;
+    segment_file_t *files;          // oldest first
+    size_t n_files;
+    size_t cap_files;
+    uint64_t disk_bytes;
+    uint8_t *header_block;
+
+    pthread_t dispatcher;
+    int dispatcher_started;
+    int sync_ready;
+    sem_t wakeup;
+    int stopping;
+
+    // pwrite() thread pool
+    pthread_t *workers;
+    unsigned int n_workers;
+    pthread_mutex_t job_lock;
+    pthread_cond_t job_cond;
+    staging_buffer_t **jobs;
+    size_t job_head;
+    size_t job_count;
+    int pool_stop;
+
+#ifdef HAVE_LIBURING
+    struct io_uring ring;
+    int use_uring;
+    unsigned int uring_inflight;
+#endif
+
+    uint64_t stat_bytes_captured;
+    uint64_t stat_bytes_written;
+    uint64_t stat_segments_written;
+    uint64_t stat_segments_deleted;
+    uint64_t stat_frames_dropped;
+    uint64_t stat_write_errors;
+    unsigned int stat_in_flight;
+};
+
+static uint64_t round_up(uint64_t value, uint64_t align) {
+    return (value + align - 1) / align * align;
+}
+
+static const char *format_name(int format) {
+    switch (format) {
+    case ARCHIVE_FORMAT_S16LE: return "pcm";
+    case ARCHIVE_FORMAT_LOSSLESS: return "lossless";
+    case ARCHIVE_FORMAT_BAND: return "band";
+    default: return NULL;
+    }
+}
+
+static uint64_t realtime_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void archive_default_config(archive_config_t *cfg, const char *directory,
+                            unsigned int sample_rate, unsigned int channels) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->directory = directory;
+    cfg->sample_rate = sample_rate;
+    cfg->channels = channels;
+    cfg->segment_sec = 60;
+    cfg->quota_bytes = 1024ULL * 1024 * 1024;
+    cfg->buffer_bytes = 1024 * 1024;
+    cfg->buffer_count = 16;
+    cfg->io_threads = 2;
+    cfg->direct_io = 1;
+    cfg->format = ARCHIVE_FORMAT_S16LE;
+    cfg->band_low_hz = 18000.0;
+    cfg->band_high_hz = 22000.0;
+    cfg->band_transition_hz = 1000.0;
+}
+
+/* ---------- Disk budget ---------- */
+
+static int is_segment_name(const char *name) {
+    size_t len = strlen(name);
+    size_t ext = strlen(ARCHIVE_SEGMENT_EXT);
+    return len > ext && strcmp(name + len - ext, ARCHIVE_SEGMENT_EXT) == 0;
+}
+
+static int compare_files(const void *a, const void *b) {
+    return strcmp(((const segment_file_t *)a)->path, ((const segment_file_t *)b)->path);
+}
+
+static int add_file(archive_t *ar, const char *path, uint64_t bytes, int busy) {
+    if (ar->n_files == ar->cap_files) {
+        size_t cap = ar->cap_files ? ar->cap_files * 2 : 64;
+        segment_file_t *files = realloc(ar->files, cap * sizeof(*files));
+        if (!files) {
+            return -1;
+        }
+        ar->files = files;
+        ar->cap_files = cap;
+    }
+    ar->files[ar->n_files].path = strdup(path);
+    ar->files[ar->n_files].bytes = bytes;
+    ar->files[ar->n_files].busy = busy;
+    ar->n_files++;
+    ar->disk_bytes += bytes;
+    return 0;
+}
+
+// Existing segments count against the budget so restarts keep the quota
+static void scan_existing_segments(archive_t *ar) {
+    DIR *dir = opendir(ar->directory);
+    struct dirent *entry;
+    char path[PATH_MAX];
+    struct stat st;
+
+    if (!dir) {
+        return;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        if (!is_segment_name(entry->d_name)) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", ar->directory, entry->d_name);
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+            add_file(ar, path, (uint64_t)st.st_blocks * 512, 0);
+        }
+    }
+    closedir(dir);
+
+    qsort(ar->files, ar->n_files, sizeof(*ar->files), compare_files);
+}
+
+// Delete the oldest finished segments until 'incoming' more bytes fit
+static void enforce_quota(archive_t *ar, uint64_t incoming) {
+    while (ar->n_files > 0 && ar->disk_bytes + incoming > ar->cfg.quota_bytes && !ar->files[0].busy) {
+        if (unlink(ar->files[0].path) < 0 && errno != ENOENT) {
+            log_warning("Cannot delete archive segment %s: %s",
+                    ar->files[0].path, strerror(errno));
+        }
+        ar->disk_bytes -= ar->files[0].bytes;
+        free(ar->files[0].path);
+        memmove(&ar->files[0], &ar->files[1], (ar->n_files - 1) * sizeof(*ar->files));
+        ar->n_files--;
+        __atomic_fetch_add(&ar->stat_segments_deleted, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void update_file(archive_t *ar, const char *path, uint64_t bytes) {
+    for (size_t i = ar->n_files; i-- > 0;) {
+        if (strcmp(ar->files[i].path, path) == 0) {
+            ar->disk_bytes = ar->disk_bytes - ar->files[i].bytes + bytes;
+            ar->files[i].bytes = bytes;
+            ar->files[i].busy = 0;
+            return;
+        }
+    }
+}
+
+/* ---------- Segment files (dispatcher thread) ---------- */
+
+static segment_t *start_segment(archive_t *ar, uint64_t timestamp_ms) {
+    uint64_t reserve = ARCHIVE_HEADER_BYTES + ar->reserve_bytes;
+    segment_t *seg = calloc(1, sizeof(*seg));
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+
+    if (!seg) {
+        return NULL;
+    }
+
+    enforce_quota(ar, reserve);
+
+    seg->start_timestamp_ms = timestamp_ms;
+    snprintf(seg->path, sizeof(seg->path), "%s/st_%013llu" ARCHIVE_SEGMENT_EXT,
+             ar->directory, (unsigned long long)timestamp_ms);
+
+    seg->fd = open(seg->path, flags | (ar->cfg.direct_io ? O_DIRECT : 0), 0644);
+    if (seg->fd < 0 && ar->cfg.direct_io && errno == EINVAL) {
+        log_warning("O_DIRECT not supported in %s, using buffered I/O", ar->directory);
+        ar->cfg.direct_io = 0;
+        seg->fd = open(seg->path, flags, 0644);
+    }
+    if (seg->fd < 0) {
+        log_error("Cannot create archive segment %s: %s", seg->path, strerror(errno));
+        free(seg);
+        return NULL;
+    }
+
+    // Preallocate so the filesystem lays the segment out contiguously and
+    // appends never have to allocate; not every filesystem supports it
+    if (fallocate(seg->fd, 0, 0, (off_t)reserve) < 0 && errno != EOPNOTSUPP) {
+        log_warning("Cannot preallocate %s: %s", seg->path, strerror(errno));
+    }
+
+    add_file(ar, seg->path, reserve, 1);
+    return seg;
+}
+
+static void end_segment(archive_t *ar, segment_t *seg) {
+    seg->next = ar->closing;
+    ar->closing = seg;
+    if (ar->open_segment == seg) {
+        ar->open_segment = NULL;
+    }
+}
+
+// Write the header and trim the preallocation once every data write landed
+static void finalize_segment(archive_t *ar, segment_t *seg) {
+    archive_segment_header_t *hdr = (archive_segment_header_t *)ar->header_block;
+    uint64_t frames = seg->data_bytes / ar->frame_bytes;
+    uint64_t data_bytes = frames * ar->frame_bytes;
+    uint64_t file_bytes;
+
+    if (ar->encoder) {
+        frames = seg->frames;
+        data_bytes = seg->data_bytes;
+    }
+    file_bytes = ARCHIVE_HEADER_BYTES + data_bytes;
+
+    memset(ar->header_block, 0, ARCHIVE_HEADER_BYTES);
+    memcpy(hdr->magic, ARCHIVE_MAGIC, sizeof(hdr->magic));
+    hdr->version = ARCHIVE_VERSION;
+    hdr->header_bytes = ARCHIVE_HEADER_BYTES;
+    hdr->sample_rate = ar->cfg.sample_rate;
+    hdr->channels = ar->cfg.channels;
+    hdr->format = (uint32_t)ar->cfg.format;
+    hdr->start_timestamp_ms = seg->start_timestamp_ms;
+    hdr->frame_count = frames;
+    hdr->data_bytes = data_bytes;
+    hdr->stored_rate = ar->cfg.sample_rate / ar->decimation;
+    hdr->decimation = ar->decimation;
+    if (ar->band) {
+        hdr->band_low_hz = (uint32_t)ar->cfg.band_low_hz;
+        hdr->band_high_hz = (uint32_t)ar->cfg.band_high_hz;
+        hdr->band_transition_hz = (uint32_t)ar->cfg.band_transition_hz;
+        hdr->filter_taps = (uint32_t)band_filter_taps(ar->band);
+    }
+
+    if (pwrite(seg->fd, ar->header_block, ARCHIVE_HEADER_BYTES, 0) != ARCHIVE_HEADER_BYTES) {
+        log_error("Cannot write archive header %s: %s", seg->path, strerror(errno));
+        __atomic_fetch_add(&ar->stat_write_errors, 1, __ATOMIC_RELAXED);
+    }
+    if (ftruncate(seg->fd, (off_t)file_bytes) < 0) {
+        log_warning("Cannot trim archive segment %s: %s", seg->path, strerror(errno));
+        file_bytes = ARCHIVE_HEADER_BYTES + ar->reserve_bytes;
+    }
+    close(seg->fd);
+
+    update_file(ar, seg->path, round_up(file_bytes, ARCHIVE_ALIGN));
+    __atomic_fetch_add(&ar->stat_segments_written, 1, __ATOMIC_RELAXED);
+    free(seg);
+}
+
+static int finalize_closed_segments(archive_t *ar) {
+    segment_t **link = &ar->closing;
+    int finalized = 0;
+
+    while (*link) {
+        segment_t *seg = *link;
+        if (__atomic_load_n(&seg->outstanding, __ATOMIC_ACQUIRE) == 0) {
+            *link = seg->next;
+            finalize_segment(ar, seg);
+            finalized = 1;
+        } else {
+            link = &seg->next;
+        }
+    }
+    return finalized;
+}
+
+/* ---------- Write completion ---------- */
+
+static void complete_buffer(archive_t *ar, staging_buffer_t *buf, int ok) {
+    if (ok) {
+        __atomic_fetch_add(&ar->stat_bytes_written, buf->out_len, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_add(&ar->stat_write_errors, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_fetch_sub(&buf->segment->outstanding, 1, __ATOMIC_RELEASE);
+    __atomic_fetch_sub(&ar->stat_in_flight, 1, __ATOMIC_RELAXED);
+    buf->segment = NULL;
+    __atomic_store_n(&buf->state, BUF_FREE, __ATOMIC_RELEASE);
+}
+
+static int write_fully(int fd, const uint8_t *data, size_t len, uint64_t offset) {
+    while (len > 0) {
+        ssize_t n = pwrite(fd, data, len, (off_t)offset);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += n;
+        len -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return 0;
+}
+
+static void *io_worker(void *arg) {
+    archive_t *ar = arg;
+
+    for (;;) {
+        staging_buffer_t *buf;
+
+        pthread_mutex_lock(&ar->job_lock);
+        while (ar->job_count == 0 && !ar->pool_stop) {
+            pthread_cond_wait(&ar->job_cond, &ar->job_lock);
+        }
+        if (ar->job_count == 0) {
+            pthread_mutex_unlock(&ar->job_lock);
+            break;
+        }
+        buf = ar->jobs[ar->job_head];
+        ar->job_head = (ar->job_head + 1) % ar->n_buffers;
+        ar->job_count--;
+        pthread_mutex_unlock(&ar->job_lock);
+
+        int ok = write_fully(buf->segment->fd, buf->out, buf->write_len, buf->file_offset) == 0;
+        if (!ok) {
+            log_error("Archive write failed: %s", strerror(errno));
+        }
+        complete_buffer(ar, buf, ok);
+        sem_post(&ar->wakeup);
+    }
+    return NULL;
+}
+
+static void submit_write(archive_t *ar, staging_buffer_t *buf) {
+    __atomic_fetch_add(&ar->stat_in_flight, 1, __ATOMIC_RELAXED);
+
+#ifdef HAVE_LIBURING
+    if (ar->use_uring) {
+        struct io_uring_sqe *sqe = io_uring_get_sqe(&ar->ring);
+        if (sqe) {
+            io_uring_prep_write(sqe, buf->segment->fd, buf->out, (unsigned int)buf->write_len,
+                                buf->file_offset);
+            io_uring_sqe_set_data(sqe, buf);
+            io_uring_submit(&ar->ring);
+            ar->uring_inflight++;
+            return;
+        }
+        // Ring full (cannot happen with depth == buffer count); write inline
+        complete_buffer(ar, buf, write_fully(buf->segment->fd, buf->out, buf->write_len,
+                                             buf->file_offset) == 0);
+        return;
+    }
+#endif
+
+    pthread_mutex_lock(&ar->job_lock);
+    ar->jobs[(ar->job_head + ar->job_count) % ar->n_buffers] = buf;
+    ar->job_count++;
+    pthread_cond_signal(&ar->job_cond);
+    pthread_mutex_unlock(&ar->job_lock);
+}
+
+#ifdef HAVE_LIBURING
+static int reap_uring(archive_t *ar, int wait) {
+    struct io_uring_cqe *cqe;
+    int reaped = 0;
+
+    if (wait && ar->uring_inflight > 0) {
+        struct __kernel_timespec ts = {0, ARCHIVE_REAP_WAIT_MS * 1000000L};
+        io_uring_wait_cqe_timeout(&ar->ring, &cqe, &ts);
+    }
+
+    while (io_uring_peek_cqe(&ar->ring, &cqe) == 0) {
+        staging_buffer_t *buf = io_uring_cqe_get_data(cqe);
+        int res = cqe->res;
+        int ok = 1;
+
+        io_uring_cqe_seen(&ar->ring, cqe);
+        ar->uring_inflight--;
+
+        if (res < 0) {
+            log_error("Archive write failed: %s", strerror(-res));
+            ok = 0;
+        } else if ((size_t)res < buf->write_len) {
+            // Short write: finish the remainder synchronously
+            ok = write_fully(buf->segment->fd, buf->out + res, buf->write_len - (size_t)res,
+                             buf->file_offset + (uint64_t)res) == 0;
+        }
+        complete_buffer(ar, buf, ok);
+        reaped = 1;
+    }
+    return reaped;
+}
+#endif
+
+/* ---------- Dispatcher thread ---------- */
+
+static void encode_buffer(archive_t *ar, staging_buffer_t *buf) {
+    const int16_t *frames = (const int16_t *)buf->data;
+    size_t n_frames = buf->used / ar->frame_bytes;
+    size_t pos = 0;
+
+    if (ar->band) {
+        n_frames = band_decimate(ar->band, frames, n_frames, ar->band_frames);
+        frames = ar->band_frames;
+    }
+    for (size_t f = 0; f < n_frames; f += CODEC_BLOCK_FRAMES) {
+        size_t count = n_frames - f < CODEC_BLOCK_FRAMES ? n_frames - f : CODEC_BLOCK_FRAMES;
+        pos += codec_encode_block(ar->encoder, frames + f * ar->cfg.channels, count, buf->encoded + pos);
+    }
+
+    buf->out = buf->encoded;
+    buf->out_len = pos;
+    buf->frames = n_frames;
+}
+
+static void dispatch_buffer(archive_t *ar, staging_buffer_t *buf) {
+    segment_t *seg;
+
+    if (buf->starts_segment || !ar->open_segment) {
+        if (ar->open_segment) {
+            end_segment(ar, ar->open_segment);
+        }
+        ar->open_segment = start_segment(ar, buf->starts_segment ? buf->start_timestamp_ms : realtime_ms());
+        // Segments must decode on their own: no filter state carries over
+        if (ar->band) {
+            band_filter_reset(ar->band);
+        }
+    }
+
+    seg = ar->open_segment;
+    if (!seg) {
+        // Segment could not be created; discard the audio but keep running
+        __atomic_fetch_add(&ar->stat_write_errors, 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&buf->state, BUF_FREE, __ATOMIC_RELEASE);
+        return;
+    }
+
+    if (ar->encoder) {
+        encode_buffer(ar, buf);
+    } else {
+        buf->out = buf->data;
+        buf->out_len = buf->used;
+    }
+
+    buf->segment = seg;
+    buf->file_offset = ARCHIVE_HEADER_BYTES + seg->data_bytes;
+    buf->write_len = round_up(buf->out_len, ARCHIVE_ALIGN);
+    if (buf->write_len > buf->out_len) {
+        memset(buf->out + buf->out_len, 0, buf->write_len - buf->out_len);
+    }
+    // Coded segments keep the filler; raw PCM is only padded at its end
+    seg->data_bytes += ar->encoder ? buf->write_len : buf->out_len;
+    seg->frames += buf->frames;
+    __atomic_fetch_add(&seg->outstanding, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&buf->state, BUF_WRITING, __ATOMIC_RELAXED);
+
+    if (buf->ends_segment) {
+        end_segment(ar, seg);
+    }
+
+    submit_write(ar, buf);
+}
+
+static int writes_in_flight(archive_t *ar) {
+    return __atomic_load_n(&ar->stat_in_flight, __ATOMIC_ACQUIRE) > 0;
+}
+
+static void *dispatcher_thread(void *arg) {
+    archive_t *ar = arg;
+
+    for (;;) {
+        // Sampled before draining: archive_close() queues its last buffer
+        // before raising the flag, so this pass is guaranteed to see it
+        int stopping = __atomic_load_n(&ar->stopping, __ATOMIC_ACQUIRE);
+        int progress = 0;
+
+        for (;;) {
+            staging_buffer_t *buf = &ar->buffers[ar->submit_seq % ar->n_buffers];
+            if (__atomic_load_n(&buf->state, __ATOMIC_ACQUIRE) != BUF_QUEUED) {
+                break;
+            }
+            dispatch_buffer(ar, buf);
+            ar->submit_seq++;
+            progress = 1;
+        }
+
+#ifdef HAVE_LIBURING
+        if (ar->use_uring) {
+            progress |= reap_uring(ar, 0);
+        }
+#endif
+
+        if (stopping && !progress && ar->open_segment) {
+            end_segment(ar, ar->open_segment);
+        }
+
+        progress |= finalize_closed_segments(ar);
+
+        if (stopping && !progress && !ar->open_segment && !ar->closing && !writes_in_flight(ar)) {
+            break;
+        }
+
+        if (!progress) {
+#ifdef HAVE_LIBURING
+            if (ar->use_uring && ar->uring_inflight > 0) {
+                reap_uring(ar, 1);
+                continue;
+            }
+#endif
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += ARCHIVE_IDLE_WAIT_MS * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_nsec -= 1000000000L;
+                deadline.tv_sec++;
+            }
+            sem_timedwait(&ar->wakeup, &deadline);
+        }
+    }
+
+    return NULL;
+}
+
+/* ---------- Capture thread ---------- */
+
+static void queue_current(archive_t *ar) {
+    staging_buffer_t *buf = ar->current;
+
+    ar->current = NULL;
+    ar->fill_seq++;
+    __atomic_store_n(&buf->state, BUF_QUEUED, __ATOMIC_RELEASE);
+    sem_post(&ar->wakeup);
+}
+
+void archive_write(archive_t *ar, const int16_t *frames, size_t n_frames) {
+    const uint8_t *src = (const uint8_t *)frames;
+    size_t remaining = n_frames * ar->frame_bytes;
+    uint64_t now_ms = 0;
+
+    __atomic_fetch_add(&ar->stat_bytes_captured, remaining, __ATOMIC_RELAXED);
+
+    while (remaining > 0) {
+        staging_buffer_t *buf = ar->current;
+
+        if (!buf) {
+            buf = &ar->buffers[ar->fill_seq % ar->n_buffers];
+            if (__atomic_load_n(&buf->state, __ATOMIC_ACQUIRE) != BUF_FREE) {
+                // I/O is behind: drop the rest of this period and restart the
+                // segment afterwards so every file stays gap-free
+                __atomic_fetch_add(&ar->stat_frames_dropped,
+                                   (remaining + ar->frame_bytes - 1) / ar->frame_bytes, __ATOMIC_RELAXED);
+                ar->segment_broken = 1;
+                return;
+            }
+            __atomic_store_n(&buf->state, BUF_FILLING, __ATOMIC_RELAXED);
+            buf->used = 0;
+            buf->starts_segment = 0;
+            buf->ends_segment = 0;
+            ar->current = buf;
+
+            if (ar->segment_broken || ar->segment_pos == 0) {
+                // Timestamp of the first frame still to be copied
+                if (!now_ms) {
+                    now_ms = realtime_ms();
+                }
+                uint64_t pending_frames = remaining / ar->frame_bytes;
+                buf->starts_segment = 1;
+                buf->start_timestamp_ms = now_ms - pending_frames * 1000 / ar->cfg.sample_rate;
+                ar->segment_pos = 0;
+                ar->segment_broken = 0;
+            }
+        }
+
+        size_t chunk = ar->fill_bytes - buf->used;
+        if (chunk > remaining) {
+            chunk = remaining;
+        }
+        if (chunk > ar->segment_bytes - ar->segment_pos) {
+            chunk = (size_t)(ar->segment_bytes - ar->segment_pos);
+        }
+
+        memcpy(buf->data + buf->used, src, chunk);
+        buf->used += chunk;
+        src += chunk;
+        remaining -= chunk;
+        ar->segment_pos += chunk;
+
+        if (ar->segment_pos == ar->segment_bytes) {
+            buf->ends_segment = 1;
+            ar->segment_pos = 0;
+            queue_current(ar);
+        } else if (buf->used == ar->fill_bytes) {
+            queue_current(ar);
+        }
+    }
+}
+
+/* ---------- Setup and teardown ---------- */
+
+archive_t *archive_open(const archive_config_t *cfg) {
+    archive_t *ar;
+
+    if (!cfg->directory || cfg->sample_rate == 0 || cfg->channels == 0 || cfg->segment_sec == 0 ||
+        cfg->buffer_count < 2 || cfg->buffer_bytes < ARCHIVE_ALIGN || !format_name(cfg->format)) {
+        log_error("Invalid archive configuration");
+        return NULL;
+    }
+
+    if (mkdir(cfg->directory, 0755) < 0 && errno != EEXIST) {
+        log_error("Cannot create archive directory %s: %s", cfg->directory, strerror(errno));
+        return NULL;
+    }
+
+    ar = calloc(1, sizeof(*ar));
+    if (!ar) {
+        return NULL;
+    }
+    ar->cfg = *cfg;
+    ar->cfg.buffer_bytes = (size_t)round_up(cfg->buffer_bytes, ARCHIVE_ALIGN);
+    snprintf(ar->directory, sizeof(ar->directory), "%s", cfg->directory);
+    ar->cfg.directory = ar->directory;
+    ar->frame_bytes = (size_t)cfg->channels * sizeof(int16_t);
+    ar->segment_bytes = (uint64_t)cfg->segment_sec * cfg->sample_rate * ar->frame_bytes;
+    ar->n_buffers = cfg->buffer_count;
+    ar->fill_bytes = ar->cfg.buffer_bytes;
+    ar->reserve_bytes = round_up(ar->segment_bytes, ARCHIVE_ALIGN);
+    ar->decimation = 1;
+
+    if (cfg->format == ARCHIVE_FORMAT_BAND) {
+        ar->decimation = band_plan_decimation(cfg->sample_rate, cfg->band_low_hz, cfg->band_high_hz,
+                                              cfg->band_transition_hz);
+        if (ar->decimation == 0) {
+            log_error("Archive band %.0f-%.0f Hz does not fit a %u Hz stream",
+                    cfg->band_low_hz, cfg->band_high_hz, cfg->sample_rate);
+            free(ar);
+            return NULL;
+        }
+    }
+
+    if (cfg->format != ARCHIVE_FORMAT_S16LE) {
+        // Whole frames per buffer so each buffer encodes independently
+        ar->fill_bytes -= ar->fill_bytes % ar->frame_bytes;
+        size_t stored = ar->fill_bytes / ar->frame_bytes / ar->decimation + 1;
+        size_t blocks = (stored + CODEC_BLOCK_FRAMES - 1) / CODEC_BLOCK_FRAMES;
+        ar->encoded_bytes = (size_t)round_up(blocks * codec_max_block_bytes(cfg->channels, CODEC_BLOCK_FRAMES),
+                                             ARCHIVE_ALIGN);
+        // Worst case every buffer of the segment is stored verbatim
+        ar->reserve_bytes = ((ar->segment_bytes + ar->fill_bytes - 1) / ar->fill_bytes + 1) * ar->encoded_bytes;
+
+        ar->encoder = codec_encoder_create(cfg->channels, CODEC_BLOCK_FRAMES);
+        if (cfg->format == ARCHIVE_FORMAT_BAND) {
+            ar->band = band_filter_create(cfg->sample_rate, cfg->channels, cfg->band_low_hz, cfg->band_high_hz,
+                                          cfg->band_transition_hz, ar->decimation);
+            ar->band_frames = malloc(stored * ar->frame_bytes);
+        }
+        if (!ar->encoder || (cfg->format == ARCHIVE_FORMAT_BAND && (!ar->band || !ar->band_frames))) {
+            log_error("Cannot set up archive encoder");
+            archive_close(ar);
+            return NULL;
+        }
+    }
+
+    ar->buffers = calloc(ar->n_buffers, sizeof(*ar->buffers));
+    ar->jobs = calloc(ar->n_buffers, sizeof(*ar->jobs));
+    if (!ar->buffers || !ar->jobs ||
+        posix_memalign((void **)&ar->header_block, ARCHIVE_ALIGN, ARCHIVE_HEADER_BYTES) != 0) {
+        archive_close(ar);
+        return NULL;
+    }
+    for (unsigned int i = 0; i < ar->n_buffers; i++) {
+        if (posix_memalign((void **)&ar->buffers[i].data, ARCHIVE_ALIGN, ar->cfg.buffer_bytes) != 0) {
+            log_error("Cannot allocate archive buffers");
+            archive_close(ar);
+            return NULL;
+        }
+        // Touch every page now so the capture thread never page-faults
+        memset(ar->buffers[i].data, 0, ar->cfg.buffer_bytes);
+
+        if (ar->encoded_bytes &&
+            posix_memalign((void **)&ar->buffers[i].encoded, ARCHIVE_ALIGN, ar->encoded_bytes) != 0) {
+            log_error("Cannot allocate archive buffers");
+            archive_close(ar);
+            return NULL;
+        }
+    }
+
+    scan_existing_segments(ar);
+    sem_init(&ar->wakeup, 0, 0);
+    pthread_mutex_init(&ar->job_lock, NULL);
+    pthread_cond_init(&ar->job_cond, NULL);
+    ar->sync_ready = 1;
+
+#ifdef HAVE_LIBURING
+    if (io_uring_queue_init(ar->n_buffers, &ar->ring, 0) == 0) {
+        ar->use_uring = 1;
+    } else {
+        log_warning("io_uring unavailable, using %u I/O threads", cfg->io_threads);
+    }
+    if (!ar->use_uring)
+#endif
+    {
+        ar->n_workers = cfg->io_threads ? cfg->io_threads : 1;
+        ar->workers = calloc(ar->n_workers, sizeof(pthread_t));
+        for (unsigned int i = 0; ar->workers && i < ar->n_workers; i++) {
+            pthread_create(&ar->workers[i], NULL, io_worker, ar);
+        }
+    }
+
+    if (pthread_create(&ar->dispatcher, NULL, dispatcher_thread, ar) != 0) {
+        log_error("Cannot start archive thread");
+        archive_close(ar);
+        return NULL;
+    }
+    ar->dispatcher_started = 1;
+
+    log_info("Archiving to %s: %s, %us segments, %.1fMB budget, %s%s",
+            ar->directory, format_name(cfg->format), cfg->segment_sec, cfg->quota_bytes / 1048576.0,
+#ifdef HAVE_LIBURING
+            ar->use_uring ? "io_uring" : "thread pool",
+#else
+            "thread pool",
+#endif
+            cfg->direct_io ? ", O_DIRECT" : "");
+    if (ar->band) {
+        log_info("Archive band %.0f-%.0f Hz stored at %u Hz (%u taps)",
+                cfg->band_low_hz, cfg->band_high_hz, cfg->sample_rate / ar->decimation,
+                (unsigned int)band_filter_taps(ar->band));
+    }
+
+    return ar;
+}
+
+void archive_get_stats(archive_t *ar, archive_stats_t *stats) {
+    stats->bytes_captured = __atomic_load_n(&ar->stat_bytes_captured, __ATOMIC_RELAXED);
+    stats->bytes_written = __atomic_load_n(&ar->stat_bytes_written, __ATOMIC_RELAXED);
+    stats->segments_written = __atomic_load_n(&ar->stat_segments_written, __ATOMIC_RELAXED);
+    stats->segments_deleted = __atomic_load_n(&ar->stat_segments_deleted, __ATOMIC_RELAXED);
+    stats->frames_dropped = __atomic_load_n(&ar->stat_frames_dropped, __ATOMIC_RELAXED);
+    stats->write_errors = __atomic_load_n(&ar->stat_write_errors, __ATOMIC_RELAXED);
+    stats->buffers_in_flight = __atomic_load_n(&ar->stat_in_flight, __ATOMIC_RELAXED);
+}
+
+void archive_close(archive_t *ar) {
+    if (!ar) {
+        return;
+    }
+
+    if (ar->dispatcher_started) {
+        if (ar->current) {
+            ar->current->ends_segment = 1;
+            ar->segment_pos = 0;
+            queue_current(ar);
+        }
+        __atomic_store_n(&ar->stopping, 1, __ATOMIC_RELEASE);
+        sem_post(&ar->wakeup);
+        pthread_join(ar->dispatcher, NULL);
+    }
+
+    if (ar->workers) {
+        pthread_mutex_lock(&ar->job_lock);
+        ar->pool_stop = 1;
+        pthread_cond_broadcast(&ar->job_cond);
+        pthread_mutex_unlock(&ar->job_lock);
+        for (unsigned int i = 0; i < ar->n_workers; i++) {
+            pthread_join(ar->workers[i], NULL);
+        }
+        free(ar->workers);
+    }
+#ifdef HAVE_LIBURING
+    if (ar->use_uring) {
+        io_uring_queue_exit(&ar->ring);
+    }
+#endif
+
+    if (ar->dispatcher_started) {
+        archive_stats_t stats;
+        archive_get_stats(ar, &stats);
+        log_info("Archive closed: %llu segments, %.1fMB written (%.1fx), %llu frames dropped",
+                (unsigned long long)stats.segments_written, stats.bytes_written / 1048576.0,
+                stats.bytes_written ? (double)stats.bytes_captured / stats.bytes_written : 0.0,
+                (unsigned long long)stats.frames_dropped);
+    }
+    if (ar->sync_ready) {
+        sem_destroy(&ar->wakeup);
+        pthread_mutex_destroy(&ar->job_lock);
+        pthread_cond_destroy(&ar->job_cond);
+    }
+
+    for (size_t i = 0; i < ar->n_files; i++) {
+        free(ar->files[i].path);
+    }
+    free(ar->files);
+    if (ar->buffers) {
+        for (unsigned int i = 0; i < ar->n_buffers; i++) {
+            free(ar->buffers[i].data);
+            free(ar->buffers[i].encoded);
+        }
+    }
+    free(ar->buffers);
+    free(ar->jobs);
+    free(ar->header_block);
+    codec_encoder_destroy(ar->encoder);
+    band_filter_destroy(ar->band);
+    free(ar->band_frames);
+    free(ar);
+}
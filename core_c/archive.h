@@ -0,0 +1,97 @@
+/*
+ * SilentTrace - Ultrasonic Signal Detector
+ * Segmented Audio Archive Writer
+ *
+ * Persists the capture stream to time-segmented files under a bounded disk
+ * budget. The capture thread only copies into preallocated aligned buffers;
+ * file I/O runs on a dispatcher thread using io_uring when available (built
+ * with HAVE_LIBURING) and a pwrite() thread pool otherwise.
+ *
+ * Segments can hold raw PCM, losslessly coded PCM, or only the ultrasonic
+ * band decimated to a lower rate (see codec.h). Encoding also runs on the
+ * dispatcher thread, and every segment decodes on its own.
+ */
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ARCHIVE_MAGIC "STARCH01"
+#define ARCHIVE_VERSION 2
+#define ARCHIVE_HEADER_BYTES 4096
+#define ARCHIVE_SEGMENT_EXT ".stseg"
+
+// Sample encodings stored in the segment header
+#define ARCHIVE_FORMAT_S16LE 1      // interleaved PCM
+#define ARCHIVE_FORMAT_LOSSLESS 2   // codec blocks of full-band PCM
+#define ARCHIVE_FORMAT_BAND 3       // codec blocks of the decimated band
+
+// On-disk segment header, little-endian, padded with zeros to
+// ARCHIVE_HEADER_BYTES. Audio data starts at ARCHIVE_HEADER_BYTES. Coded
+// formats are a sequence of codec blocks; an all-zero block prefix means
+// filler up to the next ARCHIVE_HEADER_BYTES boundary. frame_count counts
+// stored frames, at stored_rate. Version 1 headers end at data_bytes.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_bytes;
+    uint32_t sample_rate;
+    uint32_t channels;
+    uint32_t format;
+    uint32_t reserved;
+    uint64_t start_timestamp_ms;
+    uint64_t frame_count;
+    uint64_t data_bytes;
+    uint32_t stored_rate;           // sample_rate / decimation
+    uint32_t decimation;
+    uint32_t band_low_hz;           // ARCHIVE_FORMAT_BAND only
+    uint32_t band_high_hz;
+    uint32_t band_transition_hz;
+    uint32_t filter_taps;           // expanded audio lags by taps - decimation frames
+} archive_segment_header_t;
+
+typedef struct {
+    const char *directory;
+    unsigned int sample_rate;
+    unsigned int channels;
+    unsigned int segment_sec;       // audio per segment file
+    uint64_t quota_bytes;           // disk budget for all segments in directory
+    size_t buffer_bytes;            // size of each staging buffer
+    unsigned int buffer_count;      // staging buffers between capture and I/O
+    unsigned int io_threads;        // pwrite() workers when io_uring is unavailable
+    int direct_io;                  // open segments with O_DIRECT
+    int format;                     // ARCHIVE_FORMAT_*
+    double band_low_hz;             // band kept by ARCHIVE_FORMAT_BAND
+    double band_high_hz;
+    double band_transition_hz;
+} archive_config_t;
+
+typedef struct {
+    uint64_t bytes_captured;        // PCM handed to archive_write()
+    uint64_t bytes_written;         // after encoding
+    uint64_t segments_written;
+    uint64_t segments_deleted;
+    uint64_t frames_dropped;        // capture outran I/O; buffers were all busy
+    uint64_t write_errors;
+    unsigned int buffers_in_flight;
+} archive_stats_t;
+
+typedef struct archive archive_t;
+
+void archive_default_config(archive_config_t *cfg, const char *directory,
+                            unsigned int sample_rate, unsigned int channels);
+
+archive_t *archive_open(const archive_config_t *cfg);
+
+// Called from the capture thread. Never blocks on I/O: if no staging buffer
+// is free the frames are dropped and counted.
+void archive_write(archive_t *ar, const int16_t *frames, size_t n_frames);
+
+void archive_get_stats(archive_t *ar, archive_stats_t *stats);
+
+// Flush pending buffers, finalize open segments and release resources
+void archive_close(archive_t *ar);
+
+#endif
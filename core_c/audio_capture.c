@@ -3,20 +3,34 @@
  * Audio Capture Layer (C)
  * 
  * This module captures real-time audio from the system microphone using ALSA
- * and streams the data to the Python analysis layer via UNIX socket.
+ * (or renders it with the synthetic beacon generator) and streams the data
+ * to the Python analysis layer via UNIX socket.
  */
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
 #include <errno.h>
 #include <signal.h>
 #include <time.h>
+#include <getopt.h>
 #include <alsa/asoundlib.h>
 
+#include "signal_gen.h"
+#include "archive.h"
+#include "clip.h"
+#include "stats.h"
+#include "gate.h"
+#include "pcm_tune.h"
+#include "log.h"
+
 // Audio configuration constants
 #define SAMPLE_RATE 44100
 #define CHANNELS 1
@@ -24,6 +38,12 @@
 #define SOCKET_PATH "/tmp/silenttrace.sock"
 #define BUFFER_DURATION_SEC 1
 
+// Audio sources selectable with --source
+typedef enum {
+    SOURCE_ALSA,
+    SOURCE_SYNTH
+} source_type_t;
+
 // Message header structure for C->Python communication
 typedef struct {
     uint64_t timestamp;
@@ -32,21 +52,98 @@ typedef struct {
     uint32_t channels;
 } audio_header_t;
 
+// Control messages sent back by the Python client on the same socket
+#define CONTROL_MAGIC 0x4D435453u   // "STCM"
+#define CONTROL_TRIGGER_CLIP 1
+
+typedef struct {
+    uint32_t magic;
+    uint32_t command;
+    uint64_t timestamp;             // ms, same clock as audio_header_t.timestamp
+} control_message_t;
+
 // Global variables for cleanup
 static snd_pcm_t *capture_handle = NULL;
 static int socket_fd = -1;
 static int client_fd = -1;
 static volatile int running = 1;
 
+// Runtime capture configuration (defaults from the constants above)
+static source_type_t source_type = SOURCE_ALSA;
+static unsigned int capture_rate = SAMPLE_RATE;
+static unsigned int capture_channels = CHANNELS;
+
+// Period and buffer size (--period/--buffer, or chosen by --auto-tune)
+static pcm_setting_t pcm_setting = {FRAMES_PER_BUFFER, 0, 0, 0.0, 0.0, 0.0};
+static pcm_tune_config_t tune_config;
+static int auto_tune = 0;
+static int retune = 0;
+
+// Synthetic source state
+static synth_config_t synth_config;
+static synth_gen_t *synth_gen = NULL;
+static int synth_freerun = 0;
+static struct timespec synth_deadline;
+
+// Raw audio archive (enabled with --archive)
+static archive_config_t archive_config;
+static const char *archive_dir = NULL;
+static archive_t *archive = NULL;
+
+// Evidence clips around analyzer triggers (enabled with --clip-dir)
+static clip_config_t clip_config;
+static const char *clip_dir = NULL;
+static clip_recorder_t *clip_recorder = NULL;
+
+// Ultrasonic activity gate (enabled with --gate)
+static gate_config_t gate_config;
+static int gate_enabled = 0;
+static gate_t *gate = NULL;
+
+// Shared-memory pipeline stats (read with silenttrace-top)
+static const char *stats_name = STATS_DEFAULT_NAME;
+static stats_page_t *stats = NULL;
+static log_config_t log_config;
+
+// Partially received control message
+static uint8_t control_buffer[sizeof(control_message_t)];
+static size_t control_received = 0;
+
 void cleanup_and_exit(int sig) {
-    fprintf(stderr, "[INFO] Cleaning up resources...\n");
+    log_info("Cleaning up resources...");
     running = 0;
     
+    // Flush and finalize archive segments before the source goes away
+    if (archive) {
+        archive_close(archive);
+        archive = NULL;
+    }
+    
+    if (clip_recorder) {
+        clip_close(clip_recorder);
+        clip_recorder = NULL;
+    }
+    
     if (capture_handle) {
         snd_pcm_close(capture_handle);
         capture_handle = NULL;
     }
     
+    if (synth_gen) {
+        synth_destroy(synth_gen);
+        synth_gen = NULL;
+    }
+    
+    if (gate) {
+        gate_destroy(gate);
+        gate = NULL;
+    }
+    
+    if (stats) {
+        stats_destroy(stats, stats_name);
+        stats = NULL;
+    }
+    
     if (client_fd >= 0) {
         close(client_fd);
         client_fd = -1;
@@ -58,85 +155,58 @@ void cleanup_and_exit(int sig) {
     }
     
     unlink(SOCKET_PATH);
-    fprintf(stderr, "[INFO] Cleanup complete. Exiting.\n");
+    log_info("Cleanup complete. Exiting.");
+    log_stop();
     exit(0);
 }
 
+// Signals only stop the loop; blocking calls return EINTR (no SA_RESTART)
+// and main() runs the cleanup so archive segments are finalized safely
+void handle_signal(int sig) {
+    (void)sig;
+    running = 0;
+}
+
 int setup_audio_capture() {
     int err;
-    snd_pcm_hw_params_t *hw_params;
     
     // Open PCM device for recording
     if ((err = snd_pcm_open(&capture_handle, "default", SND_PCM_STREAM_CAPTURE, 0)) < 0) {
-        fprintf(stderr, "[ERROR] Cannot open audio device: %s\n", snd_strerror(err));
+        log_error("Cannot open audio device: %s", snd_strerror(err));
         return -1;
     }
     
-    // Allocate hardware parameters object
-    if ((err = snd_pcm_hw_params_malloc(&hw_params)) < 0) {
-        fprintf(stderr, "[ERROR] Cannot allocate hardware parameter structure: %s\n", snd_strerror(err));
-        return -1;
-    }
-    
-    // Initialize hardware parameters
-    if ((err = snd_pcm_hw_params_any(capture_handle, hw_params)) < 0) {
-        fprintf(stderr, "[ERROR] Cannot initialize hardware parameter structure: %s\n", snd_strerror(err));
-        return -1;
-    }
-    
-    // Set access type
-    if ((err = snd_pcm_hw_params_set_access(capture_handle, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0) {
-        fprintf(stderr, "[ERROR] Cannot set access type: %s\n", snd_strerror(err));
-        return -1;
-    }
-    
-    // Set sample format
-    if ((err = snd_pcm_hw_params_set_format(capture_handle, hw_params, SND_PCM_FORMAT_S16_LE)) < 0) {
-        fprintf(stderr, "[ERROR] Cannot set sample format: %s\n", snd_strerror(err));
-        return -1;
-    }
-    
-    // Set sample rate
-    unsigned int rate = SAMPLE_RATE;
-    if ((err = snd_pcm_hw_params_set_rate_near(capture_handle, hw_params, &rate, 0)) < 0) {
-        fprintf(stderr, "[ERROR] Cannot set sample rate: %s\n", snd_strerror(err));
+    // Pick the period and buffer size by calibration, or take them as given
+    if (auto_tune) {
+        if (pcm_auto_tune(capture_handle, &capture_rate, capture_channels, &tune_config, &pcm_setting) < 0) {
+            return -1;
+        }
+    } else if (pcm_configure(capture_handle, &capture_rate, capture_channels, &pcm_setting) < 0) {
         return -1;
     }
     
-    if (rate != SAMPLE_RATE) {
-        fprintf(stderr, "[WARNING] Sample rate set to %u instead of %d\n", rate, SAMPLE_RATE);
-    }
-    
-    // Set number of channels
-    if ((err = snd_pcm_hw_params_set_channels(capture_handle, hw_params, CHANNELS)) < 0) {
-        fprintf(stderr, "[ERROR] Cannot set channel count: %s\n", snd_strerror(err));
-        return -1;
-    }
+    log_info("Audio capture initialized: %uHz, %u channels, %lu frames/period, %lu frames buffer",
+            capture_rate, capture_channels, (unsigned long)pcm_setting.period_frames,
+            (unsigned long)pcm_setting.buffer_frames);
     
-    // Set buffer size
-    snd_pcm_uframes_t frames = FRAMES_PER_BUFFER;
-    if ((err = snd_pcm_hw_params_set_period_size_near(capture_handle, hw_params, &frames, 0)) < 0) {
-        fprintf(stderr, "[ERROR] Cannot set period size: %s\n", snd_strerror(err));
-        return -1;
-    }
+    return 0;
+}
+
+int setup_synth_source() {
+    synth_config.sample_rate = capture_rate;
+    synth_config.channels = capture_channels;
     
-    // Apply hardware parameters
-    if ((err = snd_pcm_hw_params(capture_handle, hw_params)) < 0) {
-        fprintf(stderr, "[ERROR] Cannot set parameters: %s\n", snd_strerror(err));
+    synth_gen = synth_create(&synth_config);
+    if (!synth_gen) {
+        log_error("Cannot create synthetic signal generator");
         return -1;
     }
     
-    // Free hardware parameters
-    snd_pcm_hw_params_free(hw_params);
-    
-    // Prepare audio interface for use
-    if ((err = snd_pcm_prepare(capture_handle)) < 0) {
-        fprintf(stderr, "[ERROR] Cannot prepare audio interface: %s\n", snd_strerror(err));
-        return -1;
-    }
+    clock_gettime(CLOCK_MONOTONIC, &synth_deadline);
     
-    fprintf(stderr, "[INFO] Audio capture initialized: %dHz, %d channels, %d frames/buffer\n", 
-            SAMPLE_RATE, CHANNELS, FRAMES_PER_BUFFER);
+    log_info("Synthetic source initialized: %uHz, %u channels, %zu beacons, SNR %.1fdB%s",
+            capture_rate, capture_channels, synth_config.n_beacons, synth_config.snr_db,
+            synth_freerun ? ", free-running" : "");
     
     return 0;
 }
@@ -147,7 +217,7 @@ int setup_unix_socket() {
     // Create socket
     socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
     if (socket_fd == -1) {
-        fprintf(stderr, "[ERROR] Cannot create socket: %s\n", strerror(errno));
+        log_error("Cannot create socket: %s", strerror(errno));
         return -1;
     }
     
@@ -161,30 +231,37 @@ int setup_unix_socket() {
     
     // Bind socket
     if (bind(socket_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
-        fprintf(stderr, "[ERROR] Cannot bind socket: %s\n", strerror(errno));
+        log_error("Cannot bind socket: %s", strerror(errno));
         return -1;
     }
     
     // Listen for connections
     if (listen(socket_fd, 1) == -1) {
-        fprintf(stderr, "[ERROR] Cannot listen on socket: %s\n", strerror(errno));
+        log_error("Cannot listen on socket: %s", strerror(errno));
         return -1;
     }
     
-    fprintf(stderr, "[INFO] Unix socket created at %s\n", SOCKET_PATH);
+    log_info("Unix socket created at %s", SOCKET_PATH);
     return 0;
 }
 
 int wait_for_client() {
-    fprintf(stderr, "[INFO] Waiting for Python client connection...\n");
+    log_info("Waiting for Python client connection...");
     
     client_fd = accept(socket_fd, NULL, NULL);
     if (client_fd == -1) {
-        fprintf(stderr, "[ERROR] Cannot accept client connection: %s\n", strerror(errno));
+        log_error("Cannot accept client connection: %s", strerror(errno));
         return -1;
     }
     
-    fprintf(stderr, "[INFO] Python client connected successfully\n");
+    log_info("Python client connected successfully");
+    
+    if (stats) {
+        stats_begin(stats);
+        stats->n_clients = 1;
+        stats->clients[0].connected = 1;
+        stats_end(stats);
+    }
     return 0;
 }
 
@@ -194,82 +271,334 @@ uint64_t get_timestamp_ms() {
     return (uint64_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
 }
 
+static uint64_t monotonic_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Frames lost to an overrun, from how long the device has been in XRUN
+static uint64_t xrun_lost_frames() {
+    snd_pcm_status_t *status;
+    snd_timestamp_t now, trigger;
+    uint64_t lost = 0;
+    
+    if (snd_pcm_status_malloc(&status) < 0) {
+        return 0;
+    }
+    if (snd_pcm_status(capture_handle, status) == 0 &&
+        snd_pcm_status_get_state(status) == SND_PCM_STATE_XRUN) {
+        snd_pcm_status_get_tstamp(status, &now);
+        snd_pcm_status_get_trigger_tstamp(status, &trigger);
+        int64_t us = (int64_t)(now.tv_sec - trigger.tv_sec) * 1000000 + (now.tv_usec - trigger.tv_usec);
+        if (us > 0) {
+            lost = (uint64_t)us * capture_rate / 1000000;
+        }
+    }
+    snd_pcm_status_free(status);
+    return lost;
+}
+
 int send_audio_data(int16_t *buffer, size_t frames) {
     audio_header_t header;
-    size_t data_size = frames * sizeof(int16_t) * CHANNELS;
+    size_t data_size = frames * sizeof(int16_t) * capture_channels;
     
     // Prepare header
     header.timestamp = get_timestamp_ms();
-    header.sample_rate = SAMPLE_RATE;
+    header.sample_rate = capture_rate;
     header.buffer_length = frames;
-    header.channels = CHANNELS;
+    header.channels = capture_channels;
     
     // Send header
     if (send(client_fd, &header, sizeof(header), 0) != sizeof(header)) {
-        fprintf(stderr, "[ERROR] Failed to send header: %s\n", strerror(errno));
+        log_error("Failed to send header: %s", strerror(errno));
         return -1;
     }
     
     // Send audio data
     if (send(client_fd, buffer, data_size, 0) != data_size) {
-        fprintf(stderr, "[ERROR] Failed to send audio data: %s\n", strerror(errno));
+        log_error("Failed to send audio data: %s", strerror(errno));
         return -1;
     }
     
     return 0;
 }
 
+// Send one second to the client and account for it on the stats page
+static int send_second(int16_t *samples, size_t frames) {
+    uint64_t send_start_us = monotonic_us();
+    int sent = send_audio_data(samples, frames);
+    
+    if (stats) {
+        stats_client_t *client = &stats->clients[0];
+        int queued = 0;
+        stats_begin(stats);
+        stats_hist_add(&stats->send_time, monotonic_us() - send_start_us);
+        if (sent < 0) {
+            client->drops++;
+            client->connected = 0;
+        } else {
+            uint64_t bytes = sizeof(audio_header_t) + frames * capture_channels * sizeof(int16_t);
+            stats->chunks_sent++;
+            stats->bytes_sent += bytes;
+            client->chunks_sent++;
+            client->bytes_sent += bytes;
+            if (ioctl(client_fd, SIOCOUTQ, &queued) == 0) {
+                client->queue_bytes = (uint32_t)queued;
+            }
+        }
+        stats_end(stats);
+    }
+    return sent;
+}
+
+static void handle_control_message(const control_message_t *msg) {
+    if (msg->magic != CONTROL_MAGIC) {
+        log_warning("Ignoring malformed control message");
+        return;
+    }
+    
+    switch (msg->command) {
+    case CONTROL_TRIGGER_CLIP:
+        if (!clip_recorder) {
+            break;
+        }
+        if (clip_trigger(clip_recorder, msg->timestamp) < 0) {
+            log_warning("Evidence clip dropped: all clip buffers busy");
+        }
+        break;
+    default:
+        log_warning("Unknown control command %u", msg->command);
+        break;
+    }
+}
+
+// Drain control messages from the client without blocking the capture loop
+static void poll_control_messages() {
+    for (;;) {
+        ssize_t n = recv(client_fd, control_buffer + control_received,
+                         sizeof(control_buffer) - control_received, MSG_DONTWAIT);
+        if (n <= 0) {
+            break;
+        }
+        control_received += (size_t)n;
+        if (control_received == sizeof(control_buffer)) {
+            control_message_t msg;
+            memcpy(&msg, control_buffer, sizeof(msg));
+            control_received = 0;
+            handle_control_message(&msg);
+        }
+    }
+}
+
+// Render one period from the synthetic generator, paced to real time
+// unless free-running
+static int read_synth_frames(int16_t *buffer, size_t frames) {
+    synth_generate(synth_gen, buffer, frames);
+    
+    if (!synth_freerun) {
+        long period_ns = (long)(frames * 1000000000ULL / capture_rate);
+        synth_deadline.tv_nsec += period_ns;
+        while (synth_deadline.tv_nsec >= 1000000000L) {
+            synth_deadline.tv_nsec -= 1000000000L;
+            synth_deadline.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &synth_deadline, NULL);
+    }
+    
+    return (int)frames;
+}
+
+static int read_source_frames(int16_t *buffer, size_t frames) {
+    if (source_type == SOURCE_SYNTH) {
+        return read_synth_frames(buffer, frames);
+    }
+    return snd_pcm_readi(capture_handle, buffer, frames);
+}
+
+// Step up to the next larger period; the read buffer grows with it
+static int retune_after_xrun(int16_t **buffer) {
+    pcm_setting_t setting = pcm_setting;
+    int16_t *grown;
+    
+    if (pcm_step_up(capture_handle, &capture_rate, capture_channels, &setting) < 0) {
+        log_warning("No larger period available, re-tuning disabled");
+        retune = 0;
+        return -1;
+    }
+    grown = realloc(*buffer, setting.period_frames * sizeof(int16_t) * capture_channels);
+    if (!grown) {
+        return -1;
+    }
+    *buffer = grown;
+    pcm_setting = setting;
+    
+    log_warning("Re-tuned after xruns: %lu frames/period, %lu frames buffer (%.1fms latency)",
+                (unsigned long)setting.period_frames, (unsigned long)setting.buffer_frames,
+                setting.period_frames * 1000.0 / capture_rate);
+    if (stats) {
+        stats_begin(stats);
+        stats->period_frames = (uint32_t)setting.period_frames;
+        stats->buffer_frames = (uint32_t)setting.buffer_frames;
+        stats->retunes++;
+        stats_end(stats);
+    }
+    return 0;
+}
+
 void audio_capture_loop() {
     int16_t *buffer;
     int16_t *rolling_buffer;
-    size_t rolling_buffer_size = SAMPLE_RATE * BUFFER_DURATION_SEC; // 1 second of audio
+    size_t rolling_buffer_size = capture_rate * BUFFER_DURATION_SEC * capture_channels; // 1 second of audio
     size_t rolling_buffer_pos = 0;
+    size_t period_frames = pcm_setting.period_frames;
     int frames_read;
-    int chunks_processed = 0;
+    int gate_was_open = 0;
+    uint64_t xrun_window_start_us = monotonic_us();
+    unsigned int xruns_in_window = 0;
     
     // Allocate buffers
-    buffer = malloc(FRAMES_PER_BUFFER * sizeof(int16_t) * CHANNELS);
-    rolling_buffer = malloc(rolling_buffer_size * sizeof(int16_t) * CHANNELS);
+    buffer = malloc(period_frames * sizeof(int16_t) * capture_channels);
+    rolling_buffer = malloc(rolling_buffer_size * sizeof(int16_t));
     
     if (!buffer || !rolling_buffer) {
-        fprintf(stderr, "[ERROR] Cannot allocate audio buffers\n");
+        log_error("Cannot allocate audio buffers");
         return;
     }
     
-    memset(rolling_buffer, 0, rolling_buffer_size * sizeof(int16_t) * CHANNELS);
+    memset(rolling_buffer, 0, rolling_buffer_size * sizeof(int16_t));
     
-    fprintf(stderr, "[INFO] Starting audio capture loop...\n");
+    log_info("Starting audio capture loop...");
     
     while (running) {
         // Read audio frames
-        frames_read = snd_pcm_readi(capture_handle, buffer, FRAMES_PER_BUFFER);
+        uint64_t read_start_us = monotonic_us();
+        frames_read = read_source_frames(buffer, period_frames);
+        uint64_t read_end_us = monotonic_us();
+        
+        if (!running) {
+            break;
+        }
         
         if (frames_read == -EPIPE) {
-            fprintf(stderr, "[WARNING] Buffer underrun occurred\n");
+            log_warning("Buffer underrun occurred");
+            if (stats) {
+                uint64_t lost = xrun_lost_frames();
+                stats_begin(stats);
+                stats->xruns++;
+                stats->frames_lost += lost;
+                stats_end(stats);
+            }
             snd_pcm_prepare(capture_handle);
+            
+            // Overrunning beyond the budget: trade latency for headroom
+            if (retune) {
+                uint64_t now_us = monotonic_us();
+                if (now_us - xrun_window_start_us > 60000000ULL) {
+                    xrun_window_start_us = now_us;
+                    xruns_in_window = 0;
+                }
+                if (++xruns_in_window > tune_config.xrun_budget && retune_after_xrun(&buffer) == 0) {
+                    period_frames = pcm_setting.period_frames;
+                    xrun_window_start_us = now_us;
+                    xruns_in_window = 0;
+                }
+            }
             continue;
         } else if (frames_read < 0) {
-            fprintf(stderr, "[ERROR] Error reading audio: %s\n", snd_strerror(frames_read));
+            log_error("Error reading audio: %s", snd_strerror(frames_read));
+            if (stats) {
+                stats_begin(stats);
+                stats->read_errors++;
+                stats_end(stats);
+            }
             break;
         }
         
-        // Copy to rolling buffer
-        for (int i = 0; i < frames_read * CHANNELS; i++) {
-            rolling_buffer[rolling_buffer_pos] = buffer[i];
-            rolling_buffer_pos = (rolling_buffer_pos + 1) % rolling_buffer_size;
+        // Cheap first stage: decides whether this second goes to the analyzer
+        if (gate) {
+            gate_was_open |= gate_process(gate, buffer, frames_read);
         }
         
-        chunks_processed++;
+        if (stats) {
+            stats_begin(stats);
+            stats->frames_captured += (uint64_t)frames_read;
+            stats->periods++;
+            stats_hist_add(&stats->read_wait, read_end_us - read_start_us);
+            if (archive) {
+                archive_stats_t archive_stats;
+                archive_get_stats(archive, &archive_stats);
+                stats->archive_bytes_written = archive_stats.bytes_written;
+                stats->archive_frames_dropped = archive_stats.frames_dropped;
+            }
+            if (clip_recorder) {
+                clip_stats_t clip_stats;
+                clip_get_stats(clip_recorder, &clip_stats);
+                stats->clips_written = clip_stats.clips_written;
+            }
+            if (gate) {
+                gate_stats_t gate_stats;
+                gate_get_stats(gate, &gate_stats);
+                stats->gate_open = (uint32_t)gate_stats.open;
+                stats->gate_trips = gate_stats.trips;
+                stats->rms_dbfs = gate_stats.rms_dbfs;
+                stats->peak_dbfs = gate_stats.peak_dbfs;
+                stats->gate_band_dbfs = gate_stats.band_dbfs;
+                stats->gate_floor_dbfs = gate_stats.floor_dbfs;
+            }
+            stats_end(stats);
+        }
+        
+        // Hand the period to the archive writer (copy only, never blocks)
+        if (archive) {
+            archive_write(archive, buffer, frames_read);
+        }
+        
+        // Keep the pre-trigger window and feed clips in progress
+        if (clip_recorder) {
+            clip_write(clip_recorder, buffer, frames_read);
+        }
+        poll_control_messages();
         
-        // Send data every ~1 second (approximate based on buffer size)
-        if (chunks_processed >= (SAMPLE_RATE / FRAMES_PER_BUFFER)) {
-            if (send_audio_data(rolling_buffer, rolling_buffer_size / CHANNELS) < 0) {
-                fprintf(stderr, "[ERROR] Failed to send audio data to Python client\n");
+        // Copy to rolling buffer in at most two blocks (see bench_capture).
+        // A second is sent as soon as the buffer fills, so the analyzer gets
+        // contiguous seconds in capture order; the rest of the period starts
+        // the next one.
+        const int16_t *src = buffer;
+        size_t remaining = (size_t)frames_read * capture_channels;
+        int send_failed = 0;
+        while (remaining > 0 && !send_failed) {
+            size_t chunk = rolling_buffer_size - rolling_buffer_pos;
+            if (chunk > remaining) {
+                chunk = remaining;
+            }
+            memcpy(rolling_buffer + rolling_buffer_pos, src, chunk * sizeof(int16_t));
+            rolling_buffer_pos += chunk;
+            src += chunk;
+            remaining -= chunk;
+            if (rolling_buffer_pos < rolling_buffer_size) {
                 break;
             }
+            rolling_buffer_pos = 0;
             
-            chunks_processed = 0;
-            fprintf(stderr, "[DEBUG] Sent 1-second audio chunk to Python\n");
+            // While the gate stays closed the analyzer is left asleep: the
+            // second is dropped here instead of being sent
+            if (gate && !gate_was_open) {
+                if (stats) {
+                    stats_begin(stats);
+                    stats->chunks_gated++;
+                    stats_end(stats);
+                }
+            } else if (send_second(rolling_buffer, rolling_buffer_size / capture_channels) < 0) {
+                log_error("Failed to send audio data to Python client");
+                send_failed = 1;
+            } else {
+                log_debug("Sent 1-second audio chunk to Python");
+            }
+            gate_was_open = 0;
+        }
+        if (send_failed) {
+            break;
         }
     }
     
@@ -277,28 +606,398 @@ void audio_capture_loop() {
     free(rolling_buffer);
 }
 
-int main() {
-    // Setup signal handlers
-    signal(SIGINT, cleanup_and_exit);
-    signal(SIGTERM, cleanup_and_exit);
+void print_usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --source alsa|synth     Audio source (default: alsa)\n"
+            "  --rate HZ               Sample rate (default: %d)\n"
+            "  --channels N            Channel count (default: %d)\n"
+            "  --period FRAMES         Frames per read (default: %d)\n"
+            "  --buffer FRAMES         ALSA buffer size (default: device default)\n"
+            "\n"
+            "Period tuning options (ALSA source):\n"
+            "  --auto-tune             Pick the smallest period and buffer that meet the xrun budget\n"
+            "  --target-latency MS     Largest period auto-tune may choose (default: 50)\n"
+            "  --xrun-budget N         Xruns per minute tolerated (default: 0)\n"
+            "  --tune-window SEC       Calibration time per candidate (default: 1)\n"
+            "  --retune                Step up to a larger period when xruns exceed the budget\n"
+            "\n"
+            "Synthetic source options:\n"
+            "  --beacon SPEC           Add a beacon; replaces the default mix. SPEC is\n"
+            "                          kind[,key=value...] with kind tone|fsk|chirp|pulse|doppler\n"
+            "                          and keys f=HZ[/HZ...], baud, period, width, dev, rate, level\n"
+            "                          e.g. fsk,f=18500/18700,baud=50 or pulse,f=20000,period=0.5,width=0.05\n"
+            "  --snr DB                Beacon-to-noise power ratio (default: 10)\n"
+            "  --noise white|pink|brown  Background noise color (default: pink)\n"
+            "  --speech DB             Add speech-like interference at this beacon-to-speech ratio\n"
+            "  --level DBFS            RMS level of a 0 dB beacon (default: -30)\n"
+            "  --seed N                Generator seed (default: 1)\n"
+            "  --freerun               Generate as fast as possible instead of real time\n"
+            "\n"
+            "Archive options:\n"
+            "  --archive DIR           Write the raw capture stream to segment files in DIR\n"
+            "  --archive-segment SEC   Audio per segment file (default: 60)\n"
+            "  --archive-quota MB      Disk budget; oldest segments are deleted first (default: 1024)\n"
+            "  --archive-threads N     Writer threads when io_uring is unavailable (default: 2)\n"
+            "  --archive-buffered      Use the page cache instead of O_DIRECT\n"
+            "  --archive-format FMT    pcm, lossless, or band (ultrasonic band only) (default: pcm)\n"
+            "  --archive-band LO-HI    Band kept by the band format in Hz (default: 18000-22000)\n"
+            "\n"
+            "Evidence clip options:\n"
+            "  --clip-dir DIR          Save a WAV clip around every analyzer alert trigger\n"
+            "  --clip-pre SEC          Audio kept before the trigger (default: 10)\n"
+            "  --clip-post SEC         Audio recorded after the trigger (default: 10)\n"
+            "\n"
+            "Activity gate options:\n"
+            "  --gate                  Only send audio to the analyzer while ultrasonic activity is seen\n"
+            "  --gate-band LO-HI       Band watched by the gate in Hz (default: 18000-22000)\n"
+            "  --gate-tone HZ          Also watch this tone with a Goertzel bin (repeatable)\n"
+            "  --gate-threshold DB     Trip level above the learned noise floor (default: 10)\n"
+            "  --gate-hangover SEC     Keep sending this long after the last trip (default: 2)\n"
+            "  --gate-refresh SEC      Send one chunk after this long closed, 0 = never (default: 60)\n"
+            "\n"
+            "Monitoring options:\n"
+            "  --stats-name NAME       Shared-memory stats page (default: %s)\n"
+            "  --no-stats              Do not publish pipeline stats\n"
+            "  --log-level LEVEL       debug, info, warning, or error (default: info)\n"
+            "  --log-json              Write log lines as JSON objects\n"
+            "  --log-rate N            Lines per second from one log statement, 0 = unlimited (default: %u)\n",
+            prog, SAMPLE_RATE, CHANNELS, FRAMES_PER_BUFFER, STATS_DEFAULT_NAME, log_config.rate_limit);
+}
+
+int parse_arguments(int argc, char **argv) {
+    static const struct option long_options[] = {
+        {"source",   required_argument, NULL, 's'},
+        {"rate",     required_argument, NULL, 'r'},
+        {"channels", required_argument, NULL, 'c'},
+        {"period",   required_argument, NULL, 'p'},
+        {"buffer",   required_argument, NULL, 'q'},
+        {"auto-tune",        no_argument,       NULL, 'a'},
+        {"target-latency",   required_argument, NULL, 't'},
+        {"xrun-budget",      required_argument, NULL, 'e'},
+        {"tune-window",      required_argument, NULL, 'w'},
+        {"retune",           no_argument,       NULL, 'y'},
+        {"beacon",   required_argument, NULL, 'b'},
+        {"snr",      required_argument, NULL, 'n'},
+        {"noise",    required_argument, NULL, 'N'},
+        {"speech",   required_argument, NULL, 'S'},
+        {"level",    required_argument, NULL, 'l'},
+        {"seed",     required_argument, NULL, 'x'},
+        {"freerun",  no_argument,       NULL, 'f'},
+        {"archive",          required_argument, NULL, 'A'},
+        {"archive-segment",  required_argument, NULL, 'G'},
+        {"archive-quota",    required_argument, NULL, 'Q'},
+        {"archive-threads",  required_argument, NULL, 'T'},
+        {"archive-buffered", no_argument,       NULL, 'B'},
+        {"archive-format",   required_argument, NULL, 'F'},
+        {"archive-band",     required_argument, NULL, 'W'},
+        {"clip-dir",         required_argument, NULL, 'D'},
+        {"clip-pre",         required_argument, NULL, 'P'},
+        {"clip-post",        required_argument, NULL, 'O'},
+        {"stats-name",       required_argument, NULL, 'K'},
+        {"no-stats",         no_argument,       NULL, 'k'},
+        {"gate",             no_argument,       NULL, 'g'},
+        {"gate-band",        required_argument, NULL, 'E'},
+        {"gate-tone",        required_argument, NULL, 'Y'},
+        {"gate-threshold",   required_argument, NULL, 'Z'},
+        {"gate-hangover",    required_argument, NULL, 'V'},
+        {"gate-refresh",     required_argument, NULL, 'U'},
+        {"log-level",        required_argument, NULL, 'L'},
+        {"log-json",         no_argument,       NULL, 'J'},
+        {"log-rate",         required_argument, NULL, 'R'},
+        {"help",     no_argument,       NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    int custom_beacons = 0;
+    int opt;
+    
+    synth_default_config(&synth_config, SAMPLE_RATE, CHANNELS);
+    archive_default_config(&archive_config, NULL, SAMPLE_RATE, CHANNELS);
+    clip_default_config(&clip_config, NULL, SAMPLE_RATE, CHANNELS);
+    pcm_tune_default_config(&tune_config);
+    gate_default_config(&gate_config, SAMPLE_RATE, CHANNELS);
+    log_default_config(&log_config);
+    
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 's':
+            if (strcmp(optarg, "alsa") == 0) {
+                source_type = SOURCE_ALSA;
+            } else if (strcmp(optarg, "synth") == 0) {
+                source_type = SOURCE_SYNTH;
+            } else {
+                log_error("Unknown source: %s", optarg);
+                return -1;
+            }
+            break;
+        case 'r':
+            capture_rate = (unsigned int)strtoul(optarg, NULL, 10);
+            break;
+        case 'c':
+            capture_channels = (unsigned int)strtoul(optarg, NULL, 10);
+            break;
+        case 'p':
+            pcm_setting.period_frames = (snd_pcm_uframes_t)atol(optarg);
+            break;
+        case 'q':
+            pcm_setting.buffer_frames = (snd_pcm_uframes_t)atol(optarg);
+            break;
+        case 'a':
+            auto_tune = 1;
+            break;
+        case 't':
+            tune_config.target_latency_ms = atof(optarg);
+            break;
+        case 'e':
+            tune_config.xrun_budget = atof(optarg);
+            break;
+        case 'w':
+            tune_config.window_sec = atof(optarg);
+            break;
+        case 'y':
+            retune = 1;
+            break;
+        case 'b':
+            if (!custom_beacons) {
+                synth_config.n_beacons = 0;
+                custom_beacons = 1;
+            }
+            if (synth_config.n_beacons == SYNTH_MAX_BEACONS) {
+                log_error("At most %d beacons supported", SYNTH_MAX_BEACONS);
+                return -1;
+            }
+            if (synth_parse_beacon(optarg, &synth_config.beacons[synth_config.n_beacons]) < 0) {
+                return -1;
+            }
+            synth_config.n_beacons++;
+            break;
+        case 'n':
+            synth_config.snr_db = atof(optarg);
+            break;
+        case 'N':
+            if (synth_parse_noise(optarg, &synth_config.noise) < 0) {
+                return -1;
+            }
+            break;
+        case 'S':
+            synth_config.speech_enabled = 1;
+            synth_config.sir_db = atof(optarg);
+            break;
+        case 'l':
+            synth_config.level_dbfs = atof(optarg);
+            break;
+        case 'x':
+            synth_config.seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'f':
+            synth_freerun = 1;
+            break;
+        case 'A':
+            archive_dir = optarg;
+            break;
+        case 'G':
+            archive_config.segment_sec = (unsigned int)strtoul(optarg, NULL, 10);
+            break;
+        case 'Q':
+            archive_config.quota_bytes = strtoull(optarg, NULL, 10) * 1024 * 1024;
+            break;
+        case 'T':
+            archive_config.io_threads = (unsigned int)strtoul(optarg, NULL, 10);
+            break;
+        case 'B':
+            archive_config.direct_io = 0;
+            break;
+        case 'F':
+            if (strcmp(optarg, "pcm") == 0) {
+                archive_config.format = ARCHIVE_FORMAT_S16LE;
+            } else if (strcmp(optarg, "lossless") == 0) {
+                archive_config.format = ARCHIVE_FORMAT_LOSSLESS;
+            } else if (strcmp(optarg, "band") == 0) {
+                archive_config.format = ARCHIVE_FORMAT_BAND;
+            } else {
+                log_error("Unknown archive format: %s", optarg);
+                return -1;
+            }
+            break;
+        case 'W':
+            if (sscanf(optarg, "%lf-%lf", &archive_config.band_low_hz, &archive_config.band_high_hz) != 2 ||
+                archive_config.band_low_hz >= archive_config.band_high_hz) {
+                log_error("Invalid archive band: %s", optarg);
+                return -1;
+            }
+            break;
+        case 'D':
+            clip_dir = optarg;
+            break;
+        case 'P':
+            clip_config.pre_trigger_sec = atof(optarg);
+            break;
+        case 'O':
+            clip_config.post_trigger_sec = atof(optarg);
+            break;
+        case 'K':
+            if (optarg[0] != '/' || strchr(optarg + 1, '/')) {
+                log_error("Stats name must look like /name: %s", optarg);
+                return -1;
+            }
+            stats_name = optarg;
+            break;
+        case 'k':
+            stats_name = NULL;
+            break;
+        case 'g':
+            gate_enabled = 1;
+            break;
+        case 'E':
+            if (sscanf(optarg, "%lf-%lf", &gate_config.band_low_hz, &gate_config.band_high_hz) != 2 ||
+                gate_config.band_low_hz >= gate_config.band_high_hz) {
+                log_error("Invalid gate band: %s", optarg);
+                return -1;
+            }
+            break;
+        case 'Y':
+            if (gate_config.n_tones == GATE_MAX_TONES) {
+                log_error("At most %d gate tones supported", GATE_MAX_TONES);
+                return -1;
+            }
+            gate_config.tones_hz[gate_config.n_tones++] = atof(optarg);
+            break;
+        case 'Z':
+            gate_config.threshold_db = atof(optarg);
+            break;
+        case 'V':
+            gate_config.hangover_sec = atof(optarg);
+            break;
+        case 'U':
+            gate_config.refresh_sec = atof(optarg);
+            break;
+        case 'L':
+            if (log_parse_level(optarg, &log_config.level) < 0) {
+                return -1;
+            }
+            break;
+        case 'J':
+            log_config.json = 1;
+            break;
+        case 'R':
+            log_config.rate_limit = (unsigned int)atoi(optarg);
+            break;
+        case 'h':
+        default:
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
     
-    fprintf(stderr, "[INFO] SilentTrace Audio Capture starting...\n");
+    if (capture_rate == 0 || capture_channels == 0) {
+        log_error("Sample rate and channel count must be positive");
+        return -1;
+    }
     
-    // Initialize ALSA
-    if (setup_audio_capture() < 0) {
-        fprintf(stderr, "[ERROR] Failed to setup audio capture\n");
+    if (pcm_setting.period_frames == 0 || tune_config.target_latency_ms <= 0.0 ||
+        tune_config.window_sec <= 0.0 || tune_config.xrun_budget < 0.0) {
+        log_error("Period size, target latency and tune window must be positive");
+        return -1;
+    }
+    
+    if (source_type == SOURCE_SYNTH && (auto_tune || retune)) {
+        log_warning("Period tuning only applies to the ALSA source; using %lu frames/period",
+                    (unsigned long)pcm_setting.period_frames);
+        auto_tune = 0;
+        retune = 0;
+    }
+    
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (parse_arguments(argc, argv) < 0) {
+        return 1;
+    }
+    
+    // Setup signal handlers
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    
+    // A vanished client must surface as a send() error, not kill the process
+    signal(SIGPIPE, SIG_IGN);
+    
+    if (log_start(&log_config) < 0) {
+        log_warning("Cannot start log writer thread, logging synchronously");
+    }
+    log_info("SilentTrace Audio Capture starting...");
+    
+    // Initialize the audio source
+    if (source_type == SOURCE_SYNTH) {
+        if (setup_synth_source() < 0) {
+            log_error("Failed to setup synthetic source");
+            cleanup_and_exit(1);
+        }
+    } else if (setup_audio_capture() < 0) {
+        log_error("Failed to setup audio capture");
         cleanup_and_exit(1);
     }
     
+    // Start the archive writer once the real rate is known
+    if (archive_dir) {
+        archive_config.directory = archive_dir;
+        archive_config.sample_rate = capture_rate;
+        archive_config.channels = capture_channels;
+        archive = archive_open(&archive_config);
+        if (!archive) {
+            log_error("Failed to start audio archive");
+            cleanup_and_exit(1);
+        }
+    }
+    
+    if (clip_dir) {
+        clip_config.directory = clip_dir;
+        clip_config.sample_rate = capture_rate;
+        clip_config.channels = capture_channels;
+        clip_recorder = clip_open(&clip_config);
+        if (!clip_recorder) {
+            log_error("Failed to start evidence clip recorder");
+            cleanup_and_exit(1);
+        }
+    }
+    
+    if (gate_enabled) {
+        gate_config.sample_rate = capture_rate;
+        gate_config.channels = capture_channels;
+        gate = gate_create(&gate_config);
+        if (!gate) {
+            log_error("Failed to start activity gate");
+            cleanup_and_exit(1);
+        }
+    }
+    
+    // Stats are best effort: capture runs without them if shm is unavailable
+    if (stats_name) {
+        stats = stats_create(stats_name);
+        if (stats) {
+            stats_begin(stats);
+            stats->sample_rate = capture_rate;
+            stats->channels = capture_channels;
+            stats->period_frames = (uint32_t)pcm_setting.period_frames;
+            stats->buffer_frames = (uint32_t)pcm_setting.buffer_frames;
+            stats->gate_enabled = gate != NULL;
+            stats_end(stats);
+        }
+    }
+    
     // Setup Unix socket
     if (setup_unix_socket() < 0) {
-        fprintf(stderr, "[ERROR] Failed to setup Unix socket\n");
+        log_error("Failed to setup Unix socket");
         cleanup_and_exit(1);
     }
     
     // Wait for Python client
     if (wait_for_client() < 0) {
-        fprintf(stderr, "[ERROR] Failed to connect to Python client\n");
+        log_error("Failed to connect to Python client");
         cleanup_and_exit(1);
     }
     
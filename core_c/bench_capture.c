@@ -0,0 +1,544 @@
+/*
+ * SilentTrace - Ultrasonic Signal Detector
+ * Capture-Side Microbenchmarks
+ *
+ * Times each capture-path kernel in isolation over a range of period sizes
+ * and channel counts and prints one result per line (JSON lines, or CSV
+ * with --csv) for tracking regressions across builds and machines:
+ *
+ *   {"kernel":"ring_block","frames":2048,"channels":1,"ns_per_sample":0.05,
+ *    "gb_per_s":40.1,"iterations":...}
+ *
+ * ns_per_sample is per interleaved sample; gb_per_s is S16 input
+ * throughput. Each figure is the median of several timed repetitions.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "signal_gen.h"
+#include "codec.h"
+#include "gate.h"
+
+#define BENCH_MAX_SIZES 16
+#define BENCH_REPETITIONS 5
+
+// Same layout as the stream header in audio_capture.c
+typedef struct {
+    uint64_t timestamp;
+    uint32_t sample_rate;
+    uint32_t buffer_length;
+    uint32_t channels;
+} audio_header_t;
+
+typedef struct {
+    size_t frames;
+    unsigned int channels;
+    unsigned int rate;
+
+    int16_t *input;             // frames x channels of synthetic audio
+    int32_t *input32;
+    int16_t *output;
+    float *output_f;
+    int16_t *ring;              // one second, as in the capture loop
+    size_t ring_size;
+    size_t ring_pos;
+
+    int send_fd;
+    uint8_t *encoded;
+    codec_encoder_t *encoder;
+    band_filter_t *band;
+    gate_t *gate;
+    synth_gen_t *synth;
+} bench_ctx_t;
+
+typedef struct {
+    const char *name;
+    void (*run)(bench_ctx_t *ctx);
+} kernel_t;
+
+static volatile uint64_t sink;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* ---------- Kernels ---------- */
+
+// The capture loop's rolling buffer copy: one modulo per sample
+static void kernel_ring_modulo(bench_ctx_t *ctx) {
+    size_t n = ctx->frames * ctx->channels;
+    for (size_t i = 0; i < n; i++) {
+        ctx->ring[ctx->ring_pos] = ctx->input[i];
+        ctx->ring_pos = (ctx->ring_pos + 1) % ctx->ring_size;
+    }
+}
+
+// Same ring update as at most two memcpy() calls
+static void kernel_ring_block(bench_ctx_t *ctx) {
+    const int16_t *src = ctx->input;
+    size_t n = ctx->frames * ctx->channels;
+
+    while (n > 0) {
+        size_t chunk = ctx->ring_size - ctx->ring_pos;
+        if (chunk > n) {
+            chunk = n;
+        }
+        memcpy(ctx->ring + ctx->ring_pos, src, chunk * sizeof(int16_t));
+        ctx->ring_pos = (ctx->ring_pos + chunk) % ctx->ring_size;
+        src += chunk;
+        n -= chunk;
+    }
+}
+
+static void kernel_s16_to_f32(bench_ctx_t *ctx) {
+    size_t n = ctx->frames * ctx->channels;
+    for (size_t i = 0; i < n; i++) {
+        ctx->output_f[i] = ctx->input[i] * (1.0f / 32768.0f);
+    }
+}
+
+// S32_LE capture formats down to the S16 stream format
+static void kernel_s32_to_s16(bench_ctx_t *ctx) {
+    size_t n = ctx->frames * ctx->channels;
+    for (size_t i = 0; i < n; i++) {
+        ctx->output[i] = (int16_t)(ctx->input32[i] >> 16);
+    }
+}
+
+static void kernel_deinterleave(bench_ctx_t *ctx) {
+    size_t frames = ctx->frames;
+    unsigned int nch = ctx->channels;
+    for (unsigned int c = 0; c < nch; c++) {
+        int16_t *dst = ctx->output + c * frames;
+        for (size_t i = 0; i < frames; i++) {
+            dst[i] = ctx->input[i * nch + c];
+        }
+    }
+}
+
+static void fill_header(bench_ctx_t *ctx, audio_header_t *header) {
+    memset(header, 0, sizeof(*header));
+    header->timestamp = (uint64_t)now_ns();
+    header->sample_rate = ctx->rate;
+    header->buffer_length = (uint32_t)ctx->frames;
+    header->channels = ctx->channels;
+}
+
+static int send_fully(int fd, const void *data, size_t len) {
+    const uint8_t *p = data;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Framing as send_audio_data() does it: header and payload as two sends
+static void kernel_send_split(bench_ctx_t *ctx) {
+    audio_header_t header;
+    fill_header(ctx, &header);
+    send_fully(ctx->send_fd, &header, sizeof(header));
+    send_fully(ctx->send_fd, ctx->input, ctx->frames * ctx->channels * sizeof(int16_t));
+}
+
+// Header and payload gathered into one sendmsg()
+static void kernel_send_gather(bench_ctx_t *ctx) {
+    audio_header_t header;
+    struct iovec iov[2];
+    struct msghdr msg;
+    size_t remaining;
+
+    fill_header(ctx, &header);
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = ctx->input;
+    iov[1].iov_len = ctx->frames * ctx->channels * sizeof(int16_t);
+    remaining = iov[0].iov_len + iov[1].iov_len;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    while (remaining > 0) {
+        ssize_t n = sendmsg(ctx->send_fd, &msg, 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        remaining -= (size_t)n;
+        while (msg.msg_iovlen > 0 && (size_t)n >= msg.msg_iov->iov_len) {
+            n -= (ssize_t)msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen > 0) {
+            msg.msg_iov->iov_base = (uint8_t *)msg.msg_iov->iov_base + n;
+            msg.msg_iov->iov_len -= (size_t)n;
+        }
+    }
+}
+
+static void kernel_codec_encode(bench_ctx_t *ctx) {
+    size_t total = 0;
+    for (size_t f = 0; f < ctx->frames; f += CODEC_BLOCK_FRAMES) {
+        size_t count = ctx->frames - f < CODEC_BLOCK_FRAMES ? ctx->frames - f : CODEC_BLOCK_FRAMES;
+        total += codec_encode_block(ctx->encoder, ctx->input + f * ctx->channels, count, ctx->encoded);
+    }
+    sink += total;
+}
+
+static void kernel_band_decimate(bench_ctx_t *ctx) {
+    sink += band_decimate(ctx->band, ctx->input, ctx->frames, ctx->output);
+}
+
+static void kernel_gate_process(bench_ctx_t *ctx) {
+    sink += (uint64_t)gate_process(ctx->gate, ctx->input, ctx->frames);
+}
+
+static void kernel_synth_generate(bench_ctx_t *ctx) {
+    synth_generate(ctx->synth, ctx->output, ctx->frames);
+}
+
+static const kernel_t kernels[] = {
+    {"ring_modulo",    kernel_ring_modulo},
+    {"ring_block",     kernel_ring_block},
+    {"s16_to_f32",     kernel_s16_to_f32},
+    {"s32_to_s16",     kernel_s32_to_s16},
+    {"deinterleave",   kernel_deinterleave},
+    {"send_split",     kernel_send_split},
+    {"send_gather",    kernel_send_gather},
+    {"codec_encode",   kernel_codec_encode},
+    {"band_decimate",  kernel_band_decimate},
+    {"gate_process",   kernel_gate_process},
+    {"synth_generate", kernel_synth_generate},
+};
+
+/* ---------- Harness ---------- */
+
+// Drains the receiving end of the socket pair like the Python client would
+static void *drain_thread(void *arg) {
+    int fd = *(int *)arg;
+    static uint8_t scratch[1 << 20];
+    while (recv(fd, scratch, sizeof(scratch), 0) > 0) {
+    }
+    return NULL;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Median ns per call over BENCH_REPETITIONS runs of at least min_sec / reps
+static double time_kernel(const kernel_t *k, bench_ctx_t *ctx, double min_sec, uint64_t *iterations) {
+    double runs[BENCH_REPETITIONS];
+    uint64_t iters = 1;
+    double budget_ns = min_sec * 1e9 / BENCH_REPETITIONS;
+
+    // Warm caches and calibrate the iteration count
+    for (;;) {
+        double start = now_ns();
+        for (uint64_t i = 0; i < iters; i++) {
+            k->run(ctx);
+        }
+        double elapsed = now_ns() - start;
+        if (elapsed >= budget_ns / 4 || iters >= (1ULL << 40)) {
+            iters = (uint64_t)(iters * budget_ns / (elapsed > 1.0 ? elapsed : 1.0)) + 1;
+            break;
+        }
+        iters *= 4;
+    }
+
+    for (int r = 0; r < BENCH_REPETITIONS; r++) {
+        double start = now_ns();
+        for (uint64_t i = 0; i < iters; i++) {
+            k->run(ctx);
+        }
+        runs[r] = (now_ns() - start) / iters;
+    }
+    qsort(runs, BENCH_REPETITIONS, sizeof(double), compare_doubles);
+
+    *iterations = iters * BENCH_REPETITIONS;
+    return runs[BENCH_REPETITIONS / 2];
+}
+
+static int parse_list(const char *arg, size_t *values, size_t max) {
+    size_t n = 0;
+    char *end;
+
+    while (*arg && n < max) {
+        values[n] = strtoul(arg, &end, 10);
+        if (end == arg || values[n] == 0) {
+            return -1;
+        }
+        n++;
+        arg = *end == ',' ? end + 1 : end;
+        if (*end && *end != ',') {
+            return -1;
+        }
+    }
+    return (int)n;
+}
+
+static void cpu_model(char *out, size_t len) {
+    FILE *f = fopen("/proc/cpuinfo", "r");
+    char line[256];
+
+    snprintf(out, len, "unknown");
+    if (!f) {
+        return;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        char *colon = strchr(line, ':');
+        if (strncmp(line, "model name", 10) == 0 && colon) {
+            colon += 2;
+            colon[strcspn(colon, "\n\"\\")] = '\0';
+            snprintf(out, len, "%s", colon);
+            break;
+        }
+    }
+    fclose(f);
+}
+
+// Highest frequency the default synthetic beacons reach; rates at or below
+// twice this cannot run the synth-backed kernels
+static double synth_top_freq(unsigned int rate) {
+    synth_config_t synth_config;
+    double top = 0.0;
+
+    synth_default_config(&synth_config, rate, 1);
+    for (size_t b = 0; b < synth_config.n_beacons; b++) {
+        const synth_beacon_t *beacon = &synth_config.beacons[b];
+        for (size_t k = 0; k < beacon->n_freqs; k++) {
+            double f = beacon->freqs[k] + (beacon->kind == SYNTH_DOPPLER ? beacon->dev_hz : 0.0);
+            if (f > top) {
+                top = f;
+            }
+        }
+    }
+    return top;
+}
+
+static int setup_ctx(bench_ctx_t *ctx, unsigned int rate, unsigned int channels, size_t max_frames) {
+    synth_config_t synth_config;
+    size_t samples = max_frames * channels;
+
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->rate = rate;
+    ctx->channels = channels;
+    ctx->ring_size = (size_t)rate * channels;
+    ctx->input = malloc(samples * sizeof(int16_t));
+    ctx->input32 = malloc(samples * sizeof(int32_t));
+    ctx->output = malloc(samples * sizeof(int16_t));
+    ctx->output_f = malloc(samples * sizeof(float));
+    ctx->ring = calloc(ctx->ring_size, sizeof(int16_t));
+    ctx->encoded = malloc(codec_max_block_bytes(channels, CODEC_BLOCK_FRAMES));
+    ctx->encoder = codec_encoder_create(channels, CODEC_BLOCK_FRAMES);
+
+    synth_default_config(&synth_config, rate, channels);
+    ctx->synth = synth_create(&synth_config);
+
+    unsigned int decimation = band_plan_decimation(rate, 18000.0, 22000.0, 1000.0);
+    if (decimation) {
+        ctx->band = band_filter_create(rate, channels, 18000.0, 22000.0, 1000.0, decimation);
+    }
+
+    // Band plus two Goertzel bins, as for an FSK beacon
+    gate_config_t gate_config;
+    gate_default_config(&gate_config, rate, channels);
+    gate_config.tones_hz[gate_config.n_tones++] = 18500.0;
+    gate_config.tones_hz[gate_config.n_tones++] = 18700.0;
+    if (rate > 2 * gate_config.tones_hz[1]) {
+        ctx->gate = gate_create(&gate_config);
+    }
+
+    if (!ctx->input || !ctx->input32 || !ctx->output || !ctx->output_f || !ctx->ring ||
+        !ctx->encoded || !ctx->encoder || !ctx->synth) {
+        return -1;
+    }
+
+    // Realistic input: the codec's cost depends on the signal
+    synth_generate(ctx->synth, ctx->input, max_frames);
+    for (size_t i = 0; i < samples; i++) {
+        ctx->input32[i] = (int32_t)ctx->input[i] << 16;
+    }
+    return 0;
+}
+
+static void free_ctx(bench_ctx_t *ctx) {
+    free(ctx->input);
+    free(ctx->input32);
+    free(ctx->output);
+    free(ctx->output_f);
+    free(ctx->ring);
+    free(ctx->encoded);
+    codec_encoder_destroy(ctx->encoder);
+    band_filter_destroy(ctx->band);
+    gate_destroy(ctx->gate);
+    synth_destroy(ctx->synth);
+}
+
+static void print_usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --frames N[,N...]     Period sizes in frames (default: 256,1024,2048,8192,32768)\n"
+            "  --channels N[,N...]   Channel counts (default: 1,8)\n"
+            "  --rate HZ             Sample rate for rate-dependent kernels (default: 44100)\n"
+            "  --time SEC            Measurement time per case (default: 0.1)\n"
+            "  --kernel NAME         Only run kernels whose name contains NAME\n"
+            "  --csv                 CSV instead of JSON lines\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    static const struct option long_options[] = {
+        {"frames",   required_argument, NULL, 'f'},
+        {"channels", required_argument, NULL, 'c'},
+        {"rate",     required_argument, NULL, 'r'},
+        {"time",     required_argument, NULL, 't'},
+        {"kernel",   required_argument, NULL, 'k'},
+        {"csv",      no_argument,       NULL, 'v'},
+        {"help",     no_argument,       NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    size_t frame_sizes[BENCH_MAX_SIZES] = {256, 1024, 2048, 8192, 32768};
+    size_t channel_counts[BENCH_MAX_SIZES] = {1, 8};
+    int n_frame_sizes = 5;
+    int n_channel_counts = 2;
+    unsigned int rate = 44100;
+    double min_sec = 0.1;
+    const char *filter = NULL;
+    int csv = 0;
+    int fds[2];
+    pthread_t drainer;
+    char cpu[128];
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'f':
+            n_frame_sizes = parse_list(optarg, frame_sizes, BENCH_MAX_SIZES);
+            break;
+        case 'c':
+            n_channel_counts = parse_list(optarg, channel_counts, BENCH_MAX_SIZES);
+            break;
+        case 'r':
+            rate = (unsigned int)strtoul(optarg, NULL, 10);
+            break;
+        case 't':
+            min_sec = atof(optarg);
+            break;
+        case 'k':
+            filter = optarg;
+            break;
+        case 'v':
+            csv = 1;
+            break;
+        case 'h':
+        default:
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (n_frame_sizes <= 0 || n_channel_counts <= 0 || rate == 0 || min_sec <= 0.0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    double top_freq = synth_top_freq(rate);
+    if (rate <= 2.0 * top_freq) {
+        fprintf(stderr, "[ERROR] --rate %u is too low: the synthetic input reaches %.0f Hz, "
+                "which needs a rate above %.0f Hz\n", rate, top_freq, 2.0 * top_freq);
+        return 1;
+    }
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0 ||
+        pthread_create(&drainer, NULL, drain_thread, &fds[1]) != 0) {
+        fprintf(stderr, "[ERROR] Cannot set up socket pair: %s\n", strerror(errno));
+        return 1;
+    }
+
+    cpu_model(cpu, sizeof(cpu));
+    if (csv) {
+        printf("kernel,frames,channels,ns_per_sample,gb_per_s,iterations\n");
+    } else {
+        printf("{\"bench\":\"capture\",\"cpu\":\"%s\",\"rate\":%u,\"repetitions\":%d}\n",
+               cpu, rate, BENCH_REPETITIONS);
+    }
+
+    for (int ci = 0; ci < n_channel_counts; ci++) {
+        size_t max_frames = 0;
+        for (int fi = 0; fi < n_frame_sizes; fi++) {
+            if (frame_sizes[fi] > max_frames) {
+                max_frames = frame_sizes[fi];
+            }
+        }
+
+        bench_ctx_t ctx;
+        if (setup_ctx(&ctx, rate, (unsigned int)channel_counts[ci], max_frames) < 0) {
+            fprintf(stderr, "[ERROR] Cannot allocate benchmark buffers\n");
+            free_ctx(&ctx);
+            return 1;
+        }
+        ctx.send_fd = fds[0];
+
+        for (size_t ki = 0; ki < sizeof(kernels) / sizeof(kernels[0]); ki++) {
+            const kernel_t *k = &kernels[ki];
+            if (filter && !strstr(k->name, filter)) {
+                continue;
+            }
+            if ((k->run == kernel_band_decimate && !ctx.band) || (k->run == kernel_gate_process && !ctx.gate)) {
+                continue;
+            }
+
+            for (int fi = 0; fi < n_frame_sizes; fi++) {
+                uint64_t iterations;
+                double ns, samples, ns_per_sample, gb_per_s;
+
+                ctx.frames = frame_sizes[fi];
+                ns = time_kernel(k, &ctx, min_sec, &iterations);
+                samples = (double)ctx.frames * ctx.channels;
+                ns_per_sample = ns / samples;
+                gb_per_s = samples * sizeof(int16_t) / ns;
+
+                if (csv) {
+                    printf("%s,%zu,%u,%.4f,%.3f,%llu\n", k->name, ctx.frames, ctx.channels,
+                           ns_per_sample, gb_per_s, (unsigned long long)iterations);
+                } else {
+                    printf("{\"kernel\":\"%s\",\"frames\":%zu,\"channels\":%u,\"ns_per_sample\":%.4f,"
+                           "\"gb_per_s\":%.3f,\"iterations\":%llu}\n",
+                           k->name, ctx.frames, ctx.channels, ns_per_sample, gb_per_s,
+                           (unsigned long long)iterations);
+                }
+                fflush(stdout);
+            }
+        }
+        free_ctx(&ctx);
+    }
+
+    shutdown(fds[0], SHUT_WR);
+    pthread_join(drainer, NULL);
+    close(fds[0]);
+    close(fds[1]);
+    return 0;
+}
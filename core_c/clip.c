@@ -0,0 +1,391 @@
+/*
+ * SilentTrace - Ultrasonic Signal Detector
+ * Trigger-Driven Evidence Clip Recorder
+ *
+ * The capture thread owns the pre-trigger ring and the clip slots while
+ * they are FREE or RECORDING; a finished slot is published as PENDING and
+ * the writer thread turns it into a WAV file before handing it back. Slot
+ * memory is allocated and touched up front, so a trigger costs one copy
+ * out of the ring and never allocates or touches the disk.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "clip.h"
+#include "log.h"
+#include "wav.h"
+
+#define CLIP_IDLE_WAIT_MS 200
+
+enum {
+    CLIP_FREE,
+    CLIP_RECORDING,
+    CLIP_PENDING
+};
+
+typedef struct {
+    int16_t *samples;           // interleaved
+    size_t capacity;            // frames
+    size_t length;              // frames collected
+    uint64_t start_frame;       // stream frame index of samples[0]
+    uint64_t end_frame;         // stream frame index where the clip stops
+    uint64_t trigger_ms;
+    uint64_t start_ms;
+    int state;                  // CLIP_*, accessed atomically
+} clip_slot_t;
+
+struct clip_recorder {
+    clip_config_t cfg;
+    char directory[PATH_MAX / 2];
+    size_t frame_bytes;
+
+    int16_t *ring;
+    size_t ring_frames;
+    uint64_t total_frames;      // frames written since start
+    uint64_t last_timestamp_ms; // wall clock at the end of the last write
+
+    clip_slot_t slots[CLIP_MAX_ACTIVE];
+
+    pthread_t writer;
+    int writer_started;
+    sem_t wakeup;
+    int stopping;
+
+    uint64_t stat_clips_written;
+    uint64_t stat_triggers_merged;
+    uint64_t stat_triggers_dropped;
+    uint64_t stat_write_errors;
+};
+
+static uint64_t realtime_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint64_t sec_to_frames(double sec, unsigned int sample_rate) {
+    return sec > 0.0 ? (uint64_t)(sec * sample_rate + 0.5) : 0;
+}
+
+void clip_default_config(clip_config_t *cfg, const char *directory,
+                         unsigned int sample_rate, unsigned int channels) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->directory = directory;
+    cfg->sample_rate = sample_rate;
+    cfg->channels = channels;
+    cfg->pre_trigger_sec = 10.0;
+    cfg->post_trigger_sec = 10.0;
+    cfg->max_latency_sec = 5.0;
+}
+
+// Copy stream frames [from, to) out of the pre-trigger ring
+static void copy_from_ring(clip_recorder_t *rec, int16_t *dst, uint64_t from, uint64_t to) {
+    size_t count = (size_t)(to - from);
+    size_t pos = (size_t)(from % rec->ring_frames);
+    size_t first = rec->ring_frames - pos;
+
+    if (first > count) {
+        first = count;
+    }
+    memcpy(dst, rec->ring + pos * rec->cfg.channels, first * rec->frame_bytes);
+    if (count > first) {
+        memcpy(dst + first * rec->cfg.channels, rec->ring, (count - first) * rec->frame_bytes);
+    }
+}
+
+static void publish_slot(clip_recorder_t *rec, clip_slot_t *slot) {
+    __atomic_store_n(&slot->state, CLIP_PENDING, __ATOMIC_RELEASE);
+    sem_post(&rec->wakeup);
+}
+
+void clip_write(clip_recorder_t *rec, const int16_t *frames, size_t n_frames) {
+    uint64_t block_start = rec->total_frames;
+    uint64_t block_end = block_start + n_frames;
+    size_t done = 0;
+
+    // Pre-trigger ring
+    while (done < n_frames) {
+        size_t pos = (size_t)((block_start + done) % rec->ring_frames);
+        size_t chunk = rec->ring_frames - pos;
+        if (chunk > n_frames - done) {
+            chunk = n_frames - done;
+        }
+        memcpy(rec->ring + pos * rec->cfg.channels, frames + done * rec->cfg.channels,
+               chunk * rec->frame_bytes);
+        done += chunk;
+    }
+    rec->total_frames = block_end;
+    rec->last_timestamp_ms = realtime_ms();
+
+    // Post-trigger audio for clips in progress
+    for (int i = 0; i < CLIP_MAX_ACTIVE; i++) {
+        clip_slot_t *slot = &rec->slots[i];
+        if (__atomic_load_n(&slot->state, __ATOMIC_RELAXED) != CLIP_RECORDING) {
+            continue;
+        }
+
+        uint64_t next = slot->start_frame + slot->length;
+        uint64_t from = next > block_start ? next : block_start;
+        uint64_t to = slot->end_frame < block_end ? slot->end_frame : block_end;
+
+        if (to > from) {
+            memcpy(slot->samples + slot->length * rec->cfg.channels,
+                   frames + (from - block_start) * rec->cfg.channels,
+                   (size_t)(to - from) * rec->frame_bytes);
+            slot->length += (size_t)(to - from);
+        }
+        if (slot->start_frame + slot->length >= slot->end_frame) {
+            publish_slot(rec, slot);
+        }
+    }
+}
+
+int clip_trigger(clip_recorder_t *rec, uint64_t timestamp_ms) {
+    unsigned int rate = rec->cfg.sample_rate;
+    uint64_t pre = sec_to_frames(rec->cfg.pre_trigger_sec, rate);
+    uint64_t post = sec_to_frames(rec->cfg.post_trigger_sec, rate);
+    uint64_t trigger_frame = rec->total_frames;
+    uint64_t oldest;
+    uint64_t start;
+    clip_slot_t *slot = NULL;
+
+    // Map the wall-clock trigger time onto the stream frame index
+    if (timestamp_ms < rec->last_timestamp_ms) {
+        uint64_t behind = (rec->last_timestamp_ms - timestamp_ms) * rate / 1000;
+        trigger_frame = behind < trigger_frame ? trigger_frame - behind : 0;
+    }
+    start = trigger_frame > pre ? trigger_frame - pre : 0;
+
+    // A trigger that overlaps a clip in progress extends it instead
+    for (int i = 0; i < CLIP_MAX_ACTIVE; i++) {
+        clip_slot_t *s = &rec->slots[i];
+        if (__atomic_load_n(&s->state, __ATOMIC_RELAXED) == CLIP_RECORDING && start <= s->end_frame) {
+            uint64_t limit = s->start_frame + s->capacity;
+            uint64_t end = trigger_frame + post;
+            if (end > s->end_frame) {
+                s->end_frame = end < limit ? end : limit;
+            }
+            __atomic_fetch_add(&rec->stat_triggers_merged, 1, __ATOMIC_RELAXED);
+            return 0;
+        }
+    }
+
+    for (int i = 0; i < CLIP_MAX_ACTIVE; i++) {
+        if (__atomic_load_n(&rec->slots[i].state, __ATOMIC_ACQUIRE) == CLIP_FREE) {
+            slot = &rec->slots[i];
+            break;
+        }
+    }
+    if (!slot) {
+        __atomic_fetch_add(&rec->stat_triggers_dropped, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+
+    oldest = rec->total_frames > rec->ring_frames ? rec->total_frames - rec->ring_frames : 0;
+    if (start < oldest) {
+        start = oldest;
+    }
+    if (start > rec->total_frames) {
+        start = rec->total_frames;
+    }
+
+    slot->start_frame = start;
+    slot->end_frame = trigger_frame + post;
+    if (slot->end_frame > start + slot->capacity) {
+        slot->end_frame = start + slot->capacity;
+    }
+    slot->length = (size_t)(rec->total_frames - start);
+    if (slot->length > slot->capacity) {
+        slot->length = slot->capacity;
+    }
+    copy_from_ring(rec, slot->samples, start, start + slot->length);
+    slot->trigger_ms = timestamp_ms;
+    slot->start_ms = timestamp_ms - (trigger_frame - start) * 1000 / rate;
+
+    if (slot->start_frame + slot->length >= slot->end_frame) {
+        publish_slot(rec, slot);
+    } else {
+        __atomic_store_n(&slot->state, CLIP_RECORDING, __ATOMIC_RELAXED);
+    }
+    return 0;
+}
+
+static int write_wav(clip_recorder_t *rec, const clip_slot_t *slot) {
+    char path[PATH_MAX];
+    char tmp_path[PATH_MAX];
+    uint8_t hdr[WAV_HEADER_BYTES];
+    FILE *f;
+
+    snprintf(path, sizeof(path), "%s/clip_%013llu.wav", rec->directory,
+             (unsigned long long)slot->trigger_ms);
+    snprintf(tmp_path, sizeof(tmp_path), "%s/.clip_%013llu.wav.tmp", rec->directory,
+             (unsigned long long)slot->trigger_ms);
+
+    if (wav_header(hdr, rec->cfg.sample_rate, rec->cfg.channels, slot->length) < 0) {
+        log_error("Clip %s exceeds the 4GB WAV limit", path);
+        return -1;
+    }
+
+    f = fopen(tmp_path, "wb");
+    if (!f) {
+        log_error("Cannot create clip %s: %s", tmp_path, strerror(errno));
+        return -1;
+    }
+    if (fwrite(hdr, 1, sizeof(hdr), f) != sizeof(hdr) ||
+        fwrite(slot->samples, rec->frame_bytes, slot->length, f) != slot->length) {
+        log_error("Cannot write clip %s: %s", tmp_path, strerror(errno));
+        fclose(f);
+        remove(tmp_path);
+        return -1;
+    }
+    if (fclose(f) != 0 || rename(tmp_path, path) != 0) {
+        log_error("Cannot finalize clip %s: %s", path, strerror(errno));
+        remove(tmp_path);
+        return -1;
+    }
+
+    log_info("Saved evidence clip %s (%.1fs)", path,
+            (double)slot->length / rec->cfg.sample_rate);
+    return 0;
+}
+
+static void *writer_thread(void *arg) {
+    clip_recorder_t *rec = arg;
+
+    for (;;) {
+        int stopping = __atomic_load_n(&rec->stopping, __ATOMIC_ACQUIRE);
+        int pending = 0;
+
+        for (int i = 0; i < CLIP_MAX_ACTIVE; i++) {
+            clip_slot_t *slot = &rec->slots[i];
+            if (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) != CLIP_PENDING) {
+                continue;
+            }
+            if (write_wav(rec, slot) == 0) {
+                __atomic_fetch_add(&rec->stat_clips_written, 1, __ATOMIC_RELAXED);
+            } else {
+                __atomic_fetch_add(&rec->stat_write_errors, 1, __ATOMIC_RELAXED);
+            }
+            __atomic_store_n(&slot->state, CLIP_FREE, __ATOMIC_RELEASE);
+            pending = 1;
+        }
+
+        if (stopping && !pending) {
+            break;
+        }
+        if (!pending) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += CLIP_IDLE_WAIT_MS * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_nsec -= 1000000000L;
+                deadline.tv_sec++;
+            }
+            sem_timedwait(&rec->wakeup, &deadline);
+        }
+    }
+
+    return NULL;
+}
+
+clip_recorder_t *clip_open(const clip_config_t *cfg) {
+    clip_recorder_t *rec;
+    size_t capacity;
+
+    if (!cfg->directory || cfg->sample_rate == 0 || cfg->channels == 0 ||
+        cfg->pre_trigger_sec < 0.0 || cfg->post_trigger_sec <= 0.0) {
+        log_error("Invalid clip configuration");
+        return NULL;
+    }
+    if (mkdir(cfg->directory, 0755) < 0 && errno != EEXIST) {
+        log_error("Cannot create clip directory %s: %s", cfg->directory, strerror(errno));
+        return NULL;
+    }
+
+    rec = calloc(1, sizeof(*rec));
+    if (!rec) {
+        return NULL;
+    }
+    rec->cfg = *cfg;
+    snprintf(rec->directory, sizeof(rec->directory), "%s", cfg->directory);
+    rec->cfg.directory = rec->directory;
+    rec->frame_bytes = (size_t)cfg->channels * sizeof(int16_t);
+
+    // The ring must cover the pre-trigger window plus the analyzer's delay
+    rec->ring_frames = (size_t)sec_to_frames(cfg->pre_trigger_sec + cfg->max_latency_sec, cfg->sample_rate);
+    if (rec->ring_frames == 0) {
+        rec->ring_frames = 1;
+    }
+    // Room for merged triggers to extend a clip by another post window
+    capacity = rec->ring_frames + (size_t)sec_to_frames(2.0 * cfg->post_trigger_sec, cfg->sample_rate);
+
+    rec->ring = calloc(rec->ring_frames, rec->frame_bytes);
+    if (!rec->ring) {
+        clip_close(rec);
+        return NULL;
+    }
+    for (int i = 0; i < CLIP_MAX_ACTIVE; i++) {
+        rec->slots[i].capacity = capacity;
+        rec->slots[i].samples = malloc(capacity * rec->frame_bytes);
+        if (!rec->slots[i].samples) {
+            log_error("Cannot allocate clip buffers");
+            clip_close(rec);
+            return NULL;
+        }
+        memset(rec->slots[i].samples, 0, capacity * rec->frame_bytes);
+    }
+
+    sem_init(&rec->wakeup, 0, 0);
+    if (pthread_create(&rec->writer, NULL, writer_thread, rec) != 0) {
+        log_error("Cannot start clip writer thread");
+        sem_destroy(&rec->wakeup);
+        clip_close(rec);
+        return NULL;
+    }
+    rec->writer_started = 1;
+
+    log_info("Evidence clips enabled in %s: %.1fs pre-trigger, %.1fs post-trigger",
+            rec->directory, cfg->pre_trigger_sec, cfg->post_trigger_sec);
+    return rec;
+}
+
+void clip_get_stats(clip_recorder_t *rec, clip_stats_t *stats) {
+    stats->clips_written = __atomic_load_n(&rec->stat_clips_written, __ATOMIC_RELAXED);
+    stats->triggers_merged = __atomic_load_n(&rec->stat_triggers_merged, __ATOMIC_RELAXED);
+    stats->triggers_dropped = __atomic_load_n(&rec->stat_triggers_dropped, __ATOMIC_RELAXED);
+    stats->write_errors = __atomic_load_n(&rec->stat_write_errors, __ATOMIC_RELAXED);
+}
+
+void clip_close(clip_recorder_t *rec) {
+    if (!rec) {
+        return;
+    }
+
+    if (rec->writer_started) {
+        // Save clips still collecting post-trigger audio with what we have
+        for (int i = 0; i < CLIP_MAX_ACTIVE; i++) {
+            if (__atomic_load_n(&rec->slots[i].state, __ATOMIC_RELAXED) == CLIP_RECORDING) {
+                publish_slot(rec, &rec->slots[i]);
+            }
+        }
+        __atomic_store_n(&rec->stopping, 1, __ATOMIC_RELEASE);
+        sem_post(&rec->wakeup);
+        pthread_join(rec->writer, NULL);
+        sem_destroy(&rec->wakeup);
+    }
+
+    for (int i = 0; i < CLIP_MAX_ACTIVE; i++) {
+        free(rec->slots[i].samples);
+    }
+    free(rec->ring);
+    free(rec);
+}
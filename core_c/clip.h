@@ -0,0 +1,54 @@
+/*
+ * SilentTrace - Ultrasonic Signal Detector
+ * Trigger-Driven Evidence Clip Recorder
+ *
+ * Keeps the last few seconds of audio in memory so that when the analyzer
+ * raises an alert, the audio before and after the trigger can be saved as
+ * a standalone WAV clip. Clip files are written on a background thread.
+ */
+
+#ifndef CLIP_H
+#define CLIP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CLIP_MAX_ACTIVE 4
+
+typedef struct {
+    const char *directory;
+    unsigned int sample_rate;
+    unsigned int channels;
+    double pre_trigger_sec;     // audio kept before the trigger
+    double post_trigger_sec;    // audio recorded after the trigger
+    double max_latency_sec;     // how late a trigger may arrive after its audio
+} clip_config_t;
+
+typedef struct {
+    uint64_t clips_written;
+    uint64_t triggers_merged;   // triggers that extended a clip in progress
+    uint64_t triggers_dropped;  // no free clip buffer
+    uint64_t write_errors;
+} clip_stats_t;
+
+typedef struct clip_recorder clip_recorder_t;
+
+void clip_default_config(clip_config_t *cfg, const char *directory,
+                         unsigned int sample_rate, unsigned int channels);
+
+clip_recorder_t *clip_open(const clip_config_t *cfg);
+
+// Called from the capture thread for every period: feeds the pre-trigger
+// ring and any clips still collecting post-trigger audio
+void clip_write(clip_recorder_t *rec, const int16_t *frames, size_t n_frames);
+
+// Called from the capture thread. timestamp_ms uses the same wall clock as
+// the stream headers; the clip covers [t - pre, t + post].
+int clip_trigger(clip_recorder_t *rec, uint64_t timestamp_ms);
+
+void clip_get_stats(clip_recorder_t *rec, clip_stats_t *stats);
+
+// Finish clips in progress with the audio collected so far and stop
+void clip_close(clip_recorder_t *rec);
+
+#endif
@@ -0,0 +1,689 @@
+/*
+ * SilentTrace - Ultrasonic Signal Detector
+ * Archive Codecs
+ *
+ * Block layout (byte aligned):
+ *   uint32 LE  payload bytes following this prefix
+ *   uint16 LE  frames in the block
+ *   uint16 LE  CODEC_BLOCK_SYNC
+ *   per channel, MSB-first bitstream:
+ *     3 bits   0-4 fixed predictor order, 5 constant, 6 verbatim
+ *     order x 16 bits  warm-up samples (constant: one sample)
+ *     4 bits   partition order p, then for each of the 2^p partitions:
+ *       5 bits Rice parameter k, then zigzag residuals as unary quotient
+ *              + k-bit remainder (32 zeros escape to a raw 32-bit value)
+ *   zero padding to a byte boundary
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "codec.h"
+
+#define TYPE_CONSTANT 5
+#define TYPE_VERBATIM 6
+#define MAX_FIXED_ORDER 4
+#define MAX_PARTITION_ORDER 8
+#define RICE_MAX_PARAM 30
+#define RICE_ESCAPE_QUOTIENT 32
+
+#define BAND_STOPBAND_DB 80.0
+#define BAND_PI 3.14159265358979323846
+
+struct codec_encoder {
+    unsigned int channels;
+    size_t max_frames;
+    int32_t *samples;           // one channel, widened
+    int32_t *residual;
+    uint32_t *zigzag;
+};
+
+typedef struct {
+    uint8_t *buf;
+    size_t pos;
+    uint64_t acc;
+    unsigned int nbits;
+} bit_writer_t;
+
+typedef struct {
+    const uint8_t *buf;
+    size_t len;
+    size_t pos;
+    uint64_t acc;
+    unsigned int nbits;
+} bit_reader_t;
+
+/* ---------- Bit I/O ---------- */
+
+static inline void bw_put(bit_writer_t *bw, uint32_t value, unsigned int bits) {
+    bw->acc = (bw->acc << bits) | (value & ((1ULL << bits) - 1));
+    bw->nbits += bits;
+    while (bw->nbits >= 8) {
+        bw->nbits -= 8;
+        bw->buf[bw->pos++] = (uint8_t)(bw->acc >> bw->nbits);
+    }
+}
+
+static void bw_align(bit_writer_t *bw) {
+    if (bw->nbits) {
+        bw_put(bw, 0, 8 - bw->nbits);
+    }
+}
+
+static inline int br_get(bit_reader_t *br, unsigned int bits, uint32_t *value) {
+    while (br->nbits < bits) {
+        if (br->pos >= br->len) {
+            return -1;
+        }
+        br->acc = (br->acc << 8) | br->buf[br->pos++];
+        br->nbits += 8;
+    }
+    br->nbits -= bits;
+    *value = (uint32_t)((br->acc >> br->nbits) & ((1ULL << bits) - 1));
+    return 0;
+}
+
+static inline int32_t sign_extend16(uint32_t v) {
+    return (int32_t)(int16_t)(uint16_t)v;
+}
+
+/* ---------- Lossless encoder ---------- */
+
+codec_encoder_t *codec_encoder_create(unsigned int channels, size_t max_block_frames) {
+    codec_encoder_t *enc = calloc(1, sizeof(*enc));
+
+    if (!enc || channels == 0 || max_block_frames == 0 || max_block_frames > 65535) {
+        free(enc);
+        return NULL;
+    }
+    enc->channels = channels;
+    enc->max_frames = max_block_frames;
+    enc->samples = malloc(max_block_frames * sizeof(int32_t));
+    enc->residual = malloc(max_block_frames * sizeof(int32_t));
+    enc->zigzag = malloc(max_block_frames * sizeof(uint32_t));
+    if (!enc->samples || !enc->residual || !enc->zigzag) {
+        codec_encoder_destroy(enc);
+        return NULL;
+    }
+    return enc;
+}
+
+void codec_encoder_destroy(codec_encoder_t *enc) {
+    if (!enc) {
+        return;
+    }
+    free(enc->samples);
+    free(enc->residual);
+    free(enc->zigzag);
+    free(enc);
+}
+
+size_t codec_max_block_bytes(unsigned int channels, size_t frames) {
+    // Every channel is at most a verbatim subframe
+    return CODEC_BLOCK_PREFIX_BYTES + (channels * (3 + 16 * frames) + 7) / 8;
+}
+
+static unsigned int choose_fixed_order(const int32_t *x, size_t n) {
+    uint64_t sum[MAX_FIXED_ORDER + 1] = {0, 0, 0, 0, 0};
+    unsigned int best = 0;
+
+    if (n <= MAX_FIXED_ORDER) {
+        return 0;
+    }
+    for (size_t i = MAX_FIXED_ORDER; i < n; i++) {
+        int64_t e0 = x[i];
+        int64_t e1 = e0 - x[i - 1];
+        int64_t e2 = e1 - (x[i - 1] - x[i - 2]);
+        int64_t e3 = e2 - (x[i - 1] - 2 * (int64_t)x[i - 2] + x[i - 3]);
+        int64_t e4 = e3 - (x[i - 1] - 3 * (int64_t)x[i - 2] + 3 * (int64_t)x[i - 3] - x[i - 4]);
+        sum[0] += (uint64_t)llabs(e0);
+        sum[1] += (uint64_t)llabs(e1);
+        sum[2] += (uint64_t)llabs(e2);
+        sum[3] += (uint64_t)llabs(e3);
+        sum[4] += (uint64_t)llabs(e4);
+    }
+    for (unsigned int o = 1; o <= MAX_FIXED_ORDER; o++) {
+        if (sum[o] < sum[best]) {
+            best = o;
+        }
+    }
+    return best;
+}
+
+static void compute_residual(const int32_t *x, size_t n, unsigned int order, int32_t *res) {
+    size_t i;
+
+    switch (order) {
+    case 0:
+        for (i = 0; i < n; i++) res[i] = x[i];
+        break;
+    case 1:
+        for (i = 1; i < n; i++) res[i] = x[i] - x[i - 1];
+        break;
+    case 2:
+        for (i = 2; i < n; i++) res[i] = x[i] - 2 * x[i - 1] + x[i - 2];
+        break;
+    case 3:
+        for (i = 3; i < n; i++) res[i] = x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3];
+        break;
+    default:
+        for (i = 4; i < n; i++) res[i] = x[i] - 4 * x[i - 1] + 6 * x[i - 2] - 4 * x[i - 3] + x[i - 4];
+        break;
+    }
+}
+
+static unsigned int rice_param(uint64_t sum, size_t count) {
+    unsigned int k = 0;
+    while (k < RICE_MAX_PARAM && ((uint64_t)count << (k + 1)) < sum) {
+        k++;
+    }
+    return k;
+}
+
+static uint64_t rice_cost(uint64_t sum, size_t count, unsigned int k) {
+    return 5 + count * (k + 1) + (sum >> k);
+}
+
+// Partition layout: n / 2^p samples per partition, the first one minus the
+// warm-up samples. Returns the cheapest order and fills params.
+static unsigned int choose_partitions(const uint32_t *zz, size_t n, unsigned int order, unsigned int *params) {
+    uint64_t sums[1u << MAX_PARTITION_ORDER];
+    unsigned int max_p = 0;
+    unsigned int best_p = 0;
+    uint64_t best_cost = UINT64_MAX;
+
+    while (max_p < MAX_PARTITION_ORDER && (n % (2u << max_p)) == 0 && (n >> (max_p + 1)) > order) {
+        max_p++;
+    }
+
+    // Sums at the finest partitioning, merged pairwise for coarser ones
+    size_t part = n >> max_p;
+    for (size_t j = 0; j < (1u << max_p); j++) {
+        size_t start = j == 0 ? order : j * part;
+        uint64_t s = 0;
+        for (size_t i = start; i < (j + 1) * part; i++) {
+            s += zz[i];
+        }
+        sums[j] = s;
+    }
+
+    for (int p = (int)max_p; p >= 0; p--) {
+        size_t parts = 1u << p;
+        size_t psize = n >> p;
+        uint64_t cost = 0;
+
+        if (p != (int)max_p) {
+            for (size_t j = 0; j < parts; j++) {
+                sums[j] = sums[2 * j] + sums[2 * j + 1];
+            }
+        }
+        for (size_t j = 0; j < parts; j++) {
+            size_t count = j == 0 ? psize - order : psize;
+            cost += rice_cost(sums[j], count, rice_param(sums[j], count));
+        }
+        if (cost < best_cost) {
+            best_cost = cost;
+            best_p = (unsigned int)p;
+            for (size_t j = 0; j < parts; j++) {
+                size_t count = j == 0 ? psize - order : psize;
+                params[j] = rice_param(sums[j], count);
+            }
+        }
+    }
+    return best_p;
+}
+
+// Exact size of the Rice-coded residuals with the chosen parameters
+static uint64_t coded_bits(const uint32_t *zz, size_t n, unsigned int order, unsigned int p,
+                           const unsigned int *params) {
+    size_t psize = n >> p;
+    uint64_t bits = 3 + 16 * order + 4;
+
+    for (size_t j = 0; j < (1u << p); j++) {
+        unsigned int k = params[j];
+        bits += 5;
+        for (size_t i = j == 0 ? order : j * psize; i < (j + 1) * psize; i++) {
+            uint32_t q = zz[i] >> k;
+            bits += q < RICE_ESCAPE_QUOTIENT ? q + 1 + k : RICE_ESCAPE_QUOTIENT + 32;
+        }
+    }
+    return bits;
+}
+
+static void encode_channel(codec_encoder_t *enc, bit_writer_t *bw, size_t n) {
+    const int32_t *x = enc->samples;
+    unsigned int params[1u << MAX_PARTITION_ORDER];
+    unsigned int order;
+    unsigned int p;
+    size_t i;
+
+    for (i = 1; i < n && x[i] == x[0]; i++) {
+    }
+    if (i == n) {
+        bw_put(bw, TYPE_CONSTANT, 3);
+        bw_put(bw, (uint32_t)x[0], 16);
+        return;
+    }
+
+    order = choose_fixed_order(x, n);
+    compute_residual(x, n, order, enc->residual);
+    for (i = order; i < n; i++) {
+        int32_t r = enc->residual[i];
+        enc->zigzag[i] = ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+    }
+    p = choose_partitions(enc->zigzag, n, order, params);
+
+    // Noise-like channels can cost more than raw samples: store verbatim,
+    // which also bounds the block size (see codec_max_block_bytes)
+    if (coded_bits(enc->zigzag, n, order, p, params) >= 3 + 16 * (uint64_t)n) {
+        bw_put(bw, TYPE_VERBATIM, 3);
+        for (i = 0; i < n; i++) {
+            bw_put(bw, (uint32_t)x[i], 16);
+        }
+        return;
+    }
+
+    bw_put(bw, order, 3);
+    for (i = 0; i < order; i++) {
+        bw_put(bw, (uint32_t)x[i], 16);
+    }
+    bw_put(bw, p, 4);
+
+    size_t psize = n >> p;
+    for (size_t j = 0; j < (1u << p); j++) {
+        unsigned int k = params[j];
+        bw_put(bw, k, 5);
+        for (i = j == 0 ? order : j * psize; i < (j + 1) * psize; i++) {
+            uint32_t u = enc->zigzag[i];
+            uint32_t q = u >> k;
+            if (q < RICE_ESCAPE_QUOTIENT) {
+                bw_put(bw, 1, q + 1);
+                if (k) {
+                    bw_put(bw, u, k);
+                }
+            } else {
+                bw_put(bw, 0, RICE_ESCAPE_QUOTIENT);
+                bw_put(bw, u, 32);
+            }
+        }
+    }
+}
+
+size_t codec_encode_block(codec_encoder_t *enc, const int16_t *frames, size_t n_frames, uint8_t *out) {
+    bit_writer_t bw = {out + CODEC_BLOCK_PREFIX_BYTES, 0, 0, 0};
+    unsigned int nch = enc->channels;
+
+    if (n_frames > enc->max_frames) {
+        n_frames = enc->max_frames;
+    }
+
+    for (unsigned int c = 0; c < nch; c++) {
+        for (size_t i = 0; i < n_frames; i++) {
+            enc->samples[i] = frames[i * nch + c];
+        }
+        encode_channel(enc, &bw, n_frames);
+    }
+    bw_align(&bw);
+
+    out[0] = (uint8_t)bw.pos;
+    out[1] = (uint8_t)(bw.pos >> 8);
+    out[2] = (uint8_t)(bw.pos >> 16);
+    out[3] = (uint8_t)(bw.pos >> 24);
+    out[4] = (uint8_t)n_frames;
+    out[5] = (uint8_t)(n_frames >> 8);
+    out[6] = (uint8_t)CODEC_BLOCK_SYNC;
+    out[7] = (uint8_t)(CODEC_BLOCK_SYNC >> 8);
+
+    return CODEC_BLOCK_PREFIX_BYTES + bw.pos;
+}
+
+/* ---------- Lossless decoder ---------- */
+
+static int decode_channel(bit_reader_t *br, int16_t *out, unsigned int stride, size_t n) {
+    uint32_t v;
+    unsigned int type;
+    unsigned int p;
+    int32_t hist[MAX_FIXED_ORDER];
+    size_t i;
+
+    if (br_get(br, 3, &v) < 0) {
+        return -1;
+    }
+    type = v;
+
+    if (type == TYPE_CONSTANT) {
+        if (br_get(br, 16, &v) < 0) {
+            return -1;
+        }
+        for (i = 0; i < n; i++) {
+            out[i * stride] = (int16_t)sign_extend16(v);
+        }
+        return 0;
+    }
+    if (type == TYPE_VERBATIM) {
+        for (i = 0; i < n; i++) {
+            if (br_get(br, 16, &v) < 0) {
+                return -1;
+            }
+            out[i * stride] = (int16_t)sign_extend16(v);
+        }
+        return 0;
+    }
+    if (type > MAX_FIXED_ORDER || n <= type) {
+        return -1;
+    }
+
+    for (i = 0; i < type; i++) {
+        if (br_get(br, 16, &v) < 0) {
+            return -1;
+        }
+        hist[i] = sign_extend16(v);
+        out[i * stride] = (int16_t)hist[i];
+    }
+    if (br_get(br, 4, &v) < 0) {
+        return -1;
+    }
+    p = v;
+    if ((n >> p) << p != n || (n >> p) <= type) {
+        return -1;
+    }
+
+    size_t psize = n >> p;
+    for (size_t j = 0; j < (1u << p); j++) {
+        uint32_t k;
+        if (br_get(br, 5, &k) < 0) {
+            return -1;
+        }
+        for (i = j == 0 ? type : j * psize; i < (j + 1) * psize; i++) {
+            uint32_t q = 0;
+            uint32_t bit;
+            uint32_t u;
+
+            for (;;) {
+                if (br_get(br, 1, &bit) < 0) {
+                    return -1;
+                }
+                if (bit) {
+                    break;
+                }
+                if (++q == RICE_ESCAPE_QUOTIENT) {
+                    break;
+                }
+            }
+            if (q == RICE_ESCAPE_QUOTIENT) {
+                if (br_get(br, 32, &u) < 0) {
+                    return -1;
+                }
+            } else {
+                uint32_t rem = 0;
+                if (k && br_get(br, k, &rem) < 0) {
+                    return -1;
+                }
+                u = (q << k) | rem;
+            }
+
+            int32_t r = (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+            int32_t x;
+            switch (type) {
+            case 0: x = r; break;
+            case 1: x = r + hist[0]; break;
+            case 2: x = r + 2 * hist[1] - hist[0]; break;
+            case 3: x = r + 3 * hist[2] - 3 * hist[1] + hist[0]; break;
+            default: x = r + 4 * hist[3] - 6 * hist[2] + 4 * hist[1] - hist[0]; break;
+            }
+            if (type > 0) {
+                memmove(hist, hist + 1, (type - 1) * sizeof(int32_t));
+                hist[type - 1] = x;
+            }
+            out[i * stride] = (int16_t)x;
+        }
+    }
+    return 0;
+}
+
+long codec_decode_block(const uint8_t *in, size_t in_len, unsigned int channels,
+                        int16_t *frames, size_t max_frames, size_t *n_frames) {
+    size_t payload;
+    size_t n;
+    bit_reader_t br;
+
+    if (in_len < CODEC_BLOCK_PREFIX_BYTES) {
+        return -1;
+    }
+    payload = (size_t)in[0] | ((size_t)in[1] << 8) | ((size_t)in[2] << 16) | ((size_t)in[3] << 24);
+    n = (size_t)in[4] | ((size_t)in[5] << 8);
+    if (((unsigned int)in[6] | ((unsigned int)in[7] << 8)) != CODEC_BLOCK_SYNC ||
+        payload > in_len - CODEC_BLOCK_PREFIX_BYTES || n > max_frames) {
+        return -1;
+    }
+
+    br.buf = in + CODEC_BLOCK_PREFIX_BYTES;
+    br.len = payload;
+    br.pos = 0;
+    br.acc = 0;
+    br.nbits = 0;
+
+    for (unsigned int c = 0; c < channels; c++) {
+        if (decode_channel(&br, frames + c, channels, n) < 0) {
+            return -1;
+        }
+    }
+
+    *n_frames = n;
+    return (long)(CODEC_BLOCK_PREFIX_BYTES + payload);
+}
+
+/* ---------- Band decimation ---------- */
+
+struct band_filter {
+    unsigned int channels;
+    unsigned int decimation;
+    size_t taps;
+    float *h;                   // symmetric bandpass, unity passband gain
+    float *history;             // per channel, 2 x taps (mirrored ring)
+    size_t pos;
+    unsigned int phase;
+
+    size_t poly_len;            // taps per interpolation phase
+    float *poly;                // decimation x poly_len, reversed, scaled
+    float *expand_history;      // per channel, 2 x poly_len
+    size_t expand_pos;
+};
+
+static double bessel_i0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 50; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < 1e-12 * sum) {
+            break;
+        }
+    }
+    return sum;
+}
+
+unsigned int band_plan_decimation(unsigned int sample_rate, double low_hz, double high_hz,
+                                  double transition_hz) {
+    double nyquist = sample_rate / 2.0;
+    double lo = low_hz - transition_hz;
+    double hi = high_hz + transition_hz;
+
+    if (lo < 0.0 || low_hz >= high_hz || high_hz > nyquist) {
+        return 0;
+    }
+    if (hi > nyquist) {
+        hi = nyquist;
+    }
+
+    for (unsigned int m = (unsigned int)(nyquist / (hi - lo)); m >= 1; m--) {
+        double zone = nyquist / m;
+        double z = floor(lo / zone);
+        if (hi <= (z + 1.0) * zone + 1e-9) {
+            return m;
+        }
+    }
+    return 0;
+}
+
+band_filter_t *band_filter_create(unsigned int sample_rate, unsigned int channels,
+                                  double low_hz, double high_hz, double transition_hz,
+                                  unsigned int decimation) {
+    band_filter_t *bf;
+    double dw = 2.0 * BAND_PI * transition_hz / sample_rate;
+    double beta = 0.1102 * (BAND_STOPBAND_DB - 8.7);
+    double f_lo = (low_hz - transition_hz / 2.0) / sample_rate;
+    double f_hi = (high_hz + transition_hz / 2.0) / sample_rate;
+    size_t taps;
+
+    if (decimation == 0 || channels == 0 || transition_hz <= 0.0) {
+        return NULL;
+    }
+    if (f_hi > 0.5) {
+        f_hi = 0.5;
+    }
+
+    taps = (size_t)ceil((BAND_STOPBAND_DB - 8.0) / (2.285 * dw)) + 1;
+    taps |= 1;  // odd length: integer group delay
+
+    bf = calloc(1, sizeof(*bf));
+    if (!bf) {
+        return NULL;
+    }
+    bf->channels = channels;
+    bf->decimation = decimation;
+    bf->taps = taps;
+    bf->poly_len = (taps + decimation - 1) / decimation;
+    bf->h = malloc(taps * sizeof(float));
+    bf->history = calloc(2 * taps * channels, sizeof(float));
+    bf->poly = calloc(decimation * bf->poly_len, sizeof(float));
+    bf->expand_history = calloc(2 * bf->poly_len * channels, sizeof(float));
+    if (!bf->h || !bf->history || !bf->poly || !bf->expand_history) {
+        band_filter_destroy(bf);
+        return NULL;
+    }
+
+    // Kaiser-windowed ideal bandpass
+    double center = (taps - 1) / 2.0;
+    double i0_beta = bessel_i0(beta);
+    for (size_t n = 0; n < taps; n++) {
+        double t = n - center;
+        double ideal = t == 0.0 ? 2.0 * (f_hi - f_lo)
+                                : (sin(2.0 * BAND_PI * f_hi * t) - sin(2.0 * BAND_PI * f_lo * t)) / (BAND_PI * t);
+        double r = t / center;
+        double w = bessel_i0(beta * sqrt(1.0 - r * r)) / i0_beta;
+        bf->h[n] = (float)(ideal * w);
+    }
+
+    // Polyphase interpolation filters, reversed to line up with the history
+    for (unsigned int p = 0; p < decimation; p++) {
+        float *poly = bf->poly + p * bf->poly_len;
+        for (size_t j = 0; j < bf->poly_len; j++) {
+            size_t tap = p + j * decimation;
+            poly[bf->poly_len - 1 - j] = tap < taps ? bf->h[tap] * (float)decimation : 0.0f;
+        }
+    }
+
+    return bf;
+}
+
+void band_filter_destroy(band_filter_t *bf) {
+    if (!bf) {
+        return;
+    }
+    free(bf->h);
+    free(bf->history);
+    free(bf->poly);
+    free(bf->expand_history);
+    free(bf);
+}
+
+size_t band_filter_taps(const band_filter_t *bf) {
+    return bf->taps;
+}
+
+void band_filter_reset(band_filter_t *bf) {
+    memset(bf->history, 0, 2 * bf->taps * bf->channels * sizeof(float));
+    memset(bf->expand_history, 0, 2 * bf->poly_len * bf->channels * sizeof(float));
+    bf->pos = 0;
+    bf->phase = 0;
+    bf->expand_pos = 0;
+}
+
+static inline int16_t saturate16(float v) {
+    v = v > 32767.0f ? 32767.0f : (v < -32768.0f ? -32768.0f : v);
+    return (int16_t)lrintf(v);
+}
+
+static inline float dot(const float *a, const float *b, size_t n) {
+    float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    for (; i < n; i++) {
+        s0 += a[i] * b[i];
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+size_t band_decimate(band_filter_t *bf, const int16_t *in, size_t n_frames, int16_t *out) {
+    unsigned int nch = bf->channels;
+    size_t taps = bf->taps;
+    size_t produced = 0;
+
+    for (size_t i = 0; i < n_frames; i++) {
+        size_t pos = bf->pos;
+        for (unsigned int c = 0; c < nch; c++) {
+            float *hist = bf->history + c * 2 * taps;
+            float x = in[i * nch + c];
+            hist[pos] = x;
+            hist[pos + taps] = x;
+        }
+        bf->pos = pos + 1 == taps ? 0 : pos + 1;
+
+        if (++bf->phase == bf->decimation) {
+            bf->phase = 0;
+            // Oldest sample sits at pos + 1; the filter is symmetric, so
+            // no reversal is needed
+            for (unsigned int c = 0; c < nch; c++) {
+                const float *window = bf->history + c * 2 * taps + bf->pos;
+                out[produced * nch + c] = saturate16(dot(bf->h, window, taps));
+            }
+            produced++;
+        }
+    }
+    return produced;
+}
+
+size_t band_expand(band_filter_t *bf, const int16_t *in, size_t n_frames, int16_t *out) {
+    unsigned int nch = bf->channels;
+    unsigned int m = bf->decimation;
+    size_t len = bf->poly_len;
+    size_t produced = 0;
+
+    for (size_t i = 0; i < n_frames; i++) {
+        size_t pos = bf->expand_pos;
+        for (unsigned int c = 0; c < nch; c++) {
+            float *hist = bf->expand_history + c * 2 * len;
+            float x = in[i * nch + c];
+            hist[pos] = x;
+            hist[pos + len] = x;
+        }
+        bf->expand_pos = pos + 1 == len ? 0 : pos + 1;
+
+        for (unsigned int p = 0; p < m; p++) {
+            const float *poly = bf->poly + p * len;
+            for (unsigned int c = 0; c < nch; c++) {
+                const float *window = bf->expand_history + c * 2 * len + bf->expand_pos;
+                out[produced * nch + c] = saturate16(dot(poly, window, len));
+            }
+            produced++;
+        }
+    }
+    return produced;
+}
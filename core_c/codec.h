@@ -0,0 +1,64 @@
+/*
+ * SilentTrace - Ultrasonic Signal Detector
+ * Archive Codecs
+ *
+ * Lossless block coder for S16 audio (fixed polynomial prediction with
+ * partitioned Rice-coded residuals, in the style of FLAC) and a band
+ * decimator that keeps only the ultrasonic band by bandpass filtering and
+ * sampling it down into baseband.
+ *
+ * Every block is self-contained, so any block can be decoded without the
+ * ones before it.
+ */
+
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CODEC_BLOCK_FRAMES 4096
+#define CODEC_BLOCK_SYNC 0xB10Cu
+#define CODEC_BLOCK_PREFIX_BYTES 8
+
+typedef struct codec_encoder codec_encoder_t;
+
+codec_encoder_t *codec_encoder_create(unsigned int channels, size_t max_block_frames);
+void codec_encoder_destroy(codec_encoder_t *enc);
+
+// Worst-case encoded size of one block
+size_t codec_max_block_bytes(unsigned int channels, size_t frames);
+
+// Encode interleaved frames as one block; returns the bytes written to out
+size_t codec_encode_block(codec_encoder_t *enc, const int16_t *frames, size_t n_frames, uint8_t *out);
+
+// Decode one block. Returns the bytes consumed (prefix included), or -1 if
+// the block is truncated or corrupt.
+long codec_decode_block(const uint8_t *in, size_t in_len, unsigned int channels,
+                        int16_t *frames, size_t max_frames, size_t *n_frames);
+
+typedef struct band_filter band_filter_t;
+
+// Largest decimation that keeps [low, high] (plus transition bands) inside a
+// single Nyquist zone of the decimated rate. Returns 0 if the band does not fit.
+unsigned int band_plan_decimation(unsigned int sample_rate, double low_hz, double high_hz,
+                                  double transition_hz);
+
+band_filter_t *band_filter_create(unsigned int sample_rate, unsigned int channels,
+                                  double low_hz, double high_hz, double transition_hz,
+                                  unsigned int decimation);
+void band_filter_destroy(band_filter_t *bf);
+void band_filter_reset(band_filter_t *bf);
+
+// Filter length; decimating and expanding again delays the audio by
+// taps - decimation frames
+size_t band_filter_taps(const band_filter_t *bf);
+
+// Filter and decimate interleaved frames; returns the frames written to out
+size_t band_decimate(band_filter_t *bf, const int16_t *in, size_t n_frames, int16_t *out);
+
+// Interpolate decimated frames back to the original rate and band position;
+// writes n_frames * decimation frames to out
+size_t band_expand(band_filter_t *bf, const int16_t *in, size_t n_frames, int16_t *out);
+
+#endif
@@ -0,0 +1,296 @@
+/*
+ * SilentTrace - Ultrasonic Signal Detector
+ * Ultrasonic Activity Gate
+ *
+ * Everything here runs on the capture thread, once per period, with no
+ * allocation after gate_create(). Levels are mean-square power relative to
+ * full scale (a full-scale sine is -3 dBFS), both for the band filter
+ * output and for the Goertzel bins, so one threshold applies to both.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "gate.h"
+#include "log.h"
+
+#define GATE_PI 3.14159265358979323846
+#define GATE_FLOOR_MIN 1e-12            // -120 dBFS
+#define GATE_TONE_SMOOTH_SEC 0.25       // averaging of the Goertzel bin levels
+#define GATE_HIGHPASS_STAGES 2
+
+typedef struct {
+    float b0, b1, b2, a1, a2;
+} biquad_t;
+
+typedef struct {
+    float z1, z2;
+} biquad_state_t;
+
+struct gate {
+    gate_config_t cfg;
+    int has_lowpass;
+
+    // Highpass stages then the lowpass, shared by all channels
+    biquad_t sections[GATE_HIGHPASS_STAGES + 1];
+    size_t n_sections;
+    biquad_state_t *state;              // [channel][section]
+
+    float tone_coeff[GATE_MAX_TONES];
+    double tone_level[GATE_MAX_TONES];
+    double tone_floor[GATE_MAX_TONES];
+    double band_floor;
+    uint64_t floor_updates;
+
+    uint64_t frames_seen;
+    uint64_t open_until;                // frame index where the hangover ends
+    uint64_t last_open;                 // frame index the gate was last open
+    uint64_t hangover_frames;
+    uint64_t refresh_frames;
+
+    gate_stats_t stats;
+};
+
+static double to_db(double mean_square) {
+    return 10.0 * log10(mean_square > GATE_FLOOR_MIN ? mean_square : GATE_FLOOR_MIN);
+}
+
+// RBJ cookbook highpass / lowpass
+static biquad_t design_biquad(int highpass, double freq_hz, double q, unsigned int sample_rate) {
+    double w0 = 2.0 * GATE_PI * freq_hz / sample_rate;
+    double alpha = sin(w0) / (2.0 * q);
+    double cw = cos(w0);
+    double a0 = 1.0 + alpha;
+    biquad_t bq;
+
+    if (highpass) {
+        bq.b0 = (float)((1.0 + cw) / 2.0 / a0);
+        bq.b1 = (float)(-(1.0 + cw) / a0);
+    } else {
+        bq.b0 = (float)((1.0 - cw) / 2.0 / a0);
+        bq.b1 = (float)((1.0 - cw) / a0);
+    }
+    bq.b2 = bq.b0;
+    bq.a1 = (float)(-2.0 * cw / a0);
+    bq.a2 = (float)((1.0 - alpha) / a0);
+    return bq;
+}
+
+void gate_default_config(gate_config_t *cfg, unsigned int sample_rate, unsigned int channels) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->sample_rate = sample_rate;
+    cfg->channels = channels;
+    cfg->band_low_hz = 18000.0;
+    cfg->band_high_hz = 22000.0;
+    cfg->threshold_db = 10.0;
+    cfg->hangover_sec = 2.0;
+    cfg->floor_sec = 30.0;
+    cfg->refresh_sec = 60.0;
+}
+
+gate_t *gate_create(const gate_config_t *cfg) {
+    double nyquist = cfg->sample_rate / 2.0;
+    gate_t *gate;
+
+    if (cfg->sample_rate == 0 || cfg->channels == 0 || cfg->n_tones > GATE_MAX_TONES ||
+        cfg->band_low_hz <= 0.0 || cfg->band_low_hz >= cfg->band_high_hz ||
+        cfg->band_low_hz >= nyquist || cfg->hangover_sec < 0.0 || cfg->floor_sec <= 0.0 ||
+        cfg->refresh_sec < 0.0) {
+        log_error("Invalid activity gate configuration");
+        return NULL;
+    }
+    for (size_t i = 0; i < cfg->n_tones; i++) {
+        if (cfg->tones_hz[i] <= 0.0 || cfg->tones_hz[i] >= nyquist) {
+            log_error("Gate tone %.1fHz outside (0, %.1f)Hz", cfg->tones_hz[i], nyquist);
+            return NULL;
+        }
+    }
+
+    gate = calloc(1, sizeof(*gate));
+    if (!gate) {
+        return NULL;
+    }
+    gate->cfg = *cfg;
+
+    // 4th-order Butterworth highpass as two sections, plus a 2nd-order
+    // lowpass unless the band reaches Nyquist anyway
+    gate->sections[0] = design_biquad(1, cfg->band_low_hz, 0.54119610, cfg->sample_rate);
+    gate->sections[1] = design_biquad(1, cfg->band_low_hz, 1.30656296, cfg->sample_rate);
+    gate->n_sections = GATE_HIGHPASS_STAGES;
+    gate->has_lowpass = cfg->band_high_hz < 0.95 * nyquist;
+    if (gate->has_lowpass) {
+        gate->sections[gate->n_sections++] = design_biquad(0, cfg->band_high_hz, 0.70710678, cfg->sample_rate);
+    }
+    gate->state = calloc((size_t)cfg->channels * gate->n_sections, sizeof(biquad_state_t));
+    if (!gate->state) {
+        free(gate);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < cfg->n_tones; i++) {
+        gate->tone_coeff[i] = (float)(2.0 * cos(2.0 * GATE_PI * cfg->tones_hz[i] / cfg->sample_rate));
+    }
+    gate->hangover_frames = (uint64_t)(cfg->hangover_sec * cfg->sample_rate);
+    gate->refresh_frames = (uint64_t)(cfg->refresh_sec * cfg->sample_rate);
+    gate->stats.rms_dbfs = to_db(0.0);
+    gate->stats.peak_dbfs = to_db(0.0);
+    gate->stats.band_dbfs = to_db(0.0);
+    gate->stats.floor_dbfs = to_db(0.0);
+
+    log_info("Activity gate on %.0f-%.0f Hz%s, %zu tones, %.1fdB over floor, %.1fs hangover",
+             cfg->band_low_hz, gate->has_lowpass ? cfg->band_high_hz : nyquist,
+             gate->has_lowpass ? "" : " (Nyquist)", cfg->n_tones, cfg->threshold_db, cfg->hangover_sec);
+    return gate;
+}
+
+void gate_destroy(gate_t *gate) {
+    if (!gate) {
+        return;
+    }
+    free(gate->state);
+    free(gate);
+}
+
+// Average of the background power. Starts as a plain running mean so the
+// first seconds are usable, and never moves upwards while the gate is open.
+static void track_floor(gate_t *gate, double *floor, double level, double period_sec, int open) {
+    double rate = period_sec / gate->cfg.floor_sec;
+
+    if (open && level > *floor) {
+        return;
+    }
+    if (rate < 1.0 / (gate->floor_updates + 1)) {
+        rate = 1.0 / (gate->floor_updates + 1);
+    }
+    *floor += (level - *floor) * (rate < 1.0 ? rate : 1.0);
+    if (*floor < GATE_FLOOR_MIN) {
+        *floor = GATE_FLOOR_MIN;
+    }
+}
+
+int gate_process(gate_t *gate, const int16_t *frames, size_t n_frames) {
+    const unsigned int channels = gate->cfg.channels;
+    const size_t n_sections = gate->n_sections;
+    const float scale = 1.0f / 32768.0f;
+    const float mix_scale = scale / (float)channels;
+    double full_sum[channels];
+    double band_sum[channels];
+    float peak = 0.0f;
+    float s1[GATE_MAX_TONES] = {0.0f};
+    float s2[GATE_MAX_TONES] = {0.0f};
+    double full = 0.0;
+    double band = 0.0;
+    double period_sec;
+    int tripped = 0;
+    int open;
+
+    if (n_frames == 0) {
+        return gate->stats.open;
+    }
+    memset(full_sum, 0, sizeof(full_sum));
+    memset(band_sum, 0, sizeof(band_sum));
+
+    for (size_t i = 0; i < n_frames; i++) {
+        const int16_t *frame = frames + i * channels;
+        float mix = 0.0f;
+
+        for (unsigned int c = 0; c < channels; c++) {
+            biquad_state_t *st = gate->state + c * n_sections;
+            float x = frame[c] * scale;
+            float y = x;
+            float ax = fabsf(x);
+
+            for (size_t k = 0; k < n_sections; k++) {
+                const biquad_t *bq = &gate->sections[k];
+                float out = bq->b0 * y + st[k].z1;
+                st[k].z1 = bq->b1 * y - bq->a1 * out + st[k].z2;
+                st[k].z2 = bq->b2 * y - bq->a2 * out;
+                y = out;
+            }
+            full_sum[c] += x * x;
+            band_sum[c] += y * y;
+            if (ax > peak) {
+                peak = ax;
+            }
+            mix += frame[c];
+        }
+
+        mix *= mix_scale;
+        for (size_t t = 0; t < gate->cfg.n_tones; t++) {
+            float s0 = mix + gate->tone_coeff[t] * s1[t] - s2[t];
+            s2[t] = s1[t];
+            s1[t] = s0;
+        }
+    }
+
+    for (unsigned int c = 0; c < channels; c++) {
+        if (full_sum[c] > full) {
+            full = full_sum[c];
+        }
+        if (band_sum[c] > band) {
+            band = band_sum[c];
+        }
+    }
+    full /= n_frames;
+    band /= n_frames;
+
+    period_sec = (double)n_frames / gate->cfg.sample_rate;
+    if (gate->floor_updates > 0 && to_db(band) > to_db(gate->band_floor) + gate->cfg.threshold_db) {
+        tripped = 1;
+    }
+
+    // A single bin over noise swings by 10 dB and more from period to
+    // period; smoothing it keeps the threshold meaningful
+    for (size_t t = 0; t < gate->cfg.n_tones; t++) {
+        double power = (double)s1[t] * s1[t] + (double)s2[t] * s2[t] -
+                       (double)gate->tone_coeff[t] * s1[t] * s2[t];
+        double tone = 2.0 * power / ((double)n_frames * n_frames);
+        double smooth = period_sec / GATE_TONE_SMOOTH_SEC;
+
+        if (gate->floor_updates == 0 || smooth > 1.0) {
+            smooth = 1.0;
+        }
+        gate->tone_level[t] += (tone - gate->tone_level[t]) * smooth;
+        if (gate->floor_updates > 0 &&
+            to_db(gate->tone_level[t]) > to_db(gate->tone_floor[t]) + gate->cfg.threshold_db) {
+            tripped = 1;
+        }
+    }
+
+    for (size_t t = 0; t < gate->cfg.n_tones; t++) {
+        track_floor(gate, &gate->tone_floor[t], gate->tone_level[t], period_sec, tripped || gate->stats.open);
+    }
+    track_floor(gate, &gate->band_floor, band, period_sec, tripped || gate->stats.open);
+    gate->floor_updates++;
+
+    gate->frames_seen += n_frames;
+    if (tripped) {
+        gate->open_until = gate->frames_seen + gate->hangover_frames;
+    } else if (gate->refresh_frames && gate->frames_seen - gate->last_open >= gate->refresh_frames) {
+        // Let a quiet scene through now and then so the full analyzer still
+        // samples it (and a beacon learned as background gets noticed)
+        gate->open_until = gate->frames_seen + gate->hangover_frames;
+    }
+    open = gate->frames_seen <= gate->open_until;
+    if (open) {
+        gate->last_open = gate->frames_seen;
+    }
+
+    if (open && !gate->stats.open && tripped) {
+        gate->stats.trips++;
+        log_debug("Activity gate opened: band %.1fdBFS, floor %.1fdBFS", to_db(band), to_db(gate->band_floor));
+    }
+    gate->stats.open = open;
+    gate->stats.rms_dbfs = to_db(full);
+    gate->stats.peak_dbfs = 20.0 * log10(peak > 1e-6f ? peak : 1e-6f);
+    gate->stats.band_dbfs = to_db(band);
+    gate->stats.floor_dbfs = to_db(gate->band_floor);
+    return open;
+}
+
+void gate_get_stats(const gate_t *gate, gate_stats_t *stats) {
+    *stats = gate->stats;
+}
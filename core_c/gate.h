@@ -0,0 +1,62 @@
+/*
+ * SilentTrace - Ultrasonic Signal Detector
+ * Ultrasonic Activity Gate
+ *
+ * A cheap first detection stage that runs on every capture period. Each
+ * channel goes through a biquad bandpass (4th-order highpass, 2nd-order
+ * lowpass) covering the beacon band, and optional Goertzel bins watch
+ * specific tone frequencies on the channel mix. Levels are compared with a
+ * noise floor averaged over the quiet background; the gate opens when the
+ * band or any tone rises above the floor by the threshold and stays open
+ * for the hangover time after the last trip.
+ *
+ * The floor only rises while the gate is closed, so a beacon that starts
+ * while the scene is being watched keeps the gate open instead of being
+ * learned as background. One that was already present when the floor was
+ * learned is still seen through the periodic refresh opening.
+ */
+
+#ifndef GATE_H
+#define GATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define GATE_MAX_TONES 8
+
+typedef struct {
+    unsigned int sample_rate;
+    unsigned int channels;
+    double band_low_hz;
+    double band_high_hz;
+    double tones_hz[GATE_MAX_TONES];    // Goertzel bins, in addition to the band
+    size_t n_tones;
+    double threshold_db;                // trip level above the noise floor
+    double hangover_sec;                // stay open this long after the last trip
+    double floor_sec;                   // averaging time of the noise floor
+    double refresh_sec;                 // open anyway after this long closed, 0 = never
+} gate_config_t;
+
+typedef struct {
+    int open;
+    uint64_t trips;                     // closed -> open transitions
+    double rms_dbfs;                    // last period, loudest channel, full band
+    double peak_dbfs;
+    double band_dbfs;                   // last period, loudest channel, in band
+    double floor_dbfs;
+} gate_stats_t;
+
+typedef struct gate gate_t;
+
+void gate_default_config(gate_config_t *cfg, unsigned int sample_rate, unsigned int channels);
+
+gate_t *gate_create(const gate_config_t *cfg);
+void gate_destroy(gate_t *gate);
+
+// Called from the capture thread for every period; returns 1 while the
+// gate is open
+int gate_process(gate_t *gate, const int16_t *frames, size_t n_frames);
+
+void gate_get_stats(const gate_t *gate, gate_stats_t *stats);
+
+#endif
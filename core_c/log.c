@@ -0,0 +1,631 @@
+/*
+ * SilentTrace - Ultrasonic Signal Detector
+ * Asynchronous Logging
+ *
+ * The ring is a bounded queue with a sequence number per slot: producers
+ * claim a slot by advancing the tail with a CAS, fill it, and publish it by
+ * storing the slot's sequence; the single consumer walks the head. A slot
+ * whose sequence lags the tail means the ring is full, and the producer
+ * drops its record rather than waiting.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+#include "log.h"
+
+#define LOG_RING_RECORDS 1024           // power of two
+#define LOG_RECORD_BYTES 256
+#define LOG_IDLE_WAIT_MS 10
+#define LOG_LINE_MAX 1024
+#define LOG_BATCH_BYTES 65536
+
+enum {
+    ARG_INT,
+    ARG_UINT,
+    ARG_DOUBLE,
+    ARG_STRING,
+    ARG_POINTER
+};
+
+typedef struct {
+    uint64_t seq;
+    const char *fmt;
+    uint64_t timestamp_ns;
+    uint32_t suppressed;
+    uint8_t level;
+    uint8_t truncated;
+    uint16_t args_len;
+    uint8_t args[LOG_RECORD_BYTES - 32];
+} log_record_t;
+
+static const char *level_names[] = {"DEBUG", "INFO", "WARNING", "ERROR"};
+static const char *level_keys[] = {"debug", "info", "warning", "error"};
+
+static log_config_t config = {LOG_LEVEL_INFO, 0, 20};
+static log_level_t min_level = LOG_LEVEL_INFO;
+
+static log_record_t *ring;
+static uint64_t ring_head;              // consumer only
+static uint64_t ring_tail;              // producers, CAS
+static uint64_t records_dropped;
+static int accepting;                   // producers may enqueue
+static int active_writers;              // producers between check and publish
+static int stop_requested;
+static pthread_t writer_thread;
+
+void log_default_config(log_config_t *cfg) {
+    cfg->level = LOG_LEVEL_INFO;
+    cfg->json = 0;
+    cfg->rate_limit = 20;
+}
+
+int log_parse_level(const char *name, log_level_t *level) {
+    for (int i = LOG_LEVEL_DEBUG; i <= LOG_LEVEL_ERROR; i++) {
+        if (strcmp(name, level_keys[i]) == 0) {
+            *level = (log_level_t)i;
+            return 0;
+        }
+    }
+    fprintf(stderr, "[ERROR] Unknown log level: %s\n", name);
+    return -1;
+}
+
+int log_enabled(log_level_t level) {
+    return level >= __atomic_load_n(&min_level, __ATOMIC_RELAXED);
+}
+
+static uint64_t realtime_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* ---------- Argument capture (calling thread) ---------- */
+
+static const char *skip_flags(const char *p) {
+    while (*p && strchr("-+ #0'", *p)) {
+        p++;
+    }
+    return p;
+}
+
+static const char *skip_digits(const char *p) {
+    while (*p >= '0' && *p <= '9') {
+        p++;
+    }
+    return p;
+}
+
+static int put_number(log_record_t *rec, int tag, const void *value) {
+    if ((size_t)rec->args_len + 1 + 8 > sizeof(rec->args)) {
+        rec->truncated = 1;
+        return -1;
+    }
+    rec->args[rec->args_len] = (uint8_t)tag;
+    memcpy(rec->args + rec->args_len + 1, value, 8);
+    rec->args_len += 9;
+    return 0;
+}
+
+static int put_string(log_record_t *rec, const char *s) {
+    size_t room = sizeof(rec->args) - rec->args_len;
+    size_t len;
+
+    if (room < 4) {
+        rec->truncated = 1;
+        return -1;
+    }
+    if (!s) {
+        s = "(null)";
+    }
+    len = strlen(s);
+    if (len > room - 3) {
+        len = room - 3;
+        rec->truncated = 1;
+    }
+    rec->args[rec->args_len] = ARG_STRING;
+    rec->args[rec->args_len + 1] = (uint8_t)len;
+    rec->args[rec->args_len + 2] = (uint8_t)(len >> 8);
+    memcpy(rec->args + rec->args_len + 3, s, len);
+    rec->args_len += (uint16_t)(3 + len);
+    return 0;
+}
+
+// Walk the format like printf would and store each argument by value
+static void capture_args(log_record_t *rec, const char *fmt, va_list ap) {
+    const char *p = fmt;
+
+    while ((p = strchr(p, '%')) != NULL) {
+        int64_t i;
+        uint64_t u;
+        double d;
+        int length = 0;         // 'H' hh, 'h', 'l', 'q' ll, 'z', 'j', 't', 'L'
+
+        p++;
+        if (*p == '%') {
+            p++;
+            continue;
+        }
+        p = skip_flags(p);
+        if (*p == '*') {
+            i = va_arg(ap, int);
+            if (put_number(rec, ARG_INT, &i) < 0) return;
+            p++;
+        } else {
+            p = skip_digits(p);
+        }
+        if (*p == '.') {
+            p++;
+            if (*p == '*') {
+                i = va_arg(ap, int);
+                if (put_number(rec, ARG_INT, &i) < 0) return;
+                p++;
+            } else {
+                p = skip_digits(p);
+            }
+        }
+        if (*p == 'h') {
+            length = p[1] == 'h' ? 'H' : 'h';
+            p += p[1] == 'h' ? 2 : 1;
+        } else if (*p == 'l') {
+            length = p[1] == 'l' ? 'q' : 'l';
+            p += p[1] == 'l' ? 2 : 1;
+        } else if (*p && strchr("zjtL", *p)) {
+            length = *p++;
+        }
+
+        switch (*p) {
+        case 'd':
+        case 'i':
+            switch (length) {
+            case 'l': i = va_arg(ap, long); break;
+            case 'q': i = va_arg(ap, long long); break;
+            case 'z': i = va_arg(ap, ssize_t); break;
+            case 'j': i = va_arg(ap, intmax_t); break;
+            case 't': i = va_arg(ap, ptrdiff_t); break;
+            default: i = va_arg(ap, int); break;
+            }
+            if (put_number(rec, ARG_INT, &i) < 0) return;
+            break;
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            switch (length) {
+            case 'l': u = va_arg(ap, unsigned long); break;
+            case 'q': u = va_arg(ap, unsigned long long); break;
+            case 'z': u = va_arg(ap, size_t); break;
+            case 'j': u = va_arg(ap, uintmax_t); break;
+            case 't': u = (uint64_t)va_arg(ap, ptrdiff_t); break;
+            case 'H': u = (unsigned char)va_arg(ap, unsigned int); break;
+            case 'h': u = (unsigned short)va_arg(ap, unsigned int); break;
+            default: u = va_arg(ap, unsigned int); break;
+            }
+            if (put_number(rec, ARG_UINT, &u) < 0) return;
+            break;
+        case 'c':
+            i = va_arg(ap, int);
+            if (put_number(rec, ARG_INT, &i) < 0) return;
+            break;
+        case 'f': case 'F': case 'e': case 'E':
+        case 'g': case 'G': case 'a': case 'A':
+            d = length == 'L' ? (double)va_arg(ap, long double) : va_arg(ap, double);
+            if (put_number(rec, ARG_DOUBLE, &d) < 0) return;
+            break;
+        case 's':
+            if (put_string(rec, va_arg(ap, const char *)) < 0) return;
+            break;
+        case 'p':
+            u = (uint64_t)(uintptr_t)va_arg(ap, void *);
+            if (put_number(rec, ARG_POINTER, &u) < 0) return;
+            break;
+        default:
+            // Unsupported conversion: the remaining argument types are unknown
+            rec->truncated = 1;
+            return;
+        }
+        p++;
+    }
+}
+
+/* ---------- Formatting (logging thread) ---------- */
+
+typedef struct {
+    const log_record_t *rec;
+    size_t pos;
+} arg_cursor_t;
+
+static int next_arg(arg_cursor_t *cur, int *tag, uint64_t *value, const char **str, size_t *len) {
+    const log_record_t *rec = cur->rec;
+
+    if (cur->pos >= rec->args_len) {
+        return -1;
+    }
+    *tag = rec->args[cur->pos];
+    if (*tag == ARG_STRING) {
+        *len = (size_t)rec->args[cur->pos + 1] | ((size_t)rec->args[cur->pos + 2] << 8);
+        *str = (const char *)rec->args + cur->pos + 3;
+        cur->pos += 3 + *len;
+    } else {
+        memcpy(value, rec->args + cur->pos + 1, 8);
+        cur->pos += 9;
+    }
+    return 0;
+}
+
+static size_t format_message(const log_record_t *rec, char *out, size_t cap) {
+    arg_cursor_t cur = {rec, 0};
+    const char *p = rec->fmt;
+    size_t len = 0;
+
+    while (*p && len + 1 < cap) {
+        char spec[48];
+        size_t slen = 0;
+        int tag;
+        uint64_t value;
+        const char *str;
+        size_t str_len;
+        int n = 0;
+
+        if (*p != '%') {
+            out[len++] = *p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            out[len++] = '%';
+            p += 2;
+            continue;
+        }
+
+        // Rebuild the conversion with widths resolved and a fixed length
+        spec[slen++] = '%';
+        p++;
+        while (*p && strchr("-+ #0'", *p) && slen < 8) {
+            spec[slen++] = *p++;
+        }
+        for (int part = 0; part < 2; part++) {
+            if (part == 1) {
+                if (*p != '.') {
+                    break;
+                }
+                spec[slen++] = *p++;
+            }
+            if (*p == '*') {
+                if (next_arg(&cur, &tag, &value, &str, &str_len) < 0) {
+                    goto truncated;
+                }
+                slen += (size_t)snprintf(spec + slen, sizeof(spec) - slen, "%d", (int)(int64_t)value);
+                p++;
+            } else {
+                while (*p >= '0' && *p <= '9' && slen < 32) {
+                    spec[slen++] = *p++;
+                }
+            }
+        }
+        while (*p && strchr("hlzjtLq", *p)) {
+            p++;
+        }
+        if (!*p) {
+            break;
+        }
+
+        char conv = *p++;
+        if (next_arg(&cur, &tag, &value, &str, &str_len) < 0) {
+            goto truncated;
+        }
+        switch (conv) {
+        case 'd':
+        case 'i':
+            memcpy(spec + slen, "lld", 4);
+            n = snprintf(out + len, cap - len, spec, (long long)(int64_t)value);
+            break;
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            spec[slen] = 'l';
+            spec[slen + 1] = 'l';
+            spec[slen + 2] = conv;
+            spec[slen + 3] = '\0';
+            n = snprintf(out + len, cap - len, spec, (unsigned long long)value);
+            break;
+        case 'c':
+            spec[slen] = 'c';
+            spec[slen + 1] = '\0';
+            n = snprintf(out + len, cap - len, spec, (int)(int64_t)value);
+            break;
+        case 's': {
+            char tmp[LOG_RECORD_BYTES];
+            memcpy(tmp, str, str_len);
+            tmp[str_len] = '\0';
+            spec[slen] = 's';
+            spec[slen + 1] = '\0';
+            n = snprintf(out + len, cap - len, spec, tmp);
+            break;
+        }
+        case 'p':
+            spec[slen] = 'p';
+            spec[slen + 1] = '\0';
+            n = snprintf(out + len, cap - len, spec, (void *)(uintptr_t)value);
+            break;
+        default: {
+            double d;
+            memcpy(&d, &value, sizeof(d));
+            spec[slen] = conv;
+            spec[slen + 1] = '\0';
+            n = snprintf(out + len, cap - len, spec, d);
+            break;
+        }
+        }
+        if (n > 0) {
+            len += (size_t)n < cap - len ? (size_t)n : cap - len - 1;
+        }
+    }
+    if (rec->truncated && len + 4 < cap) {
+        goto truncated;
+    }
+    out[len] = '\0';
+    while (len > 0 && out[len - 1] == '\n') {
+        out[--len] = '\0';
+    }
+    return len;
+
+truncated:
+    len += (size_t)snprintf(out + len, cap - len, "...");
+    if (len >= cap) {
+        len = cap - 1;
+    }
+    return len;
+}
+
+static size_t json_escape(const char *in, char *out, size_t cap) {
+    size_t len = 0;
+    for (; *in && len + 7 < cap; in++) {
+        unsigned char c = (unsigned char)*in;
+        if (c == '"' || c == '\\') {
+            out[len++] = '\\';
+            out[len++] = (char)c;
+        } else if (c < 0x20) {
+            len += (size_t)snprintf(out + len, cap - len, "\\u%04x", c);
+        } else {
+            out[len++] = (char)c;
+        }
+    }
+    out[len] = '\0';
+    return len;
+}
+
+static size_t format_line(const log_record_t *rec, char *out, size_t cap) {
+    char msg[LOG_LINE_MAX];
+    size_t len;
+
+    format_message(rec, msg, sizeof(msg));
+
+    if (config.json) {
+        char escaped[LOG_LINE_MAX * 2];
+        char stamp[32];
+        time_t sec = (time_t)(rec->timestamp_ns / 1000000000ULL);
+        struct tm tm;
+
+        gmtime_r(&sec, &tm);
+        strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &tm);
+        json_escape(msg, escaped, sizeof(escaped));
+        len = (size_t)snprintf(out, cap, "{\"ts\":\"%s.%03uZ\",\"level\":\"%s\",\"msg\":\"%s\"", stamp,
+                               (unsigned int)(rec->timestamp_ns / 1000000 % 1000), level_keys[rec->level],
+                               escaped);
+        if (len < cap && rec->suppressed) {
+            len += (size_t)snprintf(out + len, cap - len, ",\"suppressed\":%u", rec->suppressed);
+        }
+        if (len < cap) {
+            len += (size_t)snprintf(out + len, cap - len, "}\n");
+        }
+    } else {
+        len = (size_t)snprintf(out, cap, "[%s] %s", level_names[rec->level], msg);
+        if (len < cap && rec->suppressed) {
+            len += (size_t)snprintf(out + len, cap - len, " (%u similar messages suppressed)",
+                                    rec->suppressed);
+        }
+        if (len < cap) {
+            len += (size_t)snprintf(out + len, cap - len, "\n");
+        }
+    }
+    if (len >= cap) {
+        out[cap - 2] = '\n';
+        len = cap - 1;
+    }
+    return len;
+}
+
+static void write_all(const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(STDERR_FILENO, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+}
+
+/* ---------- Ring ---------- */
+
+static int ring_push(const log_record_t *rec) {
+    uint64_t pos = __atomic_load_n(&ring_tail, __ATOMIC_RELAXED);
+
+    for (;;) {
+        log_record_t *slot = &ring[pos & (LOG_RING_RECORDS - 1)];
+        uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t)(seq - pos);
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&ring_tail, &pos, pos + 1, 1, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                memcpy((uint8_t *)slot + sizeof(slot->seq), (const uint8_t *)rec + sizeof(rec->seq),
+                       offsetof(log_record_t, args) - sizeof(rec->seq) + rec->args_len);
+                __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+                return 0;
+            }
+        } else if (diff < 0) {
+            return -1;
+        } else {
+            pos = __atomic_load_n(&ring_tail, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static int site_allows(log_site_t *site, uint64_t now_ns, uint32_t *suppressed) {
+    uint64_t window = now_ns / 1000000000ULL;
+    uint64_t seen = __atomic_load_n(&site->window, __ATOMIC_RELAXED);
+
+    if (config.rate_limit == 0) {
+        *suppressed = 0;
+        return 1;
+    }
+    if (seen != window &&
+        __atomic_compare_exchange_n(&site->window, &seen, window, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&site->count, 0, __ATOMIC_RELAXED);
+    }
+    if (__atomic_add_fetch(&site->count, 1, __ATOMIC_RELAXED) > config.rate_limit) {
+        __atomic_fetch_add(&site->suppressed, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    *suppressed = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+    return 1;
+}
+
+void log_write(log_site_t *site, log_level_t level, const char *fmt, ...) {
+    log_record_t rec;
+    va_list ap;
+
+    rec.timestamp_ns = realtime_ns();
+    if (!site_allows(site, rec.timestamp_ns, &rec.suppressed)) {
+        return;
+    }
+    rec.fmt = fmt;
+    rec.level = (uint8_t)level;
+    rec.truncated = 0;
+    rec.args_len = 0;
+    va_start(ap, fmt);
+    capture_args(&rec, fmt, ap);
+    va_end(ap);
+
+    __atomic_add_fetch(&active_writers, 1, __ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&accepting, __ATOMIC_ACQUIRE)) {
+        if (ring_push(&rec) < 0) {
+            __atomic_fetch_add(&records_dropped, 1, __ATOMIC_RELAXED);
+        }
+        __atomic_sub_fetch(&active_writers, 1, __ATOMIC_RELEASE);
+        return;
+    }
+    __atomic_sub_fetch(&active_writers, 1, __ATOMIC_RELEASE);
+
+    // No writer thread: format and write here
+    char line[LOG_LINE_MAX + 64];
+    write_all(line, format_line(&rec, line, sizeof(line)));
+}
+
+/* ---------- Writer thread ---------- */
+
+static size_t drain(char *batch, size_t *batch_len) {
+    size_t drained = 0;
+
+    for (;;) {
+        log_record_t *slot = &ring[ring_head & (LOG_RING_RECORDS - 1)];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != ring_head + 1) {
+            break;
+        }
+        if (*batch_len + LOG_LINE_MAX * 2 + 64 > LOG_BATCH_BYTES) {
+            write_all(batch, *batch_len);
+            *batch_len = 0;
+        }
+        *batch_len += format_line(slot, batch + *batch_len, LOG_BATCH_BYTES - *batch_len);
+        __atomic_store_n(&slot->seq, ring_head + LOG_RING_RECORDS, __ATOMIC_RELEASE);
+        ring_head++;
+        drained++;
+    }
+    return drained;
+}
+
+static void *writer_main(void *arg) {
+    static char batch[LOG_BATCH_BYTES];
+    uint64_t dropped_reported = 0;
+    (void)arg;
+
+    for (;;) {
+        // Sampled first: once no producer is inside log_write() after the
+        // stop request, this drain is the last one needed
+        int stopping = __atomic_load_n(&stop_requested, __ATOMIC_ACQUIRE) &&
+                       __atomic_load_n(&active_writers, __ATOMIC_ACQUIRE) == 0;
+        size_t batch_len = 0;
+        size_t drained = drain(batch, &batch_len);
+
+        uint64_t dropped = __atomic_load_n(&records_dropped, __ATOMIC_RELAXED);
+        if (dropped != dropped_reported) {
+            batch_len += (size_t)snprintf(batch + batch_len, LOG_BATCH_BYTES - batch_len,
+                                          "[WARNING] %llu log messages dropped (logging ring full)\n",
+                                          (unsigned long long)(dropped - dropped_reported));
+            dropped_reported = dropped;
+        }
+        if (batch_len) {
+            write_all(batch, batch_len);
+        }
+
+        if (stopping && drained == 0) {
+            break;
+        }
+        if (drained == 0) {
+            struct timespec wait = {0, LOG_IDLE_WAIT_MS * 1000000L};
+            nanosleep(&wait, NULL);
+        }
+    }
+    return NULL;
+}
+
+int log_start(const log_config_t *cfg) {
+    config = *cfg;
+    __atomic_store_n(&min_level, cfg->level, __ATOMIC_RELAXED);
+
+    ring = calloc(LOG_RING_RECORDS, sizeof(log_record_t));
+    if (!ring) {
+        return -1;
+    }
+    for (uint64_t i = 0; i < LOG_RING_RECORDS; i++) {
+        ring[i].seq = i;
+    }
+    ring_head = 0;
+    ring_tail = 0;
+    stop_requested = 0;
+
+    if (pthread_create(&writer_thread, NULL, writer_main, NULL) != 0) {
+        free(ring);
+        ring = NULL;
+        return -1;
+    }
+    __atomic_store_n(&accepting, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void log_stop(void) {
+    if (!ring) {
+        return;
+    }
+    __atomic_store_n(&accepting, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&stop_requested, 1, __ATOMIC_RELEASE);
+    pthread_join(writer_thread, NULL);
+    free(ring);
+    ring = NULL;
+}
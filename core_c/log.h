@@ -0,0 +1,73 @@
+/*
+ * SilentTrace - Ultrasonic Signal Detector
+ * Asynchronous Logging
+ *
+ * Log calls never format or write on the calling thread. They copy the
+ * format pointer and the raw arguments (strings by value) into a fixed-size
+ * record in a lock-free multi-producer ring; a background thread formats
+ * the records and writes them out in batches. When the ring is full the
+ * record is dropped and counted instead of blocking. Each call site is
+ * rate limited on its own, and the next line that gets through reports
+ * how many were suppressed.
+ *
+ * Format strings must be string literals (they are read later, on the
+ * logging thread). Lines get a newline appended.
+ *
+ * Before log_start() and after log_stop(), calls write synchronously.
+ */
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdint.h>
+
+typedef enum {
+    LOG_LEVEL_DEBUG,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARNING,
+    LOG_LEVEL_ERROR
+} log_level_t;
+
+// Per-call-site rate limiting state (one static instance per log call)
+typedef struct {
+    uint64_t window;
+    uint32_t count;
+    uint32_t suppressed;
+} log_site_t;
+
+typedef struct {
+    log_level_t level;
+    int json;                       // one JSON object per line instead of text
+    unsigned int rate_limit;        // lines per second per call site, 0 = unlimited
+} log_config_t;
+
+void log_default_config(log_config_t *cfg);
+
+// Parse "debug", "info", "warning" or "error"
+int log_parse_level(const char *name, log_level_t *level);
+
+// Start the background writer; applies the level filter immediately
+int log_start(const log_config_t *cfg);
+
+// Drain pending records and stop the writer
+void log_stop(void);
+
+int log_enabled(log_level_t level);
+
+void log_write(log_site_t *site, log_level_t level, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+#define LOG_AT(level, ...) \
+    do { \
+        static log_site_t log_site_; \
+        if (log_enabled(level)) { \
+            log_write(&log_site_, level, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define log_debug(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define log_info(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define log_warning(...) LOG_AT(LOG_LEVEL_WARNING, __VA_ARGS__)
+#define log_error(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+#endif
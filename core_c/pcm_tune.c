@@ -0,0 +1,338 @@
+/*
+ * SilentTrace - Ultrasonic Signal Detector
+ * ALSA Period and Buffer Tuning
+ *
+ * Calibration reads the device exactly like the capture loop does, one
+ * period per snd_pcm_readi(), but without the loop's per-period work, so
+ * the figures describe the device and the scheduler. Load added later is
+ * what pcm_step_up() is for.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "pcm_tune.h"
+#include "log.h"
+
+typedef struct {
+    snd_pcm_uframes_t period_min;
+    snd_pcm_uframes_t period_max;
+    snd_pcm_uframes_t buffer_max;
+} pcm_limits_t;
+
+static uint64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+void pcm_tune_default_config(pcm_tune_config_t *cfg) {
+    cfg->target_latency_ms = 50.0;
+    cfg->xrun_budget = 0.0;
+    cfg->window_sec = 1.0;
+    cfg->max_fill = 0.5;
+}
+
+// Everything but the sizes; shared by configuration and limit queries
+static int set_base_params(snd_pcm_t *pcm, snd_pcm_hw_params_t *hw_params, unsigned int *rate,
+                           unsigned int channels) {
+    unsigned int granted = *rate;
+    int err;
+
+    if ((err = snd_pcm_hw_params_any(pcm, hw_params)) < 0) {
+        log_error("Cannot initialize hardware parameter structure: %s", snd_strerror(err));
+        return -1;
+    }
+    if ((err = snd_pcm_hw_params_set_access(pcm, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0) {
+        log_error("Cannot set access type: %s", snd_strerror(err));
+        return -1;
+    }
+    if ((err = snd_pcm_hw_params_set_format(pcm, hw_params, SND_PCM_FORMAT_S16_LE)) < 0) {
+        log_error("Cannot set sample format: %s", snd_strerror(err));
+        return -1;
+    }
+    if ((err = snd_pcm_hw_params_set_rate_near(pcm, hw_params, &granted, 0)) < 0) {
+        log_error("Cannot set sample rate: %s", snd_strerror(err));
+        return -1;
+    }
+    if (granted != *rate) {
+        log_warning("Sample rate set to %u instead of %u", granted, *rate);
+        *rate = granted;
+    }
+    if ((err = snd_pcm_hw_params_set_channels(pcm, hw_params, channels)) < 0) {
+        log_error("Cannot set channel count: %s", snd_strerror(err));
+        return -1;
+    }
+    return 0;
+}
+
+int pcm_configure(snd_pcm_t *pcm, unsigned int *rate, unsigned int channels, pcm_setting_t *setting) {
+    snd_pcm_hw_params_t *hw_params;
+    snd_pcm_uframes_t frames;
+    int dir = 0;
+    int err;
+
+    // Harmless on a freshly opened device; required before reconfiguring
+    snd_pcm_drop(pcm);
+    snd_pcm_hw_free(pcm);
+
+    if ((err = snd_pcm_hw_params_malloc(&hw_params)) < 0) {
+        log_error("Cannot allocate hardware parameter structure: %s", snd_strerror(err));
+        return -1;
+    }
+    if (set_base_params(pcm, hw_params, rate, channels) < 0) {
+        snd_pcm_hw_params_free(hw_params);
+        return -1;
+    }
+
+    frames = setting->period_frames;
+    if ((err = snd_pcm_hw_params_set_period_size_near(pcm, hw_params, &frames, &dir)) < 0) {
+        log_error("Cannot set period size: %s", snd_strerror(err));
+        snd_pcm_hw_params_free(hw_params);
+        return -1;
+    }
+    if (setting->buffer_frames) {
+        frames = setting->buffer_frames;
+        if ((err = snd_pcm_hw_params_set_buffer_size_near(pcm, hw_params, &frames)) < 0) {
+            log_error("Cannot set buffer size: %s", snd_strerror(err));
+            snd_pcm_hw_params_free(hw_params);
+            return -1;
+        }
+    }
+
+    if ((err = snd_pcm_hw_params(pcm, hw_params)) < 0) {
+        log_error("Cannot set parameters: %s", snd_strerror(err));
+        snd_pcm_hw_params_free(hw_params);
+        return -1;
+    }
+    snd_pcm_hw_params_get_period_size(hw_params, &setting->period_frames, &dir);
+    snd_pcm_hw_params_get_buffer_size(hw_params, &setting->buffer_frames);
+    snd_pcm_hw_params_free(hw_params);
+
+    if ((err = snd_pcm_prepare(pcm)) < 0) {
+        log_error("Cannot prepare audio interface: %s", snd_strerror(err));
+        return -1;
+    }
+    return 0;
+}
+
+static int query_limits(snd_pcm_t *pcm, unsigned int *rate, unsigned int channels, pcm_limits_t *limits) {
+    snd_pcm_hw_params_t *hw_params;
+    int dir = 0;
+
+    if (snd_pcm_hw_params_malloc(&hw_params) < 0) {
+        return -1;
+    }
+    if (set_base_params(pcm, hw_params, rate, channels) < 0) {
+        snd_pcm_hw_params_free(hw_params);
+        return -1;
+    }
+    if (snd_pcm_hw_params_get_period_size_min(hw_params, &limits->period_min, &dir) < 0) {
+        limits->period_min = PCM_TUNE_MIN_PERIOD;
+    }
+    if (snd_pcm_hw_params_get_period_size_max(hw_params, &limits->period_max, &dir) < 0) {
+        limits->period_max = PCM_TUNE_MAX_PERIOD;
+    }
+    if (snd_pcm_hw_params_get_buffer_size_max(hw_params, &limits->buffer_max) < 0) {
+        limits->buffer_max = (snd_pcm_uframes_t)PCM_TUNE_MAX_PERIOD * PCM_TUNE_MAX_PERIODS_PER_BUFFER;
+    }
+    snd_pcm_hw_params_free(hw_params);
+    return 0;
+}
+
+// Read for one calibration window; fills in the measurement fields
+static int calibrate(snd_pcm_t *pcm, unsigned int *rate, unsigned int channels,
+                     const pcm_tune_config_t *cfg, pcm_setting_t *setting) {
+    size_t max_intervals;
+    double *intervals;
+    int16_t *buffer;
+    size_t n = 0;
+    double period_us;
+    uint64_t start_us, last_us = 0, now_us;
+
+    if (pcm_configure(pcm, rate, channels, setting) < 0) {
+        return -1;
+    }
+    period_us = setting->period_frames * 1e6 / *rate;
+    max_intervals = (size_t)(cfg->window_sec * 1e6 / period_us) + 16;
+    intervals = malloc(max_intervals * sizeof(double));
+    buffer = malloc(setting->period_frames * channels * sizeof(int16_t));
+    if (!intervals || !buffer) {
+        free(intervals);
+        free(buffer);
+        return -1;
+    }
+
+    setting->xruns = 0;
+    setting->peak_fill = 0.0;
+    start_us = monotonic_us();
+    do {
+        snd_pcm_sframes_t got = snd_pcm_readi(pcm, buffer, setting->period_frames);
+        snd_pcm_sframes_t avail;
+
+        now_us = monotonic_us();
+        if (got == -EPIPE) {
+            setting->xruns++;
+            snd_pcm_prepare(pcm);
+            last_us = 0;
+            continue;
+        } else if (got < 0) {
+            log_warning("Calibration read failed at %lu frames/period: %s",
+                        (unsigned long)setting->period_frames, snd_strerror((int)got));
+            free(intervals);
+            free(buffer);
+            return -1;
+        }
+
+        if (last_us && n < max_intervals) {
+            double dev = (double)(now_us - last_us) - period_us;
+            intervals[n++] = dev < 0.0 ? -dev : dev;
+        }
+        last_us = now_us;
+
+        avail = snd_pcm_avail_update(pcm);
+        if (avail > 0 && setting->buffer_frames) {
+            double fill = (double)avail / setting->buffer_frames;
+            if (fill > setting->peak_fill) {
+                setting->peak_fill = fill;
+            }
+        }
+    } while (now_us - start_us < (uint64_t)(cfg->window_sec * 1e6));
+    snd_pcm_drop(pcm);
+
+    setting->jitter_p99_us = 0.0;
+    setting->jitter_max_us = 0.0;
+    if (n > 0) {
+        qsort(intervals, n, sizeof(double), compare_doubles);
+        setting->jitter_p99_us = intervals[(size_t)(0.99 * (n - 1))];
+        setting->jitter_max_us = intervals[n - 1];
+    }
+    free(intervals);
+    free(buffer);
+
+    log_debug("Calibrated %lu/%lu frames: %u xruns, jitter p99 %.0fus max %.0fus, peak fill %.0f%%",
+              (unsigned long)setting->period_frames, (unsigned long)setting->buffer_frames, setting->xruns,
+              setting->jitter_p99_us, setting->jitter_max_us, setting->peak_fill * 100.0);
+    return 0;
+}
+
+static int within_budget(const pcm_tune_config_t *cfg, const pcm_setting_t *setting) {
+    double allowed = cfg->xrun_budget * cfg->window_sec / 60.0;
+    return setting->xruns <= allowed && setting->peak_fill <= cfg->max_fill;
+}
+
+int pcm_auto_tune(snd_pcm_t *pcm, unsigned int *rate, unsigned int channels,
+                  const pcm_tune_config_t *cfg, pcm_setting_t *chosen) {
+    pcm_limits_t limits;
+    snd_pcm_uframes_t max_period;
+    snd_pcm_uframes_t fallback = 0;
+    int found = 0;
+
+    if (query_limits(pcm, rate, channels, &limits) < 0) {
+        return -1;
+    }
+    max_period = (snd_pcm_uframes_t)(cfg->target_latency_ms * *rate / 1000.0);
+    if (max_period > limits.period_max) {
+        max_period = limits.period_max;
+    }
+    if (max_period > PCM_TUNE_MAX_PERIOD) {
+        max_period = PCM_TUNE_MAX_PERIOD;
+    }
+    log_info("Auto-tuning capture period: device allows %lu-%lu frames, target %.1fms, %.1f xruns/min",
+             (unsigned long)limits.period_min, (unsigned long)limits.period_max, cfg->target_latency_ms,
+             cfg->xrun_budget);
+
+    for (snd_pcm_uframes_t period = PCM_TUNE_MIN_PERIOD; period <= max_period && !found; period *= 2) {
+        pcm_setting_t trial;
+
+        if (period < limits.period_min) {
+            continue;
+        }
+        fallback = period;
+
+        // Largest buffer first: if that overruns, smaller ones will too
+        for (int periods = PCM_TUNE_MAX_PERIODS_PER_BUFFER; periods >= 2; periods /= 2) {
+            memset(&trial, 0, sizeof(trial));
+            trial.period_frames = period;
+            trial.buffer_frames = period * periods;
+            if (trial.buffer_frames > limits.buffer_max) {
+                continue;
+            }
+            if (calibrate(pcm, rate, channels, cfg, &trial) < 0 || !within_budget(cfg, &trial)) {
+                break;
+            }
+            *chosen = trial;
+            found = 1;
+        }
+    }
+
+    if (!found) {
+        memset(chosen, 0, sizeof(*chosen));
+        chosen->period_frames = fallback ? fallback : limits.period_min;
+        chosen->buffer_frames = chosen->period_frames * PCM_TUNE_MAX_PERIODS_PER_BUFFER;
+        log_warning("No period up to %.1fms met the xrun budget, using %lu frames",
+                    cfg->target_latency_ms, (unsigned long)chosen->period_frames);
+    }
+
+    pcm_setting_t result = *chosen;
+    if (pcm_configure(pcm, rate, channels, &result) < 0) {
+        return -1;
+    }
+    chosen->period_frames = result.period_frames;
+    chosen->buffer_frames = result.buffer_frames;
+
+    log_info("Auto-tune chose %lu frames/period, %lu frames buffer (%.1fms latency): "
+             "%u xruns, jitter p99 %.0fus, peak fill %.0f%%",
+             (unsigned long)chosen->period_frames, (unsigned long)chosen->buffer_frames,
+             chosen->period_frames * 1000.0 / *rate, chosen->xruns, chosen->jitter_p99_us,
+             chosen->peak_fill * 100.0);
+    return 0;
+}
+
+int pcm_step_up(snd_pcm_t *pcm, unsigned int *rate, unsigned int channels, pcm_setting_t *setting) {
+    pcm_limits_t limits;
+    pcm_setting_t next;
+    snd_pcm_uframes_t periods = 4;
+    // Everything downstream is sized for *rate; a re-tune that ends up at
+    // another rate counts as failed
+    unsigned int granted = *rate;
+
+    if (query_limits(pcm, &granted, channels, &limits) < 0) {
+        return -1;
+    }
+    if (setting->buffer_frames && setting->period_frames) {
+        periods = setting->buffer_frames / setting->period_frames;
+    }
+    memset(&next, 0, sizeof(next));
+    next.period_frames = setting->period_frames * 2;
+    next.buffer_frames = next.period_frames * periods;
+    if (next.period_frames > limits.period_max || next.period_frames > PCM_TUNE_MAX_PERIOD) {
+        return -1;
+    }
+    if (next.buffer_frames > limits.buffer_max) {
+        next.buffer_frames = limits.buffer_max;
+    }
+    granted = *rate;
+    if (pcm_configure(pcm, &granted, channels, &next) < 0 || granted != *rate) {
+        if (granted != *rate) {
+            log_warning("Re-tune changed the sample rate to %u, keeping %u", granted, *rate);
+        }
+        // Put the device back the way it was so capture can go on
+        pcm_setting_t previous = *setting;
+        granted = *rate;
+        pcm_configure(pcm, &granted, channels, &previous);
+        return -1;
+    }
+    *setting = next;
+    return 0;
+}
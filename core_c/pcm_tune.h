@@ -0,0 +1,56 @@
+/*
+ * SilentTrace - Ultrasonic Signal Detector
+ * ALSA Period and Buffer Tuning
+ *
+ * Configures the capture device for a given period and buffer size, and
+ * optionally picks those sizes itself: candidates are tried from the
+ * smallest period up to the latency target, each read for a calibration
+ * window while xruns, wakeup jitter and buffer fill are measured, and the
+ * first one that stays within the xrun budget wins. A running stream can
+ * later step up to the next larger period when it overruns under load.
+ */
+
+#ifndef PCM_TUNE_H
+#define PCM_TUNE_H
+
+#include <alsa/asoundlib.h>
+
+#define PCM_TUNE_MIN_PERIOD 64
+#define PCM_TUNE_MAX_PERIOD 16384
+#define PCM_TUNE_MAX_PERIODS_PER_BUFFER 8
+
+typedef struct {
+    double target_latency_ms;       // largest period considered, in ms
+    double xrun_budget;             // xruns per minute tolerated
+    double window_sec;              // calibration time per candidate
+    double max_fill;                // highest buffer fill seen during calibration, 0-1
+} pcm_tune_config_t;
+
+typedef struct {
+    snd_pcm_uframes_t period_frames;
+    snd_pcm_uframes_t buffer_frames;    // 0 = device default
+
+    // Calibration results of the chosen setting
+    unsigned int xruns;
+    double jitter_p99_us;           // wakeup interval deviation from the period
+    double jitter_max_us;
+    double peak_fill;               // largest buffer fill after a read, 0-1
+} pcm_setting_t;
+
+void pcm_tune_default_config(pcm_tune_config_t *cfg);
+
+// Apply access, format, rate, channels, period and buffer size; the actual
+// sizes granted by the device are written back to setting and *rate
+int pcm_configure(snd_pcm_t *pcm, unsigned int *rate, unsigned int channels, pcm_setting_t *setting);
+
+// Calibrate candidates and leave the device configured with the chosen
+// one. Returns -1 only if the device cannot be configured at all.
+int pcm_auto_tune(snd_pcm_t *pcm, unsigned int *rate, unsigned int channels,
+                  const pcm_tune_config_t *cfg, pcm_setting_t *chosen);
+
+// Reconfigure a running stream with twice the period (same periods per
+// buffer) at the same *rate; returns -1 when the device has nothing larger
+// to offer or would only take it at another rate
+int pcm_step_up(snd_pcm_t *pcm, unsigned int *rate, unsigned int channels, pcm_setting_t *setting);
+
+#endif
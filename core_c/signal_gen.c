@@ -0,0 +1,658 @@
+/*
+ * SilentTrace - Ultrasonic Signal Detector
+ * Synthetic Beacon Signal Generator
+ *
+ * Oscillators are table-lookup DDS (32-bit phase accumulators) so tones,
+ * FSK, chirps and Doppler drift all reduce to an integer add and one
+ * interpolated lookup per sample. Each component renders a whole block
+ * for one channel at a time into float scratch buffers, which keeps the
+ * inner loops short and branch-free.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "signal_gen.h"
+#include "log.h"
+
+#define SYNTH_TABLE_BITS 12
+#define SYNTH_TABLE_SIZE (1u << SYNTH_TABLE_BITS)
+#define SYNTH_FRAC_BITS (32 - SYNTH_TABLE_BITS)
+#define SYNTH_TWO_PI 6.283185307179586
+#define SYNTH_PULSE_RAMP_SEC 0.002
+#define SYNTH_CALIBRATION_SEC 4
+#define SYNTH_SCRATCH_FRAMES 4096
+
+static float sine_table[SYNTH_TABLE_SIZE + 1];
+static int sine_table_ready = 0;
+
+typedef struct {
+    uint32_t phase;
+    int64_t inc;                        // current phase increment per sample
+    int64_t incs[SYNTH_MAX_TONES];      // FSK alphabet / chirp start and end
+    int64_t inc_step;                   // chirp increment change per sample
+    uint64_t pos;                       // samples into current symbol or period
+    uint64_t period_len;                // samples per symbol, sweep or period
+    uint64_t width_len;                 // pulse on-time in samples
+    uint64_t ramp_len;                  // pulse edge length in samples
+    uint32_t mod_phase;                 // Doppler modulator
+    uint32_t mod_inc;
+    float dev_inc;                      // Doppler deviation in increment units
+    float amplitude;
+    uint32_t lfsr;                      // FSK symbol source
+} beacon_state_t;
+
+typedef struct {
+    float b0, a1, a2;
+    float y1, y2;
+} resonator_t;
+
+typedef struct {
+    float pulse_countdown;              // samples to next glottal pulse
+    float f0_period;                    // glottal period in samples
+    resonator_t formants[2];
+    float fric_prev;                    // fricative high-pass state
+    uint64_t syllable_pos;
+    uint64_t syllable_len;
+    int syllable_kind;                  // 0 pause, 1 voiced, 2 fricative
+} speech_state_t;
+
+typedef struct {
+    beacon_state_t beacons[SYNTH_MAX_BEACONS];
+    uint64_t rng;
+    float pink[3];
+    float brown;
+    speech_state_t speech;
+} channel_state_t;
+
+struct synth_gen {
+    synth_config_t cfg;
+    channel_state_t *channels;
+    float noise_gain;
+    float speech_gain;
+    float *mix;
+    float *scratch;
+};
+
+// Vowel formant pairs (F1, F2) in Hz used by the babble model
+static const float vowel_formants[][2] = {
+    {730.0f, 1090.0f}, {270.0f, 2290.0f}, {530.0f, 1840.0f},
+    {570.0f, 840.0f},  {440.0f, 1020.0f}, {300.0f, 870.0f},
+    {660.0f, 1720.0f}, {490.0f, 1350.0f}
+};
+#define N_VOWELS (sizeof(vowel_formants) / sizeof(vowel_formants[0]))
+
+static void init_sine_table(void) {
+    if (sine_table_ready) {
+        return;
+    }
+    for (unsigned int i = 0; i <= SYNTH_TABLE_SIZE; i++) {
+        sine_table[i] = (float)sin(SYNTH_TWO_PI * i / SYNTH_TABLE_SIZE);
+    }
+    sine_table_ready = 1;
+}
+
+static inline float dds_lookup(uint32_t phase) {
+    uint32_t idx = phase >> SYNTH_FRAC_BITS;
+    float frac = (float)(phase & ((1u << SYNTH_FRAC_BITS) - 1)) * (1.0f / (1u << SYNTH_FRAC_BITS));
+    float a = sine_table[idx];
+    return a + (sine_table[idx + 1] - a) * frac;
+}
+
+static int64_t freq_to_inc(double freq_hz, unsigned int sample_rate) {
+    return (int64_t)llround(freq_hz / sample_rate * 4294967296.0);
+}
+
+// splitmix64, used to derive independent per-channel seeds
+static uint64_t splitmix64(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// xorshift64*
+static inline uint64_t rng_next(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static inline float rng_uniform(uint64_t *state) {
+    return (float)(rng_next(state) >> 40) * (1.0f / 16777216.0f);
+}
+
+// Irwin-Hall approximation of N(0, 1) from four 16-bit uniforms of one draw
+static inline float rng_gauss(uint64_t *state) {
+    uint64_t r = rng_next(state);
+    float sum = (float)(r & 0xFFFF) + (float)((r >> 16) & 0xFFFF) +
+                (float)((r >> 32) & 0xFFFF) + (float)(r >> 48);
+    return (sum * (1.0f / 65536.0f) - 2.0f) * 1.7320508f;
+}
+
+static inline uint32_t lfsr_next(uint32_t *lfsr) {
+    // Galois LFSR, taps 32,22,2,1
+    uint32_t x = *lfsr;
+    x = (x >> 1) ^ (-(x & 1u) & 0x80200003u);
+    *lfsr = x;
+    return x;
+}
+
+static void resonator_set(resonator_t *r, float freq_hz, float bandwidth_hz, unsigned int sample_rate) {
+    float radius = expf(-3.14159265f * bandwidth_hz / sample_rate);
+    r->a1 = 2.0f * radius * cosf((float)SYNTH_TWO_PI * freq_hz / sample_rate);
+    r->a2 = -radius * radius;
+    r->b0 = 1.0f - radius;
+}
+
+static void render_beacon(const synth_beacon_t *b, beacon_state_t *s, float *mix, size_t n) {
+    float amp = s->amplitude;
+    uint32_t phase = s->phase;
+    size_t i;
+
+    switch (b->kind) {
+    case SYNTH_TONE: {
+        uint32_t inc = (uint32_t)s->inc;
+        for (i = 0; i < n; i++) {
+            mix[i] += amp * dds_lookup(phase + (uint32_t)i * inc);
+        }
+        phase += (uint32_t)n * inc;
+        break;
+    }
+    case SYNTH_FSK:
+        for (i = 0; i < n; i++) {
+            if (s->pos == s->period_len) {
+                s->pos = 0;
+                s->inc = s->incs[lfsr_next(&s->lfsr) % b->n_freqs];
+            }
+            mix[i] += amp * dds_lookup(phase);
+            phase += (uint32_t)s->inc;
+            s->pos++;
+        }
+        break;
+    case SYNTH_CHIRP:
+        for (i = 0; i < n; i++) {
+            if (s->pos == s->period_len) {
+                s->pos = 0;
+                s->inc = s->incs[0];
+            }
+            mix[i] += amp * dds_lookup(phase);
+            phase += (uint32_t)s->inc;
+            s->inc += s->inc_step;
+            s->pos++;
+        }
+        break;
+    case SYNTH_PULSE: {
+        uint32_t inc = (uint32_t)s->inc;
+        float ramp_scale = s->ramp_len ? 1.0f / s->ramp_len : 1.0f;
+        for (i = 0; i < n; i++) {
+            uint64_t pos = s->pos;
+            if (pos < s->width_len) {
+                float env = 1.0f;
+                if (pos < s->ramp_len) {
+                    env = pos * ramp_scale;
+                } else if (s->width_len - pos < s->ramp_len) {
+                    env = (s->width_len - pos) * ramp_scale;
+                }
+                mix[i] += amp * env * dds_lookup(phase);
+            }
+            phase += inc;
+            if (++s->pos == s->period_len) {
+                s->pos = 0;
+            }
+        }
+        break;
+    }
+    case SYNTH_DOPPLER:
+        for (i = 0; i < n; i++) {
+            int64_t inc = s->inc + (int64_t)(s->dev_inc * dds_lookup(s->mod_phase));
+            mix[i] += amp * dds_lookup(phase);
+            phase += (uint32_t)inc;
+            s->mod_phase += s->mod_inc;
+        }
+        break;
+    }
+
+    s->phase = phase;
+}
+
+static void render_noise(synth_noise_t kind, channel_state_t *ch, float *out, size_t n) {
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        out[i] = rng_gauss(&ch->rng);
+    }
+
+    if (kind == SYNTH_NOISE_PINK) {
+        // Paul Kellet's economy pink filter (-3 dB/octave above ~100 Hz)
+        float b0 = ch->pink[0], b1 = ch->pink[1], b2 = ch->pink[2];
+        for (i = 0; i < n; i++) {
+            float w = out[i];
+            b0 = 0.99765f * b0 + w * 0.0990460f;
+            b1 = 0.96300f * b1 + w * 0.2965164f;
+            b2 = 0.57000f * b2 + w * 1.0526913f;
+            out[i] = b0 + b1 + b2 + w * 0.1848f;
+        }
+        ch->pink[0] = b0;
+        ch->pink[1] = b1;
+        ch->pink[2] = b2;
+    } else if (kind == SYNTH_NOISE_BROWN) {
+        // Leaky integrator (-6 dB/octave)
+        float y = ch->brown;
+        for (i = 0; i < n; i++) {
+            y = 0.995f * y + 0.1f * out[i];
+            out[i] = y;
+        }
+        ch->brown = y;
+    }
+}
+
+static void next_syllable(speech_state_t *sp, uint64_t *rng, unsigned int sample_rate) {
+    float r = rng_uniform(rng);
+
+    sp->syllable_pos = 0;
+    sp->syllable_len = (uint64_t)((0.12f + 0.2f * rng_uniform(rng)) * sample_rate);
+    sp->syllable_kind = r < 0.2f ? 0 : (r < 0.85f ? 1 : 2);
+
+    if (sp->syllable_kind == 1) {
+        const float *f = vowel_formants[rng_next(rng) % N_VOWELS];
+        resonator_set(&sp->formants[0], f[0], 80.0f, sample_rate);
+        resonator_set(&sp->formants[1], f[1], 120.0f, sample_rate);
+        sp->f0_period = sample_rate / (100.0f + 120.0f * rng_uniform(rng));
+    }
+}
+
+// Babble model: glottal pulse train through two vowel formants, with
+// syllabic envelope, pauses and broadband fricatives that reach into
+// the ultrasonic band like real sibilants do
+static void render_speech(channel_state_t *ch, float *out, size_t n, unsigned int sample_rate) {
+    speech_state_t *sp = &ch->speech;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        float x = 0.0f;
+
+        if (sp->syllable_pos >= sp->syllable_len) {
+            next_syllable(sp, &ch->rng, sample_rate);
+        }
+
+        float env = dds_lookup((uint32_t)((double)sp->syllable_pos / sp->syllable_len * 2147483648.0));
+        sp->syllable_pos++;
+
+        if (sp->syllable_kind == 1) {
+            float excitation = 0.0f;
+            if (--sp->pulse_countdown <= 0.0f) {
+                excitation = 1.0f;
+                sp->pulse_countdown += sp->f0_period * (0.97f + 0.06f * rng_uniform(&ch->rng));
+            }
+            for (int k = 0; k < 2; k++) {
+                resonator_t *r = &sp->formants[k];
+                float y = r->b0 * excitation + r->a1 * r->y1 + r->a2 * r->y2;
+                r->y2 = r->y1;
+                r->y1 = y;
+                x += y;
+            }
+        } else if (sp->syllable_kind == 2) {
+            float w = rng_gauss(&ch->rng);
+            x = 0.5f * (w - sp->fric_prev);
+            sp->fric_prev = w;
+        }
+
+        out[i] = env * x;
+    }
+}
+
+// Measure the RMS of a unit generator so it can be scaled to a target power
+static float calibrate_rms(const synth_config_t *cfg, int speech) {
+    channel_state_t ch;
+    size_t total = (size_t)cfg->sample_rate * SYNTH_CALIBRATION_SEC;
+    size_t done = 0;
+    double energy = 0.0;
+    float buf[1024];
+
+    memset(&ch, 0, sizeof(ch));
+    ch.rng = 0x5DEECE66DULL;
+    ch.speech.syllable_len = 0;
+    ch.speech.pulse_countdown = 1.0f;
+
+    while (done < total) {
+        size_t n = total - done < 1024 ? total - done : 1024;
+        if (speech) {
+            render_speech(&ch, buf, n, cfg->sample_rate);
+        } else {
+            render_noise(cfg->noise, &ch, buf, n);
+        }
+        for (size_t i = 0; i < n; i++) {
+            energy += (double)buf[i] * buf[i];
+        }
+        done += n;
+    }
+
+    return (float)sqrt(energy / total);
+}
+
+static int validate_beacon(const synth_beacon_t *b, unsigned int sample_rate) {
+    double nyquist = sample_rate / 2.0;
+
+    for (size_t k = 0; k < b->n_freqs; k++) {
+        if (b->freqs[k] <= 0.0 || b->freqs[k] >= nyquist) {
+            log_error("Beacon frequency %.1fHz outside (0, %.1f)Hz", b->freqs[k], nyquist);
+            return -1;
+        }
+    }
+    if (b->kind == SYNTH_DOPPLER) {
+        if (b->dev_hz < 0.0) {
+            log_error("Doppler deviation %.1fHz is negative", b->dev_hz);
+            return -1;
+        }
+        if (b->freqs[0] - b->dev_hz <= 0.0 || b->freqs[0] + b->dev_hz >= nyquist) {
+            log_error("Doppler sweep %.1f +/- %.1fHz outside (0, %.1f)Hz",
+                      b->freqs[0], b->dev_hz, nyquist);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void synth_default_config(synth_config_t *cfg, unsigned int sample_rate, unsigned int channels) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->sample_rate = sample_rate;
+    cfg->channels = channels;
+    cfg->level_dbfs = -30.0;
+    cfg->noise = SYNTH_NOISE_PINK;
+    cfg->snr_db = 10.0;
+    cfg->speech_enabled = 0;
+    cfg->sir_db = 0.0;
+    cfg->seed = 1;
+
+    synth_parse_beacon("tone,f=19500", &cfg->beacons[cfg->n_beacons++]);
+    synth_parse_beacon("fsk,f=18500/18700,baud=50", &cfg->beacons[cfg->n_beacons++]);
+    synth_parse_beacon("chirp,f=20000/21500,period=0.2", &cfg->beacons[cfg->n_beacons++]);
+    synth_parse_beacon("pulse,f=20800,period=0.5,width=0.05", &cfg->beacons[cfg->n_beacons++]);
+    synth_parse_beacon("doppler,f=19000,dev=25,rate=0.2", &cfg->beacons[cfg->n_beacons++]);
+}
+
+int synth_parse_beacon(const char *spec, synth_beacon_t *beacon) {
+    char buf[256];
+    char *save = NULL;
+    char *tok;
+
+    if (strlen(spec) >= sizeof(buf)) {
+        log_error("Beacon spec too long: %s", spec);
+        return -1;
+    }
+    strcpy(buf, spec);
+
+    memset(beacon, 0, sizeof(*beacon));
+    beacon->baud = 50.0;
+    beacon->dev_hz = 20.0;
+    beacon->rate_hz = 0.25;
+    beacon->width_sec = 0.05;
+
+    tok = strtok_r(buf, ",", &save);
+    if (!tok) {
+        log_error("Empty beacon spec");
+        return -1;
+    }
+
+    if (strcmp(tok, "tone") == 0) {
+        beacon->kind = SYNTH_TONE;
+    } else if (strcmp(tok, "fsk") == 0) {
+        beacon->kind = SYNTH_FSK;
+    } else if (strcmp(tok, "chirp") == 0) {
+        beacon->kind = SYNTH_CHIRP;
+        beacon->period_sec = 0.1;
+    } else if (strcmp(tok, "pulse") == 0) {
+        beacon->kind = SYNTH_PULSE;
+        beacon->period_sec = 0.5;
+    } else if (strcmp(tok, "doppler") == 0) {
+        beacon->kind = SYNTH_DOPPLER;
+    } else {
+        log_error("Unknown beacon kind: %s", tok);
+        return -1;
+    }
+
+    while ((tok = strtok_r(NULL, ",", &save)) != NULL) {
+        char *eq = strchr(tok, '=');
+        if (!eq) {
+            log_error("Expected key=value in beacon spec: %s", tok);
+            return -1;
+        }
+        *eq = '\0';
+        const char *key = tok;
+        char *value = eq + 1;
+
+        if (strcmp(key, "f") == 0) {
+            char *fsave = NULL;
+            char *f;
+            for (f = strtok_r(value, "/", &fsave); f; f = strtok_r(NULL, "/", &fsave)) {
+                if (beacon->n_freqs == SYNTH_MAX_TONES) {
+                    log_error("At most %d frequencies per beacon", SYNTH_MAX_TONES);
+                    return -1;
+                }
+                beacon->freqs[beacon->n_freqs++] = atof(f);
+            }
+        } else if (strcmp(key, "baud") == 0) {
+            beacon->baud = atof(value);
+        } else if (strcmp(key, "period") == 0) {
+            beacon->period_sec = atof(value);
+        } else if (strcmp(key, "width") == 0) {
+            beacon->width_sec = atof(value);
+        } else if (strcmp(key, "dev") == 0) {
+            beacon->dev_hz = atof(value);
+        } else if (strcmp(key, "rate") == 0) {
+            beacon->rate_hz = atof(value);
+        } else if (strcmp(key, "level") == 0) {
+            beacon->level_db = atof(value);
+        } else {
+            log_error("Unknown beacon parameter: %s", key);
+            return -1;
+        }
+    }
+
+    if (beacon->n_freqs == 0 ||
+        (beacon->kind == SYNTH_FSK && beacon->n_freqs < 2) ||
+        (beacon->kind == SYNTH_CHIRP && beacon->n_freqs != 2)) {
+        log_error("Beacon '%s' needs f= (FSK: 2+ tones, chirp: start/end)", spec);
+        return -1;
+    }
+    if ((beacon->kind == SYNTH_FSK && beacon->baud <= 0.0) ||
+        ((beacon->kind == SYNTH_CHIRP || beacon->kind == SYNTH_PULSE) && beacon->period_sec <= 0.0) ||
+        (beacon->kind == SYNTH_PULSE && (beacon->width_sec <= 0.0 || beacon->width_sec > beacon->period_sec))) {
+        log_error("Invalid timing parameters in beacon '%s'", spec);
+        return -1;
+    }
+
+    return 0;
+}
+
+int synth_parse_noise(const char *name, synth_noise_t *noise) {
+    if (strcmp(name, "white") == 0) {
+        *noise = SYNTH_NOISE_WHITE;
+    } else if (strcmp(name, "pink") == 0) {
+        *noise = SYNTH_NOISE_PINK;
+    } else if (strcmp(name, "brown") == 0) {
+        *noise = SYNTH_NOISE_BROWN;
+    } else {
+        log_error("Unknown noise color: %s", name);
+        return -1;
+    }
+    return 0;
+}
+
+synth_gen_t *synth_create(const synth_config_t *cfg) {
+    synth_gen_t *gen;
+    uint64_t seed_state = cfg->seed;
+    double ref_amp = sqrt(2.0) * pow(10.0, cfg->level_dbfs / 20.0);
+    double beacon_power = 0.0;
+    unsigned int fs = cfg->sample_rate;
+
+    if (cfg->channels == 0 || fs == 0) {
+        log_error("Synthetic source needs a sample rate and at least one channel");
+        return NULL;
+    }
+    for (size_t b = 0; b < cfg->n_beacons; b++) {
+        if (validate_beacon(&cfg->beacons[b], fs) < 0) {
+            return NULL;
+        }
+    }
+
+    init_sine_table();
+
+    gen = calloc(1, sizeof(*gen));
+    if (!gen) {
+        return NULL;
+    }
+    gen->cfg = *cfg;
+    gen->channels = calloc(cfg->channels, sizeof(channel_state_t));
+    gen->mix = malloc(SYNTH_SCRATCH_FRAMES * sizeof(float));
+    gen->scratch = malloc(SYNTH_SCRATCH_FRAMES * sizeof(float));
+    if (!gen->channels || !gen->mix || !gen->scratch) {
+        synth_destroy(gen);
+        return NULL;
+    }
+
+    for (unsigned int c = 0; c < cfg->channels; c++) {
+        channel_state_t *ch = &gen->channels[c];
+        ch->rng = splitmix64(&seed_state) | 1;
+        ch->speech.pulse_countdown = 1.0f;
+
+        for (size_t b = 0; b < cfg->n_beacons; b++) {
+            const synth_beacon_t *bc = &cfg->beacons[b];
+            beacon_state_t *s = &ch->beacons[b];
+            double amp = ref_amp * pow(10.0, bc->level_db / 20.0);
+
+            s->amplitude = (float)amp;
+            s->phase = (uint32_t)rng_next(&ch->rng);
+            s->lfsr = (uint32_t)rng_next(&ch->rng) | 1;
+            for (size_t k = 0; k < bc->n_freqs; k++) {
+                s->incs[k] = freq_to_inc(bc->freqs[k], fs);
+            }
+            s->inc = s->incs[0];
+
+            switch (bc->kind) {
+            case SYNTH_TONE:
+                break;
+            case SYNTH_FSK:
+                s->period_len = (uint64_t)llround(fs / bc->baud);
+                if (s->period_len == 0) {
+                    s->period_len = 1;
+                }
+                s->pos = s->period_len;
+                break;
+            case SYNTH_CHIRP:
+                s->period_len = (uint64_t)llround(bc->period_sec * fs);
+                if (s->period_len == 0) {
+                    s->period_len = 1;
+                }
+                s->inc_step = (s->incs[1] - s->incs[0]) / (int64_t)s->period_len;
+                s->pos = rng_next(&ch->rng) % s->period_len;
+                s->inc = s->incs[0] + s->inc_step * (int64_t)s->pos;
+                break;
+            case SYNTH_PULSE:
+                s->period_len = (uint64_t)llround(bc->period_sec * fs);
+                s->width_len = (uint64_t)llround(bc->width_sec * fs);
+                s->ramp_len = (uint64_t)llround(SYNTH_PULSE_RAMP_SEC * fs);
+                if (s->period_len == 0) {
+                    s->period_len = 1;
+                }
+                if (2 * s->ramp_len > s->width_len) {
+                    s->ramp_len = s->width_len / 2;
+                }
+                s->pos = rng_next(&ch->rng) % s->period_len;
+                break;
+            case SYNTH_DOPPLER:
+                s->mod_inc = (uint32_t)freq_to_inc(bc->rate_hz, fs);
+                s->mod_phase = (uint32_t)rng_next(&ch->rng);
+                s->dev_inc = (float)freq_to_inc(bc->dev_hz, fs);
+                break;
+            }
+        }
+    }
+
+    // Every channel carries the full mix, so beacon power is per channel
+    for (size_t b = 0; b < cfg->n_beacons; b++) {
+        const synth_beacon_t *bc = &cfg->beacons[b];
+        double amp = ref_amp * pow(10.0, bc->level_db / 20.0);
+        double duty = bc->kind == SYNTH_PULSE ? bc->width_sec / bc->period_sec : 1.0;
+        beacon_power += amp * amp / 2.0 * duty;
+    }
+    if (beacon_power <= 0.0) {
+        // No beacons: use the reference level so SNR still sets the noise level
+        beacon_power = ref_amp * ref_amp / 2.0;
+    }
+
+    gen->noise_gain = (float)(sqrt(beacon_power / pow(10.0, cfg->snr_db / 10.0)) /
+                              calibrate_rms(cfg, 0));
+    if (cfg->speech_enabled) {
+        gen->speech_gain = (float)(sqrt(beacon_power / pow(10.0, cfg->sir_db / 10.0)) /
+                                   calibrate_rms(cfg, 1));
+    }
+
+    return gen;
+}
+
+void synth_destroy(synth_gen_t *gen) {
+    if (!gen) {
+        return;
+    }
+    free(gen->channels);
+    free(gen->mix);
+    free(gen->scratch);
+    free(gen);
+}
+
+int synth_generate(synth_gen_t *gen, int16_t *out, size_t frames) {
+    const synth_config_t *cfg = &gen->cfg;
+    unsigned int nch = cfg->channels;
+    size_t done = 0;
+
+    while (done < frames) {
+        size_t n = frames - done;
+        if (n > SYNTH_SCRATCH_FRAMES) {
+            n = SYNTH_SCRATCH_FRAMES;
+        }
+
+        for (unsigned int c = 0; c < nch; c++) {
+            channel_state_t *ch = &gen->channels[c];
+            float *mix = gen->mix;
+            float *tmp = gen->scratch;
+            int16_t *dst = out + done * nch + c;
+            size_t i;
+
+            memset(mix, 0, n * sizeof(float));
+
+            for (size_t b = 0; b < cfg->n_beacons; b++) {
+                render_beacon(&cfg->beacons[b], &ch->beacons[b], mix, n);
+            }
+
+            render_noise(cfg->noise, ch, tmp, n);
+            for (i = 0; i < n; i++) {
+                mix[i] += gen->noise_gain * tmp[i];
+            }
+
+            if (cfg->speech_enabled) {
+                render_speech(ch, tmp, n, cfg->sample_rate);
+                for (i = 0; i < n; i++) {
+                    mix[i] += gen->speech_gain * tmp[i];
+                }
+            }
+
+            for (i = 0; i < n; i++) {
+                float v = mix[i] * 32767.0f;
+                v = v > 32767.0f ? 32767.0f : (v < -32768.0f ? -32768.0f : v);
+                dst[i * nch] = (int16_t)lrintf(v);
+            }
+        }
+
+        done += n;
+    }
+
+    return 0;
+}
@@ -0,0 +1,76 @@
+/*
+ * SilentTrace - Ultrasonic Signal Detector
+ * Synthetic Beacon Signal Generator
+ *
+ * Reproducible multi-channel workload source for load and detection
+ * benchmarking without audio hardware. Each channel mixes a set of
+ * ultrasonic beacons with colored noise and optional speech-like
+ * interference at a chosen signal-to-noise ratio.
+ */
+
+#ifndef SIGNAL_GEN_H
+#define SIGNAL_GEN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SYNTH_MAX_BEACONS 16
+#define SYNTH_MAX_TONES 8
+
+typedef enum {
+    SYNTH_TONE,     // constant carrier
+    SYNTH_FSK,      // continuous-phase M-FSK with pseudo-random symbols
+    SYNTH_CHIRP,    // repeating linear sweep between two frequencies
+    SYNTH_PULSE,    // tone bursts on a fixed repetition period
+    SYNTH_DOPPLER   // carrier with sinusoidal frequency drift
+} synth_beacon_kind_t;
+
+typedef enum {
+    SYNTH_NOISE_WHITE,
+    SYNTH_NOISE_PINK,
+    SYNTH_NOISE_BROWN
+} synth_noise_t;
+
+typedef struct {
+    synth_beacon_kind_t kind;
+    double freqs[SYNTH_MAX_TONES];  // carrier, FSK alphabet or chirp start/end
+    size_t n_freqs;
+    double baud;                    // FSK symbol rate
+    double period_sec;              // chirp sweep or pulse repetition period
+    double width_sec;               // pulse on-time
+    double dev_hz;                  // Doppler peak deviation
+    double rate_hz;                 // Doppler modulation rate
+    double level_db;                // relative to the reference beacon level
+} synth_beacon_t;
+
+typedef struct {
+    unsigned int sample_rate;
+    unsigned int channels;
+    synth_beacon_t beacons[SYNTH_MAX_BEACONS];
+    size_t n_beacons;
+    double level_dbfs;      // RMS level of a 0 dB beacon
+    synth_noise_t noise;
+    double snr_db;          // total beacon power over noise power
+    int speech_enabled;
+    double sir_db;          // total beacon power over speech power
+    uint64_t seed;
+} synth_config_t;
+
+typedef struct synth_gen synth_gen_t;
+
+// Fill cfg with the default beacon mix (one of each kind) and levels
+void synth_default_config(synth_config_t *cfg, unsigned int sample_rate, unsigned int channels);
+
+// Parse "kind,key=value,..." (e.g. "fsk,f=18500/18700,baud=50") into a beacon
+int synth_parse_beacon(const char *spec, synth_beacon_t *beacon);
+
+// Parse "white", "pink" or "brown"
+int synth_parse_noise(const char *name, synth_noise_t *noise);
+
+synth_gen_t *synth_create(const synth_config_t *cfg);
+void synth_destroy(synth_gen_t *gen);
+
+// Render the next frames of interleaved S16 audio for every channel
+int synth_generate(synth_gen_t *gen, int16_t *out, size_t frames);
+
+#endif
@@ -0,0 +1,186 @@
+/*
+ * SilentTrace - Ultrasonic Signal Detector
+ * silenttrace-top: live view of the capture daemon's pipeline stats
+ *
+ * Maps the shared-memory stats page read-only and redraws once per
+ * interval. Reading never blocks or slows the capture thread.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "stats.h"
+
+static volatile int running = 1;
+
+static void handle_signal(int sig) {
+    (void)sig;
+    running = 0;
+}
+
+static double rate_per_sec(uint64_t now, uint64_t before, double sec) {
+    return sec > 0.0 && now >= before ? (now - before) / sec : 0.0;
+}
+
+static void format_bytes(double bytes, char *out, size_t len) {
+    const char *units[] = {"B", "KB", "MB", "GB", "TB"};
+    int u = 0;
+    while (bytes >= 1024.0 && u < 4) {
+        bytes /= 1024.0;
+        u++;
+    }
+    snprintf(out, len, "%.1f%s", bytes, units[u]);
+}
+
+static void print_histogram(const char *label, const stats_histogram_t *h) {
+    printf("%-10s n=%-10llu avg=%8.1fus  p50<%-8llu p99<%-8llu p99.9<%-8llu max=%lluus\n", label,
+           (unsigned long long)h->count, h->count ? (double)h->sum_us / h->count : 0.0,
+           (unsigned long long)stats_hist_percentile(h, 0.50),
+           (unsigned long long)stats_hist_percentile(h, 0.99),
+           (unsigned long long)stats_hist_percentile(h, 0.999),
+           (unsigned long long)h->max_us);
+}
+
+static void print_page(const stats_page_t *s, const stats_page_t *prev, double sec, int clear) {
+    char sent[32];
+    char rate[32];
+    char archived[32];
+    uint64_t now_ms;
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    now_ms = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+
+    if (clear) {
+        printf("\033[H\033[2J");
+    }
+    printf("SilentTrace capture  pid %u  up %llus  %uHz x %u ch, %u frames/period, %u buffer%s\n",
+           s->pid, (unsigned long long)((s->update_time_ms - s->start_time_ms) / 1000),
+           s->sample_rate, s->channels, s->period_frames, s->buffer_frames,
+           now_ms > s->update_time_ms + 5000 ? "  [STALE]" : "");
+
+    format_bytes((double)s->bytes_sent, sent, sizeof(sent));
+    format_bytes(rate_per_sec(s->bytes_sent, prev->bytes_sent, sec), rate, sizeof(rate));
+    format_bytes((double)s->archive_bytes_written, archived, sizeof(archived));
+
+    printf("\nframes    %-14llu %10.0f/s   periods %llu\n",
+           (unsigned long long)s->frames_captured,
+           rate_per_sec(s->frames_captured, prev->frames_captured, sec),
+           (unsigned long long)s->periods);
+    printf("xruns     %-14llu lost frames %llu   read errors %llu   re-tunes %u\n",
+           (unsigned long long)s->xruns, (unsigned long long)s->frames_lost,
+           (unsigned long long)s->read_errors, s->retunes);
+    printf("sent      %-14llu chunks  %s (%s/s)\n",
+           (unsigned long long)s->chunks_sent, sent, rate);
+    printf("archive   %s written, %llu frames dropped   clips %llu\n", archived,
+           (unsigned long long)s->archive_frames_dropped, (unsigned long long)s->clips_written);
+
+    if (s->gate_enabled) {
+        printf("level     rms %.1fdBFS  peak %.1fdBFS\n", s->rms_dbfs, s->peak_dbfs);
+        printf("gate      %-6s band %.1fdBFS  floor %.1fdBFS  trips %llu  chunks held %llu\n",
+               s->gate_open ? "OPEN" : "closed", s->gate_band_dbfs, s->gate_floor_dbfs,
+               (unsigned long long)s->gate_trips, (unsigned long long)s->chunks_gated);
+    }
+
+    printf("\n");
+    print_histogram("read wait", &s->read_wait);
+    print_histogram("send", &s->send_time);
+
+    printf("\nclient  state         queue     chunks      bytes   drops\n");
+    for (uint32_t i = 0; i < s->n_clients && i < STATS_MAX_CLIENTS; i++) {
+        const stats_client_t *c = &s->clients[i];
+        char bytes[32];
+        format_bytes((double)c->bytes_sent, bytes, sizeof(bytes));
+        printf("%-7u %-12s %6u %10llu %10s %7llu\n", i, c->connected ? "connected" : "disconnected",
+               c->queue_bytes, (unsigned long long)c->chunks_sent, bytes, (unsigned long long)c->drops);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    static const struct option long_options[] = {
+        {"name",     required_argument, NULL, 'n'},
+        {"interval", required_argument, NULL, 'i'},
+        {"once",     no_argument,       NULL, '1'},
+        {"help",     no_argument,       NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    const char *name = STATS_DEFAULT_NAME;
+    double interval = 1.0;
+    int once = 0;
+    int opt;
+    const stats_page_t *page;
+    stats_page_t current;
+    stats_page_t previous;
+
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'n':
+            name = optarg;
+            break;
+        case 'i':
+            interval = atof(optarg);
+            break;
+        case '1':
+            once = 1;
+            break;
+        case 'h':
+        default:
+            fprintf(stderr,
+                    "Usage: %s [options]\n"
+                    "  --name NAME       Stats page to read (default: %s)\n"
+                    "  --interval SEC    Refresh interval (default: 1)\n"
+                    "  --once            Print one snapshot and exit\n",
+                    argv[0], STATS_DEFAULT_NAME);
+            return 1;
+        }
+    }
+    if (interval <= 0.0) {
+        interval = 1.0;
+    }
+
+    page = stats_attach(name);
+    if (!page) {
+        fprintf(stderr, "[ERROR] Cannot open stats page %s: %s (is audio_capture running?)\n",
+                name, strerror(errno));
+        return 1;
+    }
+    if (stats_snapshot(page, &previous) < 0) {
+        fprintf(stderr, "[ERROR] Stats page %s has an incompatible layout\n", name);
+        stats_detach(page);
+        return 1;
+    }
+
+    if (once) {
+        print_page(&previous, &previous, 0.0, 0);
+        stats_detach(page);
+        return 0;
+    }
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+
+    while (running) {
+        struct timespec delay;
+        delay.tv_sec = (time_t)interval;
+        delay.tv_nsec = (long)((interval - (double)delay.tv_sec) * 1e9);
+        nanosleep(&delay, NULL);
+
+        if (stats_snapshot(page, &current) < 0) {
+            fprintf(stderr, "[ERROR] Lost consistent view of %s\n", name);
+            break;
+        }
+        print_page(&current, &previous, (current.update_time_ms - previous.update_time_ms) / 1000.0, 1);
+        previous = current;
+    }
+
+    stats_detach(page);
+    return 0;
+}
@@ -0,0 +1,160 @@
+/*
+ * SilentTrace - Ultrasonic Signal Detector
+ * Shared-Memory Pipeline Statistics
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "stats.h"
+#include "log.h"
+
+#define SNAPSHOT_RETRIES 1000
+
+static uint64_t realtime_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+stats_page_t *stats_create(const char *name) {
+    stats_page_t *page;
+    int fd;
+
+    shm_unlink(name);
+    fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        log_warning("Cannot create stats page %s: %s", name, strerror(errno));
+        return NULL;
+    }
+    if (ftruncate(fd, sizeof(stats_page_t)) < 0) {
+        log_warning("Cannot size stats page %s: %s", name, strerror(errno));
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    page = mmap(NULL, sizeof(stats_page_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED) {
+        log_warning("Cannot map stats page %s: %s", name, strerror(errno));
+        shm_unlink(name);
+        return NULL;
+    }
+
+    memset(page, 0, sizeof(*page));
+    page->version = STATS_VERSION;
+    page->size = sizeof(stats_page_t);
+    page->pid = (uint32_t)getpid();
+    page->start_time_ms = realtime_ms();
+    page->update_time_ms = page->start_time_ms;
+    // Magic last: readers treat the page as valid once it appears
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(page->magic, STATS_MAGIC, sizeof(page->magic));
+
+    log_info("Pipeline stats published at /dev/shm%s", name);
+    return page;
+}
+
+void stats_destroy(stats_page_t *page, const char *name) {
+    if (!page) {
+        return;
+    }
+    munmap(page, sizeof(*page));
+    shm_unlink(name);
+}
+
+void stats_begin(stats_page_t *page) {
+    __atomic_store_n(&page->seq, page->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void stats_end(stats_page_t *page) {
+    page->update_time_ms = realtime_ms();
+    __atomic_store_n(&page->seq, page->seq + 1, __ATOMIC_RELEASE);
+}
+
+void stats_hist_add(stats_histogram_t *hist, uint64_t us) {
+    unsigned int bucket = us ? 64 - (unsigned int)__builtin_clzll(us) : 0;
+
+    if (bucket >= STATS_HIST_BUCKETS) {
+        bucket = STATS_HIST_BUCKETS - 1;
+    }
+    hist->buckets[bucket]++;
+    hist->count++;
+    hist->sum_us += us;
+    if (us > hist->max_us) {
+        hist->max_us = us;
+    }
+}
+
+const stats_page_t *stats_attach(const char *name) {
+    const stats_page_t *page;
+    struct stat st;
+    int fd = shm_open(name, O_RDONLY, 0);
+
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(stats_page_t)) {
+        close(fd);
+        errno = EPROTO;
+        return NULL;
+    }
+    page = mmap(NULL, sizeof(stats_page_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED) {
+        return NULL;
+    }
+    return page;
+}
+
+void stats_detach(const stats_page_t *page) {
+    if (page) {
+        munmap((void *)page, sizeof(*page));
+    }
+}
+
+int stats_snapshot(const stats_page_t *page, stats_page_t *out) {
+    for (int attempt = 0; attempt < SNAPSHOT_RETRIES; attempt++) {
+        uint32_t before = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+        if (before & 1) {
+            sched_yield();
+            continue;
+        }
+        memcpy(out, page, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&page->seq, __ATOMIC_RELAXED) == before) {
+            if (memcmp(out->magic, STATS_MAGIC, sizeof(out->magic)) != 0 ||
+                out->version != STATS_VERSION || out->size != sizeof(stats_page_t)) {
+                return -1;
+            }
+            return 0;
+        }
+    }
+    return -1;
+}
+
+uint64_t stats_hist_percentile(const stats_histogram_t *hist, double fraction) {
+    uint64_t target = (uint64_t)(hist->count * fraction);
+    uint64_t seen = 0;
+
+    if (hist->count == 0) {
+        return 0;
+    }
+    for (unsigned int i = 0; i < STATS_HIST_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen > target) {
+            return i ? 1ULL << i : 1;
+        }
+    }
+    return hist->max_us;
+}
@@ -0,0 +1,101 @@
+/*
+ * SilentTrace - Ultrasonic Signal Detector
+ * Shared-Memory Pipeline Statistics
+ *
+ * The capture daemon keeps its counters in a POSIX shared-memory page that
+ * any number of readers (silenttrace-top) can map read-only. The capture
+ * thread is the only writer and never waits: updates are bracketed by a
+ * sequence counter (odd while writing) and readers retry their copy until
+ * they see the same even value before and after.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define STATS_MAGIC "STSTATS1"
+#define STATS_VERSION 3
+#define STATS_DEFAULT_NAME "/silenttrace-stats"
+#define STATS_MAX_CLIENTS 8
+#define STATS_HIST_BUCKETS 32   // bucket i: [2^(i-1), 2^i) microseconds
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum_us;
+    uint64_t max_us;
+    uint64_t buckets[STATS_HIST_BUCKETS];
+} stats_histogram_t;
+
+typedef struct {
+    uint32_t connected;
+    uint32_t queue_bytes;           // unsent bytes in the socket send queue
+    uint64_t chunks_sent;
+    uint64_t bytes_sent;
+    uint64_t drops;                 // chunks not delivered to this client
+} stats_client_t;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t size;                  // sizeof(stats_page_t) of the writer
+    uint32_t seq;                   // odd while an update is in progress
+    uint32_t pid;
+    uint64_t start_time_ms;
+    uint64_t update_time_ms;
+
+    uint32_t sample_rate;
+    uint32_t channels;
+    uint32_t period_frames;
+    uint32_t buffer_frames;         // 0 = device default
+    uint32_t retunes;               // period step-ups after xruns
+    uint32_t n_clients;
+
+    uint64_t frames_captured;
+    uint64_t periods;
+    uint64_t xruns;
+    uint64_t frames_lost;           // estimated from the gap around each xrun
+    uint64_t read_errors;
+    uint64_t chunks_sent;
+    uint64_t bytes_sent;
+
+    uint64_t archive_bytes_written;
+    uint64_t archive_frames_dropped;
+    uint64_t clips_written;
+
+    uint32_t gate_enabled;
+    uint32_t gate_open;
+    uint64_t gate_trips;
+    uint64_t chunks_gated;          // chunks held back while the gate was closed
+    double rms_dbfs;                // last period, loudest channel
+    double peak_dbfs;
+    double gate_band_dbfs;
+    double gate_floor_dbfs;
+
+    stats_histogram_t read_wait;    // time blocked in snd_pcm_readi()
+    stats_histogram_t send_time;    // time to frame and send one chunk
+    stats_client_t clients[STATS_MAX_CLIENTS];
+} stats_page_t;
+
+// Create (or replace) the named page; returns NULL if shared memory is
+// unavailable, in which case callers simply run without stats
+stats_page_t *stats_create(const char *name);
+void stats_destroy(stats_page_t *page, const char *name);
+
+// Writer side: bracket every batch of updates
+void stats_begin(stats_page_t *page);
+void stats_end(stats_page_t *page);
+
+void stats_hist_add(stats_histogram_t *hist, uint64_t us);
+
+// Reader side: map an existing page read-only and take consistent copies
+const stats_page_t *stats_attach(const char *name);
+void stats_detach(const stats_page_t *page);
+int stats_snapshot(const stats_page_t *page, stats_page_t *out);
+
+// Value below which the given fraction of histogram samples fall, in
+// microseconds (bucket upper bound)
+uint64_t stats_hist_percentile(const stats_histogram_t *hist, double fraction);
+
+#endif
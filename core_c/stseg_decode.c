@@ -0,0 +1,224 @@
+/*
+ * SilentTrace - Ultrasonic Signal Detector
+ * Archive Segment Decoder
+ *
+ * Converts one archive segment (any format) into a 16-bit WAV file. Band
+ * segments are expanded back to the capture rate with the band in its
+ * original place, unless --stored asks for the decimated samples as kept.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include "archive.h"
+#include "codec.h"
+#include "wav.h"
+
+#define V1_HEADER_BYTES 56  // archive_segment_header_t up to data_bytes
+
+static int write_wav_header(FILE *f, unsigned int rate, unsigned int channels, uint64_t frames) {
+    uint8_t hdr[WAV_HEADER_BYTES];
+
+    if (wav_header(hdr, rate, channels, frames) < 0) {
+        fprintf(stderr, "[ERROR] Decoded audio exceeds the 4GB WAV limit\n");
+        return -1;
+    }
+    if (fseek(f, 0, SEEK_SET) != 0 || fwrite(hdr, 1, sizeof(hdr), f) != sizeof(hdr)) {
+        return -1;
+    }
+    return 0;
+}
+
+static uint8_t *read_file(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    uint8_t *data = NULL;
+    long size;
+
+    if (!f) {
+        fprintf(stderr, "[ERROR] Cannot open %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    if (fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) >= 0 && fseek(f, 0, SEEK_SET) == 0) {
+        data = malloc(size > 0 ? (size_t)size : 1);
+        if (data && fread(data, 1, (size_t)size, f) != (size_t)size) {
+            free(data);
+            data = NULL;
+        }
+        *len = (size_t)size;
+    }
+    if (!data) {
+        fprintf(stderr, "[ERROR] Cannot read %s\n", path);
+    }
+    fclose(f);
+    return data;
+}
+
+// Decimated band frames are expanded before writing; the first
+// taps - decimation expanded frames are filter delay and are skipped, so
+// the output lines up with the segment start time
+typedef struct {
+    FILE *out;
+    unsigned int channels;
+    band_filter_t *band;
+    int16_t *expanded;
+    uint64_t skip;
+    uint64_t frames;
+} output_t;
+
+static int emit(output_t *o, const int16_t *frames, size_t n_frames) {
+    if (o->band) {
+        n_frames = band_expand(o->band, frames, n_frames, o->expanded);
+        frames = o->expanded;
+    }
+    if (o->skip) {
+        size_t drop = o->skip < n_frames ? (size_t)o->skip : n_frames;
+        frames += drop * o->channels;
+        n_frames -= drop;
+        o->skip -= drop;
+    }
+    if (n_frames && fwrite(frames, o->channels * sizeof(int16_t), n_frames, o->out) != n_frames) {
+        return -1;
+    }
+    o->frames += n_frames;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    static const struct option long_options[] = {
+        {"stored", no_argument, NULL, 's'},
+        {"help",   no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    archive_segment_header_t hdr;
+    output_t o;
+    int16_t *frames = NULL;
+    uint8_t *file;
+    size_t file_len;
+    unsigned int out_rate;
+    int stored = 0;
+    int opt;
+    int status = 1;
+
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        if (opt == 's') {
+            stored = 1;
+        } else {
+            fprintf(stderr, "Usage: %s [--stored] SEGMENT" ARCHIVE_SEGMENT_EXT " OUTPUT.wav\n"
+                            "  --stored   Write band segments at their stored rate instead of\n"
+                            "             expanding them back to the capture rate\n", argv[0]);
+            return 1;
+        }
+    }
+    if (argc - optind != 2) {
+        fprintf(stderr, "Usage: %s [--stored] SEGMENT" ARCHIVE_SEGMENT_EXT " OUTPUT.wav\n", argv[0]);
+        return 1;
+    }
+
+    file = read_file(argv[optind], &file_len);
+    if (!file) {
+        return 1;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    if (file_len < ARCHIVE_HEADER_BYTES || memcmp(file, ARCHIVE_MAGIC, 8) != 0) {
+        fprintf(stderr, "[ERROR] %s is not an archive segment\n", argv[optind]);
+        free(file);
+        return 1;
+    }
+    memcpy(&hdr, file, ((const archive_segment_header_t *)file)->version >= 2 ? sizeof(hdr) : V1_HEADER_BYTES);
+    if (hdr.version < 2) {
+        hdr.stored_rate = hdr.sample_rate;
+        hdr.decimation = 1;
+    }
+    if (hdr.channels == 0 || hdr.decimation == 0 || hdr.header_bytes > file_len ||
+        hdr.data_bytes > file_len - hdr.header_bytes) {
+        fprintf(stderr, "[ERROR] Corrupt segment header in %s\n", argv[optind]);
+        free(file);
+        return 1;
+    }
+
+    memset(&o, 0, sizeof(o));
+    o.channels = hdr.channels;
+    out_rate = hdr.stored_rate;
+    if (hdr.format == ARCHIVE_FORMAT_BAND && !stored) {
+        o.band = band_filter_create(hdr.sample_rate, hdr.channels, hdr.band_low_hz, hdr.band_high_hz,
+                                    hdr.band_transition_hz, hdr.decimation);
+        o.expanded = malloc((size_t)CODEC_BLOCK_FRAMES * hdr.decimation * hdr.channels * sizeof(int16_t));
+        if (!o.band || !o.expanded) {
+            fprintf(stderr, "[ERROR] Cannot set up band expansion\n");
+            goto done;
+        }
+        o.skip = hdr.filter_taps > hdr.decimation ? hdr.filter_taps - hdr.decimation : 0;
+        out_rate = hdr.sample_rate;
+    }
+
+    o.out = fopen(argv[optind + 1], "wb");
+    if (!o.out || write_wav_header(o.out, out_rate, hdr.channels, 0) < 0) {
+        fprintf(stderr, "[ERROR] Cannot create %s: %s\n", argv[optind + 1], strerror(errno));
+        goto done;
+    }
+
+    const uint8_t *data = file + hdr.header_bytes;
+    size_t len = (size_t)hdr.data_bytes;
+
+    if (hdr.format == ARCHIVE_FORMAT_S16LE) {
+        size_t n = len / (hdr.channels * sizeof(int16_t));
+        if (emit(&o, (const int16_t *)data, n) < 0) {
+            fprintf(stderr, "[ERROR] Cannot write %s: %s\n", argv[optind + 1], strerror(errno));
+            goto done;
+        }
+    } else if (hdr.format == ARCHIVE_FORMAT_LOSSLESS || hdr.format == ARCHIVE_FORMAT_BAND) {
+        size_t pos = 0;
+
+        frames = malloc((size_t)CODEC_BLOCK_FRAMES * hdr.channels * sizeof(int16_t));
+        if (!frames) {
+            goto done;
+        }
+        while (pos + CODEC_BLOCK_PREFIX_BYTES <= len) {
+            static const uint8_t zero[CODEC_BLOCK_PREFIX_BYTES];
+            size_t n;
+            long used;
+
+            // Filler up to the next header-sized boundary
+            if (memcmp(data + pos, zero, sizeof(zero)) == 0) {
+                pos = (pos / ARCHIVE_HEADER_BYTES + 1) * ARCHIVE_HEADER_BYTES;
+                continue;
+            }
+            used = codec_decode_block(data + pos, len - pos, hdr.channels, frames, CODEC_BLOCK_FRAMES, &n);
+            if (used < 0) {
+                fprintf(stderr, "[ERROR] Corrupt block at offset %zu in %s\n",
+                        hdr.header_bytes + pos, argv[optind]);
+                goto done;
+            }
+            if (emit(&o, frames, n) < 0) {
+                fprintf(stderr, "[ERROR] Cannot write %s: %s\n", argv[optind + 1], strerror(errno));
+                goto done;
+            }
+            pos += (size_t)used;
+        }
+    } else {
+        fprintf(stderr, "[ERROR] Unsupported segment format %u\n", hdr.format);
+        goto done;
+    }
+
+    if (write_wav_header(o.out, out_rate, hdr.channels, o.frames) < 0) {
+        goto done;
+    }
+    fprintf(stderr, "[INFO] Decoded %llu frames at %u Hz into %s\n",
+            (unsigned long long)o.frames, out_rate, argv[optind + 1]);
+    status = 0;
+
+done:
+    if (o.out && fclose(o.out) != 0) {
+        status = 1;
+    }
+    band_filter_destroy(o.band);
+    free(o.expanded);
+    free(frames);
+    free(file);
+    return status;
+}
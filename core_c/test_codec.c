@@ -0,0 +1,144 @@
+/*
+ * SilentTrace - Ultrasonic Signal Detector
+ * Lossless Codec Round-Trip Check
+ *
+ * Encodes blocks of random, sine, constant and full-scale audio, of full
+ * and odd lengths and several channel counts, decodes them again and checks
+ * that every sample comes back, that the block stays within
+ * codec_max_block_bytes and that a truncated block is rejected. Prints one
+ * line per failure and exits non-zero if there was any.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "codec.h"
+
+#define TEST_PI 3.14159265358979323846
+
+typedef enum {
+    SIGNAL_RANDOM,
+    SIGNAL_SINE,
+    SIGNAL_CONSTANT,
+    SIGNAL_FULL_SCALE
+} signal_t;
+
+static const char *signal_names[] = {"random", "sine", "constant", "full-scale"};
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static uint32_t next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t)(rng_state >> 32);
+}
+
+static void fill(int16_t *frames, size_t n_frames, unsigned int channels, signal_t signal) {
+    for (size_t i = 0; i < n_frames; i++) {
+        for (unsigned int c = 0; c < channels; c++) {
+            int16_t *s = &frames[i * channels + c];
+            switch (signal) {
+            case SIGNAL_RANDOM:
+                *s = (int16_t)(next_random() & 0xFFFF);
+                break;
+            case SIGNAL_SINE:
+                *s = (int16_t)lrint(12000.0 * sin(2.0 * TEST_PI * 19500.0 * i / 48000.0 + c));
+                break;
+            case SIGNAL_CONSTANT:
+                *s = (int16_t)(c % 2 ? -1234 : 777);
+                break;
+            case SIGNAL_FULL_SCALE:
+                // Square wave between the two rails, the largest residuals
+                *s = (i / (c + 1)) % 2 ? INT16_MIN : INT16_MAX;
+                break;
+            }
+        }
+    }
+}
+
+static int check(codec_encoder_t *enc, unsigned int channels, size_t n_frames, signal_t signal,
+                 int16_t *input, int16_t *output, uint8_t *block) {
+    size_t max_bytes = codec_max_block_bytes(channels, n_frames);
+    size_t bytes;
+    size_t decoded = 0;
+    long consumed;
+
+    fill(input, n_frames, channels, signal);
+    bytes = codec_encode_block(enc, input, n_frames, block);
+    if (bytes > max_bytes) {
+        printf("[FAIL] %s, %u channels, %zu frames: %zu bytes, codec_max_block_bytes says %zu\n",
+               signal_names[signal], channels, n_frames, bytes, max_bytes);
+        return -1;
+    }
+
+    consumed = codec_decode_block(block, bytes, channels, output, n_frames, &decoded);
+    if (consumed != (long)bytes || decoded != n_frames) {
+        printf("[FAIL] %s, %u channels, %zu frames: decoded %zu frames from %ld of %zu bytes\n",
+               signal_names[signal], channels, n_frames, decoded, consumed, bytes);
+        return -1;
+    }
+    if (memcmp(input, output, n_frames * channels * sizeof(int16_t)) != 0) {
+        printf("[FAIL] %s, %u channels, %zu frames: samples differ after decoding\n",
+               signal_names[signal], channels, n_frames);
+        return -1;
+    }
+
+    if (codec_decode_block(block, bytes - 1, channels, output, n_frames, &decoded) != -1) {
+        printf("[FAIL] %s, %u channels, %zu frames: truncated block decoded\n",
+               signal_names[signal], channels, n_frames);
+        return -1;
+    }
+    return 0;
+}
+
+int main(void) {
+    static const unsigned int channel_counts[] = {1, 2, 8};
+    static const size_t lengths[] = {CODEC_BLOCK_FRAMES, CODEC_BLOCK_FRAMES - 1, 1001, 7, 1};
+    size_t max_samples = CODEC_BLOCK_FRAMES * 8;
+    int16_t *input = malloc(max_samples * sizeof(int16_t));
+    int16_t *output = malloc(max_samples * sizeof(int16_t));
+    // Not sized by codec_max_block_bytes, so a block past its bound is
+    // reported instead of overrunning the buffer
+    uint8_t *block = malloc(2 * max_samples * sizeof(int16_t) + 1024);
+    int failures = 0;
+    int checks = 0;
+
+    if (!input || !output || !block) {
+        fprintf(stderr, "[ERROR] Out of memory\n");
+        return 1;
+    }
+
+    // A verbatim subframe is 3 bits of type and 16 per sample, after the prefix
+    checks++;
+    if (codec_max_block_bytes(1, 8) != CODEC_BLOCK_PREFIX_BYTES + 17 ||
+        codec_max_block_bytes(2, CODEC_BLOCK_FRAMES) != CODEC_BLOCK_PREFIX_BYTES + 16385) {
+        printf("[FAIL] codec_max_block_bytes gives %zu and %zu\n", codec_max_block_bytes(1, 8),
+               codec_max_block_bytes(2, CODEC_BLOCK_FRAMES));
+        failures++;
+    }
+
+    for (size_t c = 0; c < sizeof(channel_counts) / sizeof(channel_counts[0]); c++) {
+        codec_encoder_t *enc = codec_encoder_create(channel_counts[c], CODEC_BLOCK_FRAMES);
+        if (!enc) {
+            fprintf(stderr, "[ERROR] Cannot create the encoder\n");
+            return 1;
+        }
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+            for (int s = SIGNAL_RANDOM; s <= SIGNAL_FULL_SCALE; s++) {
+                checks++;
+                if (check(enc, channel_counts[c], lengths[l], (signal_t)s, input, output, block) < 0) {
+                    failures++;
+                }
+            }
+        }
+        codec_encoder_destroy(enc);
+    }
+
+    free(input);
+    free(output);
+    free(block);
+    printf("Codec round trip: %d of %d checks failed\n", failures, checks);
+    return failures ? 1 : 0;
+}
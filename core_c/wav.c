@@ -0,0 +1,43 @@
+/*
+ * SilentTrace - Ultrasonic Signal Detector
+ * WAV File Header
+ */
+
+#include <string.h>
+#include "wav.h"
+
+static void put_le16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_le32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+int wav_header(uint8_t hdr[WAV_HEADER_BYTES], unsigned int rate, unsigned int channels,
+               uint64_t frames) {
+    uint32_t frame_bytes = channels * (uint32_t)sizeof(int16_t);
+    uint64_t data_bytes = frames * frame_bytes;
+
+    if (data_bytes > UINT32_MAX - 36) {
+        return -1;
+    }
+
+    memcpy(hdr, "RIFF", 4);
+    put_le32(hdr + 4, 36 + (uint32_t)data_bytes);
+    memcpy(hdr + 8, "WAVEfmt ", 8);
+    put_le32(hdr + 16, 16);
+    put_le16(hdr + 20, 1);                                  // PCM
+    put_le16(hdr + 22, (uint16_t)channels);
+    put_le32(hdr + 24, rate);
+    put_le32(hdr + 28, rate * frame_bytes);
+    put_le16(hdr + 32, (uint16_t)frame_bytes);
+    put_le16(hdr + 34, 16);
+    memcpy(hdr + 36, "data", 4);
+    put_le32(hdr + 40, (uint32_t)data_bytes);
+    return 0;
+}
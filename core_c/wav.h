@@ -0,0 +1,21 @@
+/*
+ * SilentTrace - Ultrasonic Signal Detector
+ * WAV File Header
+ *
+ * The 44-byte RIFF header of a 16-bit PCM WAV file, shared by the evidence
+ * clip writer and the archive segment decoder.
+ */
+
+#ifndef WAV_H
+#define WAV_H
+
+#include <stdint.h>
+
+#define WAV_HEADER_BYTES 44
+
+// Fill hdr for frames of channels x 16-bit samples at rate; -1 when the
+// data would not fit the 32-bit RIFF sizes (the 4GB WAV limit)
+int wav_header(uint8_t hdr[WAV_HEADER_BYTES], unsigned int rate, unsigned int channels,
+               uint64_t frames);
+
+#endif